@@ -72,6 +72,31 @@ namespace KayLib
         std::string whatString;
     };
 
+    class ImmutableValueException : public std::exception
+    {
+    public:
+
+        ImmutableValueException(const std::string valueType)
+        {
+            type = valueType;
+            whatString = "Attempt to modify a frozen " + type + ".";
+        }
+
+        virtual const char *what() const throw ()
+        {
+            return whatString.c_str();
+        };
+
+        std::string valueType()
+        {
+            return type;
+        };
+
+    private:
+        std::string type;
+        std::string whatString;
+    };
+
     class ParserException : public std::exception
     {
     public:
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KMAPPEDFILE_H
+#define KMAPPEDFILE_H
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace KayLib
+{
+
+    /**
+     * A file mapped read only into memory, so it can be parsed in place by
+     * StringParser, JSONDocument or XMLDocument without first reading it into
+     * a string.  Pages are only loaded as they are read and can be dropped again
+     * by the system, so large files do not need the memory of a copy.
+     * Files that can not be mapped, such as pipes, are read into memory instead.
+     */
+    class KMappedFile
+    {
+    public:
+
+        /**
+         * Map a file.
+         * @param fileName The file to map.
+         * @param sequential True if the file will be read from start to end, so the
+         * system reads ahead and drops pages that have been read.
+         */
+        KMappedFile(const std::string &fileName, bool sequential = true)
+        {
+            map = nullptr;
+            mapLength = 0;
+            error = 0;
+            open(fileName, sequential);
+            opened = error == 0;
+        }
+
+        KMappedFile(const KMappedFile &orig) = delete;
+
+        KMappedFile &operator=(const KMappedFile &orig) = delete;
+
+        virtual ~KMappedFile()
+        {
+            close();
+        }
+
+        /**
+         * Check if the file was opened and has not been closed.
+         * @return True if the contents are available.
+         */
+        bool isOpen() const
+        {
+            return opened;
+        }
+
+        /**
+         * Get the reason the file could not be opened.
+         * @return The errno value or 0.
+         */
+        int getError() const
+        {
+            return error;
+        }
+
+        /**
+         * Get the contents of the file.
+         * @return The contents.  They are only valid while the file is open.
+         */
+        const char *data() const
+        {
+            return map != nullptr ? map : buffer.data();
+        }
+
+        /**
+         * Get the size of the file.
+         * @return The number of bytes.
+         */
+        size_t size() const
+        {
+            return map != nullptr ? mapLength : buffer.length();
+        }
+
+        /**
+         * Release the contents.
+         */
+        void close()
+        {
+#ifndef _WIN32
+            if(map != nullptr)
+            {
+                munmap((void *) map, mapLength);
+            }
+#endif
+            map = nullptr;
+            mapLength = 0;
+            buffer.clear();
+            opened = false;
+        }
+
+    private:
+        const char *map;
+        size_t mapLength;
+        // The contents of files that could not be mapped.
+        std::string buffer;
+        int error;
+        // An empty file is open without contents, so this is kept apart.
+        bool opened;
+
+        void open(const std::string &fileName, bool sequential)
+        {
+#ifndef _WIN32
+            int fd = ::open(fileName.c_str(), O_RDONLY);
+            if(fd < 0)
+            {
+                error = errno;
+                return;
+            }
+            struct stat info;
+            if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+            {
+                void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(mapped != MAP_FAILED)
+                {
+                    map = (const char *) mapped;
+                    mapLength = info.st_size;
+                    if(sequential)
+                    {
+                        madvise(mapped, mapLength, MADV_SEQUENTIAL);
+                    }
+                    ::close(fd);
+                    return;
+                }
+            }
+            // Not a regular file, or it could not be mapped.
+            char chunk[64 * 1024];
+            ssize_t got;
+            while((got = ::read(fd, chunk, sizeof (chunk))) != 0)
+            {
+                if(got < 0)
+                {
+                    if(errno == EINTR)
+                    {
+                        continue;
+                    }
+                    error = errno;
+                    buffer.clear();
+                    break;
+                }
+                buffer.append(chunk, got);
+            }
+            ::close(fd);
+#else
+            std::ifstream in(fileName, std::ios::binary);
+            if(!in)
+            {
+                error = ENOENT;
+                return;
+            }
+            std::stringstream contents;
+            contents << in.rdbuf();
+            buffer = contents.str();
+#endif
+        }
+    };
+
+}
+
+#endif /* KMAPPEDFILE_H */
@@ -19,12 +19,23 @@
 
 #include <mutex>
 #include <vector>
-#include <map>
 #include <memory>
 #include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <algorithm>
 
 #include "../Parser/StringParser.h"
+#include "../Parser/JSONIndex.h"
+#include "../Parser/JSONWriter.h"
 #include "../String/KString.h"
+#include "../String/KNumber.h"
+#include "../String/KUTF.h"
+#include "../IO/Exceptions.h"
+#include "../Utility/KArena.h"
 
 namespace KayLib
 {
@@ -36,7 +47,7 @@ namespace KayLib
 
     enum class JSONError
     {
-        NONE, UnexpectedEndOfDocument, InvalidSyntax, InvalidObjectName
+        NONE, UnexpectedEndOfDocument, InvalidSyntax, InvalidObjectName, LimitExceeded, InvalidNumber
     };
 
     std::string JSONErrorString(JSONError err)
@@ -55,10 +66,154 @@ namespace KayLib
             case JSONError::InvalidObjectName:
                 return "A JSONObject name was improperly formated";
                 break;
+            case JSONError::LimitExceeded:
+                return "A token or the nesting depth exceeded the parser limits";
+                break;
+            case JSONError::InvalidNumber:
+                return "A number does not fit in the value it is read into";
+                break;
         }
         return "Unknown error";
     }
 
+    /**
+     * Options that control how a JSONDocument is parsed.
+     * Options can be combined with the '|' operator.
+     */
+    enum class JSONParseOptions : int
+    {
+        NONE = 0,
+        // Allocate all values and string data from an arena owned by the document.
+        ARENA = 1,
+        // Strings and names without escape sequences refer to the source string instead of being copied.
+        STRING_VIEWS = 2,
+        // Find the document structure with vector instructions before building the values.
+        // Errors are reported as they are without it.
+        STRUCTURAL_INDEX = 4,
+        // Freeze all values so they can be read from any number of threads without locking.
+        FROZEN = 8
+    };
+
+    inline JSONParseOptions operator|(JSONParseOptions a, JSONParseOptions b)
+    {
+        return static_cast<JSONParseOptions> (static_cast<int> (a) | static_cast<int> (b));
+    }
+
+    inline JSONParseOptions operator&(JSONParseOptions a, JSONParseOptions b)
+    {
+        return static_cast<JSONParseOptions> (static_cast<int> (a) & static_cast<int> (b));
+    }
+
+    /**
+     * Text that is either owned or borrowed from memory that outlives it,
+     * such as a document arena or the string a document was parsed from.
+     */
+    class JSONText
+    {
+    public:
+
+        JSONText() : ptr(nullptr), len(0) { }
+
+        explicit JSONText(const std::string &str) : owned(str), ptr(nullptr), len(0) { }
+
+        explicit JSONText(std::string &&str) : owned(std::move(str)), ptr(nullptr), len(0) { }
+
+        /**
+         * Create text that refers to memory owned by someone else.
+         * @param str The characters.
+         * @param length The number of characters.
+         * @return The text.
+         */
+        static JSONText borrow(const char *str, size_t length)
+        {
+            JSONText text;
+            text.ptr = str;
+            text.len = length;
+            return text;
+        }
+
+        /**
+         * Get the characters of the text.
+         * @return The characters, not necessarily null terminated.
+         */
+        const char *data() const
+        {
+            return ptr != nullptr ? ptr : owned.data();
+        }
+
+        /**
+         * Get the length of the text.
+         * @return The number of characters.
+         */
+        size_t length() const
+        {
+            return ptr != nullptr ? len : owned.length();
+        }
+
+        /**
+         * Is the text borrowed from memory it does not own?
+         * @return True if borrowed.
+         */
+        bool isBorrowed() const
+        {
+            return ptr != nullptr;
+        }
+
+        /**
+         * Get a copy of the text.
+         * @return The text.
+         */
+        std::string str() const
+        {
+            return ptr != nullptr ? std::string(ptr, len) : owned;
+        }
+
+        /**
+         * Take a private copy of borrowed text so it no longer depends on the lender.
+         */
+        void own()
+        {
+            if(ptr != nullptr)
+            {
+                owned.assign(ptr, len);
+                ptr = nullptr;
+                len = 0;
+            }
+        }
+
+        /**
+         * Compare two texts the same way std::string does.
+         * @param other The text to compare to.
+         * @return Less than, equal to or greater than zero.
+         */
+        int compare(const JSONText &other) const
+        {
+            size_t l1 = length();
+            size_t l2 = other.length();
+            int res = l1 == 0 || l2 == 0 ? 0 : std::memcmp(data(), other.data(), l1 < l2 ? l1 : l2);
+            if(res != 0)
+            {
+                return res;
+            }
+            return l1 < l2 ? -1 : (l1 > l2 ? 1 : 0);
+        }
+
+        bool operator<(const JSONText &other) const
+        {
+            return compare(other) < 0;
+        }
+
+        bool operator==(const JSONText &other) const
+        {
+            return length() == other.length() && compare(other) == 0;
+        }
+
+    private:
+        std::string owned;
+        const char *ptr;
+        size_t len;
+    };
+
     class JSONObject;
     class JSONArray;
     class JSONString;
@@ -68,7 +223,19 @@ namespace KayLib
 
     class JSONValue
     {
+        friend class JSONDocument;
+        friend class JSONPointer;
+        friend class JSONSchema;
+        friend class JSONPatch;
     public:
+
+        JSONValue() : arena(nullptr), frozen(false) { }
+
+        // Values are copied with copy(), the mutex and arena belong to each value.
+        JSONValue &operator=(const JSONValue &orig) = delete;
+
+        virtual ~JSONValue() { }
+
         /**
          * Get the type of value this object represents.
          * @return The value type.
@@ -89,6 +256,12 @@ namespace KayLib
          */
         virtual void format(std::ostream &out, const std::string &current, const std::string &indent) const = 0;
 
+        /**
+         * Write the value to a JSONWriter.
+         * @param writer The writer.
+         */
+        virtual void write(JSONWriter &writer) const = 0;
+
         /**
          * Prints the value to an output stream without formating.
          * @param out The output stream.
@@ -101,6 +274,26 @@ namespace KayLib
             return out;
         }
 
+        /**
+         * Make the value, and all values it contains, read only.
+         * Frozen values are read without locking so any number of threads can read them at once.
+         * @note Freeze a value before sharing it between threads.  Freezing is permanent,
+         * use copy() to get a value that can be changed.
+         */
+        virtual void freeze()
+        {
+            frozen = true;
+        }
+
+        /**
+         * Check if the value is read only.
+         * @return True if the value is frozen.
+         */
+        bool isFrozen() const
+        {
+            return frozen;
+        }
+
         /**
          * Check if this is a JSONObject.
          * @return True if this is a JSONObject.
@@ -156,12 +349,86 @@ namespace KayLib
         };
 
     protected:
+        // Embedded so mutable values, arena values included, need no allocation to lock.
         mutable std::mutex lockPtr;
+        // The arena the value was created in or nullptr if it is heap allocated.
+        KArena *arena;
+        bool frozen;
 
         inline std::unique_lock<std::mutex> getLock() const
         {
+            if(frozen)
+            {
+                // Nothing can change a frozen value.
+                return std::unique_lock<std::mutex>();
+            }
             return std::unique_lock<std::mutex>(lockPtr);
         }
+
+        /**
+         * Throw if the value is frozen.
+         */
+        void checkMutable() const
+        {
+            if(frozen)
+            {
+                throw ImmutableValueException(typeName());
+            }
+        }
+
+        /**
+         * Get the name of the value type for messages.
+         */
+        std::string typeName() const
+        {
+            switch(type())
+            {
+                case JSONType::OBJECT:
+                    return "JSONObject";
+                case JSONType::ARRAY:
+                    return "JSONArray";
+                case JSONType::STRING:
+                    return "JSONString";
+                case JSONType::NUMBER:
+                    return "JSONNumber";
+                case JSONType::BOOL:
+                    return "JSONBool";
+                case JSONType::_NULL:
+                    return "JSONNull";
+            }
+            return "JSONValue";
+        }
+
+        /**
+         * Get a pointer that keeps the value alive.
+         * Arena values are kept alive by sharing ownership of their arena.
+         * @param value The value.
+         * @return The owning pointer.
+         */
+        static std::shared_ptr<JSONValue> share(const std::shared_ptr<JSONValue> &value)
+        {
+            if(value && value->arena != nullptr)
+            {
+                return std::shared_ptr<JSONValue>(value->arena->shared_from_this(), value.get());
+            }
+            return value;
+        }
+
+        /**
+         * Get the pointer a container should store for a child value.
+         * Children from the container's own arena are stored without ownership
+         * so the arena does not end up owning itself.
+         * @param value The child value.
+         * @return The pointer to store.
+         */
+        std::shared_ptr<JSONValue> adopt(std::shared_ptr<JSONValue> value) const
+        {
+            if(value && arena != nullptr && value->arena == arena)
+            {
+                return std::shared_ptr<JSONValue>(std::shared_ptr<JSONValue>(), value.get());
+            }
+            return value;
+        }
     };
 
     class JSONNull : public JSONValue
@@ -193,6 +460,11 @@ namespace KayLib
             out << "null";
         }
 
+        virtual void write(JSONWriter &writer) const override
+        {
+            writer.null();
+        }
+
     };
 
     class JSONString : public JSONValue
@@ -201,12 +473,33 @@ namespace KayLib
 
         JSONString(const std::string &nValue)
         {
-            value = KString::escape(nValue, true);
+            value = JSONText(KString::escape(nValue, true));
+        }
+
+        /**
+         * Create a string, taking the text without copying it when it needs no escapes.
+         * @param nValue The string.
+         */
+        JSONString(std::string &&nValue)
+        {
+            value = escapeText(std::move(nValue));
+        }
+
+        /**
+         * Create a string from text that is already escaped.
+         * @param nValue The escaped text.
+         */
+        JSONString(const JSONText &nValue)
+        {
+            value = nValue;
         }
 
         JSONString(const JSONString& orig)
         {
+            std::unique_lock<std::mutex> uLock = orig.getLock();
             value = orig.value;
+            // Copies must not depend on the lifetime of the original.
+            value.own();
         }
 
         virtual ~JSONString() { }
@@ -228,7 +521,15 @@ namespace KayLib
         virtual void format(std::ostream &out, const std::string &current, const std::string &indent) const override
         {
             std::unique_lock<std::mutex> uLock = getLock();
-            out << "\"" << value << "\"";
+            out << "\"";
+            out.write(value.data(), value.length());
+            out << "\"";
+        }
+
+        virtual void write(JSONWriter &writer) const override
+        {
+            std::unique_lock<std::mutex> uLock = getLock();
+            writer.escapedString(value.data(), value.length());
         }
 
         /**
@@ -238,21 +539,42 @@ namespace KayLib
         std::string getValue() const
         {
             std::unique_lock<std::mutex> uLock = getLock();
-            return value;
+            return value.str();
         }
 
         /**
          * Set the value of this string.
          * @param nValue The value to set this string to.
          */
-        void set(const std::string &nValue)
+        void set(std::string nValue)
         {
+            checkMutable();
+            JSONText text = escapeText(std::move(nValue));
             std::unique_lock<std::mutex> uLock = getLock();
-            value = KString::escape(nValue, true);
+            value = std::move(text);
         }
 
     private:
-        std::string value;
+        friend class JSONDocument;
+        friend class JSONSchema;
+        JSONText value;
+
+        /**
+         * Escape a string, keeping it as is when KString::escape would not change it.
+         * @param str The string.
+         * @return The escaped text.
+         */
+        static JSONText escapeText(std::string &&str)
+        {
+            for(char c : str)
+            {
+                if(c == '\\' || c == '\"' || c == '\'' || c <= 0x0F)
+                {
+                    return JSONText(KString::escape(str, true));
+                }
+            }
+            return JSONText(std::move(str));
+        }
     };
 
     class JSONNumber : public JSONValue
@@ -269,10 +591,11 @@ namespace KayLib
         JSONNumber(const double nValue)
         {
             _isDouble = true;
-            lNumber = (long) nValue;
+            lNumber = KNumber::toLong(nValue);
             dNumber = nValue;
-            if(!std::isnormal(nValue))
+            if(!std::isfinite(nValue))
             {
+                // JSON has no infinity or NaN.
                 lNumber = 0;
                 dNumber = 0;
             }
@@ -303,18 +626,24 @@ namespace KayLib
         }
 
         virtual void format(std::ostream &out, const std::string &current, const std::string &indent) const override
+        {
+            std::unique_lock<std::mutex> uLock = getLock();
+            char buf[32];
+            // Doubles are written with the fewest digits that read back to the same value.
+            int len = _isDouble ? KNumber::format(dNumber, buf) : KNumber::format(lNumber, buf);
+            out.write(buf, len);
+        }
+
+        virtual void write(JSONWriter &writer) const override
         {
             std::unique_lock<std::mutex> uLock = getLock();
             if(_isDouble)
             {
-                char buf[100];
-                snprintf(buf, 100, "%.17g", dNumber);
-                out << buf;
-                //    out << std::to_string(dNumber);
+                writer.number(dNumber);
             }
             else
             {
-                out << std::to_string(lNumber);
+                writer.number(lNumber);
             }
         }
 
@@ -362,6 +691,7 @@ namespace KayLib
          */
         void set(long nValue)
         {
+            checkMutable();
             std::unique_lock<std::mutex> uLock = getLock();
             _isDouble = false;
             lNumber = nValue;
@@ -374,18 +704,36 @@ namespace KayLib
          */
         void set(double nValue)
         {
+            checkMutable();
             std::unique_lock<std::mutex> uLock = getLock();
             _isDouble = true;
-            lNumber = (long) nValue;
+            lNumber = KNumber::toLong(nValue);
             dNumber = nValue;
-            if(!std::isnormal(nValue))
+            if(!std::isfinite(nValue))
             {
+                // JSON has no infinity or NaN.
                 lNumber = 0;
                 dNumber = 0;
             }
         }
 
+        /**
+         * Parse a number from text.
+         * @param str The first character of the number.  Advanced past the number.
+         * @param end The end of the text.
+         * @param lValue Set to the value if it is an integer.
+         * @param dValue Set to the value if it is a double.
+         * @return True if the number is a double.
+         */
+        static bool parseText(const char *&str, const char *end, long &lValue, double &dValue)
+        {
+            bool isDouble;
+            str = KNumber::parse(str, end, lValue, dValue, isDouble);
+            return isDouble;
+        }
+
     private:
+        friend class JSONSchema;
         bool _isDouble;
         long lNumber;
         double dNumber;
@@ -428,6 +776,12 @@ namespace KayLib
             out << (value ? "true" : "false");
         }
 
+        virtual void write(JSONWriter &writer) const override
+        {
+            std::unique_lock<std::mutex> uLock = getLock();
+            writer.boolean(value);
+        }
+
         /**
          * Get the value of this bool.
          * @return The value.
@@ -444,6 +798,7 @@ namespace KayLib
          */
         void set(bool nValue)
         {
+            checkMutable();
             std::unique_lock<std::mutex> uLock = getLock();
             value = nValue;
         }
@@ -452,158 +807,427 @@ namespace KayLib
         bool value;
     };
 
-    class JSONObject : public JSONValue
+    /**
+     * The members of a JSONObject in the order they were added.
+     * Small objects are searched directly, larger ones through an open addressing
+     * hash table of member positions.  Every member keeps the hash of its name.
+     */
+    class JSONMembers
     {
     public:
 
-        JSONObject() { }
-
-        JSONObject(const JSONObject& orig)
-        {
-            std::unique_lock<std::mutex> uLock = orig.getLock();
-            for(auto value : orig.values)
-            {
-                if(value.second)
-                {
-                    values[value.first] = std::shared_ptr<JSONValue>(value.second->copy());
-                }
-            }
-        }
-
-        virtual ~JSONObject() { }
-
-        virtual JSONType type() const override
+        struct Member
         {
-            return JSONType::OBJECT;
+            JSONText name;
+            std::shared_ptr<JSONValue> value;
+            uint64_t hash;
         };
 
+        typedef std::vector<Member>::iterator iterator;
+        typedef std::vector<Member>::const_iterator const_iterator;
+
         /**
-         * Create a copy of the value.
-         * @return The copy.
+         * Hash a member name.
+         * @param name The name.
+         * @param length The length of the name.
+         * @return The hash.
          */
-        JSONValue *copy() const override
-        {
-            return new JSONObject(*this);
-        }
-
-        virtual void format(std::ostream &out, const std::string &current, const std::string &indent) const override
+        static uint64_t hash(const char *name, size_t length)
         {
-            out << "{" << std::endl;
-            bool first = true;
-            std::unique_lock<std::mutex> uLock = getLock();
-            for(auto value : values)
+            // FNV-1a
+            uint64_t h = 14695981039346656037ULL;
+            for(size_t i = 0; i < length; i++)
             {
-                if(!first)
-                {
-                    out << "," << std::endl;
-                }
-                out << current + indent << "\"" << value.first << "\" : ";
-                value.second->format(out, current + indent, indent);
-                first = false;
+                h ^= (unsigned char) name[i];
+                h *= 1099511628211ULL;
             }
-            out << std::endl << current + "}";
+            return h;
         }
 
         /**
-         * Get the names of all values of this element.
-         * @return The list of value names.
+         * Find a member.
+         * @param name The name of the member.
+         * @param length The length of the name.
+         * @param h The hash of the name.
+         * @return The member or nullptr if not found.
          */
-        std::vector<std::string> getValueNames() const
+        const Member *find(const char *name, size_t length, uint64_t h) const
         {
-            std::unique_lock<std::mutex> uLock = getLock();
-            std::vector<std::string> names;
-            for(auto entry : values)
+            if(slots.empty())
             {
-                names.push_back(entry.first);
+                for(auto &member : members)
+                {
+                    if(member.hash == h && equals(member, name, length))
+                    {
+                        return &member;
+                    }
+                }
+                return nullptr;
+            }
+            size_t mask = slots.size() - 1;
+            for(size_t slot = h & mask;; slot = (slot + 1) & mask)
+            {
+                uint32_t pos = slots[slot];
+                if(pos == 0)
+                {
+                    return nullptr;
+                }
+                const Member &member = members[pos - 1];
+                if(member.hash == h && equals(member, name, length))
+                {
+                    return &member;
+                }
             }
-            return names;
         }
 
-        /**
-         * Check if the named value exists.
-         * @param valName The value to check for.
-         * @return True if the value exists. False if not.
-         */
-        bool hasValue(const std::string &valName) const
+        const Member *find(const char *name, size_t length) const
         {
-            std::unique_lock<std::mutex> uLock = getLock();
-            return values.find(valName) != values.end();
+            return find(name, length, hash(name, length));
         }
 
         /**
-         * Get the named value.
-         * @param valName The value to get.
-         * @return The value or nullptr if not found.
+         * Add a member or replace the value of an existing one.
+         * A replaced member keeps its position.
+         * @param name The name of the member.
+         * @param value The value.
          */
-        std::shared_ptr<JSONValue> getValue(const std::string &valName) const
+        void set(JSONText name, std::shared_ptr<JSONValue> value)
         {
-            std::unique_lock<std::mutex> uLock = getLock();
-            auto itr = values.find(valName);
-            if(itr == values.end())
+            uint64_t h = hash(name.data(), name.length());
+            const Member *found = find(name.data(), name.length(), h);
+            if(found != nullptr)
             {
-                return nullptr;
+                const_cast<Member *> (found)->value = std::move(value);
+                return;
             }
-            return itr->second;
+            add(std::move(name), std::move(value), h);
         }
 
         /**
-         * Get the named value if it is a JSONString.
-         * @param valName The value to get.
-         * @return The value or nullptr if not found.
+         * Add a member that is known not to exist yet.
+         * @param name The name of the member.
+         * @param value The value.
+         * @param h The hash of the name.
          */
-        std::shared_ptr<JSONString> getValueAsString(const std::string &valName) const
+        void add(JSONText name, std::shared_ptr<JSONValue> value, uint64_t h)
         {
-            std::shared_ptr<JSONValue> val = getValue(valName);
-            if(val.get() == nullptr)
+            members.push_back(Member{std::move(name), std::move(value), h});
+            if(!slots.empty() && members.size() * 2 <= slots.size())
             {
-                return nullptr;
+                place(members.size() - 1);
             }
-            if(val->type() != JSONType::STRING)
+            else if(members.size() > INDEX_THRESHOLD)
             {
-                return nullptr;
+                rebuild();
             }
-            return std::dynamic_pointer_cast<JSONString>(val);
         }
 
         /**
-         * Get the named value if it is a JSONNumber.
-         * @param valName The value to get.
-         * @return The value or nullptr if not found.
+         * Remove a member.  The members after it move up one position.
+         * @param name The name of the member.
+         * @param length The length of the name.
+         * @return True if the member existed.
          */
-        std::shared_ptr<JSONNumber> getValueAsNumber(const std::string &valName) const
+        bool remove(const char *name, size_t length)
         {
-            std::shared_ptr<JSONValue> val = getValue(valName);
-            if(val.get() == nullptr)
+            const Member *found = find(name, length);
+            if(found == nullptr)
             {
-                return nullptr;
+                return false;
             }
-            if(val->type() != JSONType::NUMBER)
+            members.erase(members.begin() + (found - members.data()));
+            if(members.size() > INDEX_THRESHOLD)
             {
-                return nullptr;
+                rebuild();
             }
-            return std::dynamic_pointer_cast<JSONNumber>(val);
+            else
+            {
+                slots.clear();
+            }
+            return true;
         }
 
         /**
-         * Get the named value if it is a JSONBool.
-         * @param valName The value to get.
-         * @return The value or nullptr if not found.
+         * Reserve room for members.
+         * @param count The expected number of members.
          */
-        std::shared_ptr<JSONBool> getValueAsBool(const std::string &valName) const
+        void reserve(size_t count)
         {
-            std::shared_ptr<JSONValue> val = getValue(valName);
-            if(val.get() == nullptr)
-            {
-                return nullptr;
-            }
-            if(val->type() != JSONType::BOOL)
-            {
-                return nullptr;
-            }
-            return std::dynamic_pointer_cast<JSONBool>(val);
+            members.reserve(count);
         }
 
-        /**
+        size_t size() const
+        {
+            return members.size();
+        }
+
+        bool empty() const
+        {
+            return members.empty();
+        }
+
+        iterator begin()
+        {
+            return members.begin();
+        }
+
+        iterator end()
+        {
+            return members.end();
+        }
+
+        const_iterator begin() const
+        {
+            return members.begin();
+        }
+
+        const_iterator end() const
+        {
+            return members.end();
+        }
+
+    private:
+        // Objects with up to this many members are searched without a hash table.
+        static const size_t INDEX_THRESHOLD = 8;
+
+        std::vector<Member> members;
+        // Member positions plus one, zero marks an empty slot.
+        std::vector<uint32_t> slots;
+
+        static bool equals(const Member &member, const char *name, size_t length)
+        {
+            return member.name.length() == length && (length == 0 || std::memcmp(member.name.data(), name, length) == 0);
+        }
+
+        void place(size_t pos)
+        {
+            size_t mask = slots.size() - 1;
+            size_t slot = members[pos].hash & mask;
+            while(slots[slot] != 0)
+            {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot] = (uint32_t) (pos + 1);
+        }
+
+        void rebuild()
+        {
+            size_t capacity = 16;
+            while(capacity < members.size() * 2)
+            {
+                capacity *= 2;
+            }
+            slots.assign(capacity, 0);
+            for(size_t pos = 0; pos < members.size(); pos++)
+            {
+                place(pos);
+            }
+        }
+    };
+
+    class JSONObject : public JSONValue
+    {
+    public:
+
+        JSONObject() { }
+
+        JSONObject(const JSONObject& orig)
+        {
+            copyValues(orig);
+        }
+
+        /**
+         * Take the values of another object, which is left empty.
+         * Frozen objects can not be changed so their values are copied.
+         */
+        JSONObject(JSONObject &&orig)
+        {
+            if(orig.frozen)
+            {
+                copyValues(orig);
+                return;
+            }
+            std::unique_lock<std::mutex> uLock = orig.getLock();
+            values = std::move(orig.values);
+            orig.values = JSONMembers();
+            if(orig.arena != nullptr)
+            {
+                // This object is not in the arena, so it must keep the arena alive.
+                for(auto &member : values)
+                {
+                    member.name.own();
+                    member.value = share(member.value);
+                }
+            }
+        }
+
+        virtual ~JSONObject() { }
+
+        virtual JSONType type() const override
+        {
+            return JSONType::OBJECT;
+        };
+
+        /**
+         * Create a copy of the value.
+         * @return The copy.
+         */
+        JSONValue *copy() const override
+        {
+            return new JSONObject(*this);
+        }
+
+        virtual void format(std::ostream &out, const std::string &current, const std::string &indent) const override
+        {
+            std::unique_lock<std::mutex> uLock = getLock();
+            if(values.empty())
+            {
+                out << "{}";
+                return;
+            }
+            std::string inner = current + indent;
+            out << "{\n";
+            bool first = true;
+            for(auto &member : values)
+            {
+                if(!first)
+                {
+                    out << ",\n";
+                }
+                out << inner << "\"";
+                out.write(member.name.data(), member.name.length());
+                out << "\" : ";
+                member.value->format(out, inner, indent);
+                first = false;
+            }
+            out << "\n" << current << "}";
+        }
+
+        virtual void write(JSONWriter &writer) const override
+        {
+            std::unique_lock<std::mutex> uLock = getLock();
+            writer.startObject();
+            for(auto &member : values)
+            {
+                writer.escapedKey(member.name.data(), member.name.length());
+                member.value->write(writer);
+            }
+            writer.endObject();
+        }
+
+        /**
+         * Get the names of all values of this element.
+         * @return The list of value names in the order they were added.
+         */
+        std::vector<std::string> getValueNames() const
+        {
+            std::unique_lock<std::mutex> uLock = getLock();
+            std::vector<std::string> names;
+            names.reserve(values.size());
+            for(auto &member : values)
+            {
+                names.push_back(member.name.str());
+            }
+            return names;
+        }
+
+        /**
+         * Check if the named value exists.
+         * @param valName The value to check for.
+         * @return True if the value exists. False if not.
+         */
+        bool hasValue(const std::string &valName) const
+        {
+            std::unique_lock<std::mutex> uLock = getLock();
+            return values.find(valName.data(), valName.length()) != nullptr;
+        }
+
+        /**
+         * Remove the named value.
+         * @param valName The value to remove.
+         * @return True if the value existed.
+         */
+        bool removeValue(const std::string &valName)
+        {
+            checkMutable();
+            std::unique_lock<std::mutex> uLock = getLock();
+            return values.remove(valName.data(), valName.length());
+        }
+
+        /**
+         * Get the named value.
+         * @param valName The value to get.
+         * @return The value or nullptr if not found.
+         */
+        std::shared_ptr<JSONValue> getValue(const std::string &valName) const
+        {
+            std::unique_lock<std::mutex> uLock = getLock();
+            const JSONMembers::Member *member = values.find(valName.data(), valName.length());
+            if(member == nullptr)
+            {
+                return nullptr;
+            }
+            return share(member->value);
+        }
+
+        /**
+         * Get the named value if it is a JSONString.
+         * @param valName The value to get.
+         * @return The value or nullptr if not found.
+         */
+        std::shared_ptr<JSONString> getValueAsString(const std::string &valName) const
+        {
+            std::shared_ptr<JSONValue> val = getValue(valName);
+            if(val.get() == nullptr)
+            {
+                return nullptr;
+            }
+            if(val->type() != JSONType::STRING)
+            {
+                return nullptr;
+            }
+            return std::dynamic_pointer_cast<JSONString>(val);
+        }
+
+        /**
+         * Get the named value if it is a JSONNumber.
+         * @param valName The value to get.
+         * @return The value or nullptr if not found.
+         */
+        std::shared_ptr<JSONNumber> getValueAsNumber(const std::string &valName) const
+        {
+            std::shared_ptr<JSONValue> val = getValue(valName);
+            if(val.get() == nullptr)
+            {
+                return nullptr;
+            }
+            if(val->type() != JSONType::NUMBER)
+            {
+                return nullptr;
+            }
+            return std::dynamic_pointer_cast<JSONNumber>(val);
+        }
+
+        /**
+         * Get the named value if it is a JSONBool.
+         * @param valName The value to get.
+         * @return The value or nullptr if not found.
+         */
+        std::shared_ptr<JSONBool> getValueAsBool(const std::string &valName) const
+        {
+            std::shared_ptr<JSONValue> val = getValue(valName);
+            if(val.get() == nullptr)
+            {
+                return nullptr;
+            }
+            if(val->type() != JSONType::BOOL)
+            {
+                return nullptr;
+            }
+            return std::dynamic_pointer_cast<JSONBool>(val);
+        }
+
+        /**
          * Get the named value if it is a JSONNull.
          * @param valName The value to get.
          * @return The value or nullptr if not found.
@@ -667,21 +1291,65 @@ namespace KayLib
          */
         std::string getString(const std::string &valName) const
         {
-            std::shared_ptr<JSONValue> val = getValue(valName);
-            if(val.get() == nullptr)
+            std::shared_ptr<JSONValue> hold;
+            return valueToString(findValue(valName, hold));
+        }
+
+        /**
+         * Get the named value if it can be represented as a int.
+         * @param valName The value to get.
+         * @return The value or zero if not found.
+         * @note a value of zero does not guarantee that it is a valid result.
+         */
+        long getInt(const std::string &valName) const
+        {
+            std::shared_ptr<JSONValue> hold;
+            return valueToInt(findValue(valName, hold));
+        }
+
+        /**
+         * Get the named value if it can be represented as a double.
+         * @param valName The value to get.
+         * @return The value or zero if not found.
+         * @note a value of zero does not guarantee that it is a valid result.
+         */
+        double getDouble(const std::string &valName) const
+        {
+            std::shared_ptr<JSONValue> hold;
+            return valueToDouble(findValue(valName, hold));
+        }
+
+        /**
+         * Get the named value if it can be represented as a bool.
+         * @param valName The value to get.
+         * @return The 0 if false, 1 if true or -1 if not found.
+         */
+        int getBool(const std::string &valName) const
+        {
+            std::shared_ptr<JSONValue> hold;
+            return valueToBool(findValue(valName, hold));
+        }
+
+        /**
+         * Convert a value to a string the same way getString() does.
+         * @param val The value or nullptr.
+         */
+        static std::string valueToString(const JSONValue *val)
+        {
+            if(val == nullptr)
             {
                 return "";
             }
             if(val->type() == JSONType::STRING)
             {
                 // A string return the value.
-                std::shared_ptr<JSONString> str = std::dynamic_pointer_cast<JSONString>(val);
+                const JSONString *str = static_cast<const JSONString *> (val);
                 return str->getValue();
             }
             if(val->type() == JSONType::NUMBER)
             {
                 // It's a number convert it to a string.
-                std::shared_ptr<JSONNumber> num = std::dynamic_pointer_cast<JSONNumber>(val);
+                const JSONNumber *num = static_cast<const JSONNumber *> (val);
                 if(num->isDouble())
                 {
                     return std::to_string(num->getDouble());
@@ -690,7 +1358,7 @@ namespace KayLib
             }
             if(val->type() == JSONType::BOOL)
             {
-                std::shared_ptr<JSONBool> bl = std::dynamic_pointer_cast<JSONBool>(val);
+                const JSONBool *bl = static_cast<const JSONBool *> (val);
                 // It's a bool return true/false
                 if(bl->get())
                 {
@@ -707,21 +1375,18 @@ namespace KayLib
         }
 
         /**
-         * Get the named value if it can be represented as a int.
-         * @param valName The value to get.
-         * @return The value or zero if not found.
-         * @note a value of zero does not guarantee that it is a valid result.
+         * Convert a value to an integer the same way getInt() does.
+         * @param val The value or nullptr.
          */
-        long getInt(const std::string &valName) const
+        static long valueToInt(const JSONValue *val)
         {
-            std::shared_ptr<JSONValue> val = getValue(valName);
-            if(val.get() == nullptr)
+            if(val == nullptr)
             {
                 return 0;
             }
             if(val->type() == JSONType::STRING)
             {
-                std::shared_ptr<JSONString> str = std::dynamic_pointer_cast<JSONString>(val);
+                const JSONString *str = static_cast<const JSONString *> (val);
                 // A string attempt to parse the value.
                 StringParser<char> parser(str->getValue());
                 if(parser.isDecimal())
@@ -732,13 +1397,13 @@ namespace KayLib
             }
             if(val->type() == JSONType::NUMBER)
             {
-                std::shared_ptr<JSONNumber> num = std::dynamic_pointer_cast<JSONNumber>(val);
+                const JSONNumber *num = static_cast<const JSONNumber *> (val);
                 // It's a number just return the value.
                 return num->getInt();
             }
             if(val->type() == JSONType::BOOL)
             {
-                std::shared_ptr<JSONBool> bl = std::dynamic_pointer_cast<JSONBool>(val);
+                const JSONBool *bl = static_cast<const JSONBool *> (val);
                 // It's a bool return 1/0
                 if(bl->get())
                 {
@@ -756,34 +1421,31 @@ namespace KayLib
         }
 
         /**
-         * Get the named value if it can be represented as a double.
-         * @param valName The value to get.
-         * @return The value or zero if not found.
-         * @note a value of zero does not guarantee that it is a valid result.
+         * Convert a value to a double the same way getDouble() does.
+         * @param val The value or nullptr.
          */
-        double getDouble(const std::string &valName) const
+        static double valueToDouble(const JSONValue *val)
         {
-            std::shared_ptr<JSONValue> val = getValue(valName);
-            if(val.get() == nullptr)
+            if(val == nullptr)
             {
                 return 0;
             }
             if(val->type() == JSONType::STRING)
             {
-                std::shared_ptr<JSONString> str = std::dynamic_pointer_cast<JSONString>(val);
+                const JSONString *str = static_cast<const JSONString *> (val);
                 // A string attempt to parse the value.
                 StringParser<char> parser(str->getValue());
                 return parser.getDouble();
             }
             if(val->type() == JSONType::NUMBER)
             {
-                std::shared_ptr<JSONNumber> num = std::dynamic_pointer_cast<JSONNumber>(val);
+                const JSONNumber *num = static_cast<const JSONNumber *> (val);
                 // It's a number just return the value.
                 return num->getDouble();
             }
             if(val->type() == JSONType::BOOL)
             {
-                std::shared_ptr<JSONBool> bl = std::dynamic_pointer_cast<JSONBool>(val);
+                const JSONBool *bl = static_cast<const JSONBool *> (val);
                 // It's a bool return 1/0
                 if(bl->get())
                 {
@@ -801,20 +1463,18 @@ namespace KayLib
         }
 
         /**
-         * Get the named value if it can be represented as a bool.
-         * @param valName The value to get.
-         * @return The 0 if false, 1 if true or -1 if not found.
+         * Convert a value to a bool the same way getBool() does.
+         * @param val The value or nullptr.
          */
-        int getBool(const std::string &valName) const
+        static int valueToBool(const JSONValue *val)
         {
-            std::shared_ptr<JSONValue> val = getValue(valName);
-            if(val.get() == nullptr)
+            if(val == nullptr)
             {
                 return -1;
             }
             if(val->type() == JSONType::STRING)
             {
-                std::shared_ptr<JSONString> str = std::dynamic_pointer_cast<JSONString>(val);
+                const JSONString *str = static_cast<const JSONString *> (val);
                 // A string attempt to parse the value.
                 StringParser<char> parser(str->getValue());
                 if(parser.nextIs("true"))
@@ -829,7 +1489,7 @@ namespace KayLib
             }
             if(val->type() == JSONType::NUMBER)
             {
-                std::shared_ptr<JSONNumber> num = std::dynamic_pointer_cast<JSONNumber>(val);
+                const JSONNumber *num = static_cast<const JSONNumber *> (val);
                 if(num->isDouble())
                 {
                     return num->getDouble() != 0;
@@ -838,7 +1498,7 @@ namespace KayLib
             }
             if(val->type() == JSONType::BOOL)
             {
-                std::shared_ptr<JSONBool> bl = std::dynamic_pointer_cast<JSONBool>(val);
+                const JSONBool *bl = static_cast<const JSONBool *> (val);
                 // It's a bool return the value.
                 return bl->get();
             }
@@ -856,10 +1516,13 @@ namespace KayLib
          * @param name The name of the value.
          * @param value The value.
          */
-        void setValue(const std::string &name, JSONValue *value)
+        void setValue(std::string name, JSONValue *value)
         {
+            // Take ownership first so the value is not leaked if the object is frozen.
+            std::shared_ptr<JSONValue> owned(value);
+            checkMutable();
             std::unique_lock<std::mutex> uLock = getLock();
-            values[name] = std::shared_ptr<JSONValue>(value);
+            values.set(JSONText(std::move(name)), std::move(owned));
         }
 
         /**
@@ -867,30 +1530,168 @@ namespace KayLib
          * @param name The name of the value.
          * @param value The value.
          */
-        void setValue(const std::string &name, std::shared_ptr<JSONValue> value)
+        void setValue(std::string name, std::shared_ptr<JSONValue> value)
         {
+            checkMutable();
             std::unique_lock<std::mutex> uLock = getLock();
-            values[name] = value;
+            values.set(JSONText(std::move(name)), adopt(std::move(value)));
         }
 
-    private:
-        std::map<std::string, std::shared_ptr<JSONValue>> values;
-    };
-
-    class JSONArray : public JSONValue
-    {
-    public:
+        /**
+         * Set a value for the object.
+         * @param name The name of the value.  Borrowed names must outlive the object.
+         * @param value The value.
+         */
+        void setValue(JSONText name, std::shared_ptr<JSONValue> value)
+        {
+            checkMutable();
+            std::unique_lock<std::mutex> uLock = getLock();
+            values.set(std::move(name), adopt(std::move(value)));
+        }
+
+        /**
+         * Create a value in place and set it.
+         * @param name The name of the value.
+         * @param args The arguments for the value constructor.
+         * @return The value.
+         */
+        template<typename T, typename... Args>
+        std::shared_ptr<T> emplace(std::string name, Args&&... args)
+        {
+            checkMutable();
+            std::shared_ptr<T> value = std::make_shared<T>(std::forward<Args>(args)...);
+            std::unique_lock<std::mutex> uLock = getLock();
+            values.set(JSONText(std::move(name)), value);
+            return value;
+        }
+
+        /**
+         * Get the number of values.
+         * @return The number of values.
+         */
+        size_t size() const
+        {
+            std::unique_lock<std::mutex> uLock = getLock();
+            return values.size();
+        }
+
+        /**
+         * Iterate the members in the order they were added, without copying them.
+         * Each member has a 'name' and a 'value'.  The values are only valid while
+         * the object is, use getValue() to keep one.
+         * @note Iterating does not lock the object.  Only iterate objects that are
+         * frozen or that no other thread changes.
+         */
+        JSONMembers::const_iterator begin() const
+        {
+            return values.begin();
+        }
+
+        JSONMembers::const_iterator end() const
+        {
+            return values.end();
+        }
+
+        /**
+         * Make the object, and all values it contains, read only.
+         */
+        void freeze() override
+        {
+            if(frozen)
+            {
+                // The values of a frozen object are already frozen.
+                return;
+            }
+            for(auto &member : values)
+            {
+                if(member.value)
+                {
+                    member.value->freeze();
+                }
+            }
+            frozen = true;
+        }
+
+    private:
+        friend class JSONDocument;
+        friend class JSONPointer;
+        friend class JSONSchema;
+        friend class JSONPatch;
+        JSONMembers values;
+
+        void copyValues(const JSONObject &orig)
+        {
+            std::unique_lock<std::mutex> uLock = orig.getLock();
+            values.reserve(orig.values.size());
+            for(auto &member : orig.values)
+            {
+                if(member.value)
+                {
+                    JSONText name = member.name;
+                    // Copies must not depend on the lifetime of the original.
+                    name.own();
+                    values.add(std::move(name), std::shared_ptr<JSONValue>(member.value->copy()), member.hash);
+                }
+            }
+        }
+
+        /**
+         * Add a value while the object is being built by a single thread.
+         */
+        void insert(JSONText name, std::shared_ptr<JSONValue> value)
+        {
+            values.set(std::move(name), adopt(std::move(value)));
+        }
+
+        /**
+         * Find the named value.
+         * @param valName The value to find.
+         * @param hold Receives a reference to the value unless the object is frozen.
+         * @return The value or nullptr if not found.  Only valid while 'hold' is.
+         */
+        const JSONValue *findValue(const std::string &valName, std::shared_ptr<JSONValue> &hold) const
+        {
+            if(frozen)
+            {
+                // Frozen values can not be replaced, no reference is needed.
+                const JSONMembers::Member *member = values.find(valName.data(), valName.length());
+                return member == nullptr ? nullptr : member->value.get();
+            }
+            hold = getValue(valName);
+            return hold.get();
+        }
+    };
+
+    class JSONArray : public JSONValue
+    {
+    public:
 
         JSONArray() { }
 
         JSONArray(const JSONArray& orig)
         {
+            copyValues(orig);
+        }
+
+        /**
+         * Take the values of another array, which is left empty.
+         * Frozen arrays can not be changed so their values are copied.
+         */
+        JSONArray(JSONArray &&orig)
+        {
+            if(orig.frozen)
+            {
+                copyValues(orig);
+                return;
+            }
             std::unique_lock<std::mutex> uLock = orig.getLock();
-            for(auto value : orig.values)
+            values.swap(orig.values);
+            if(orig.arena != nullptr)
             {
-                if(value)
+                // This array is not in the arena, so it must keep the arena alive.
+                for(auto &value : values)
                 {
-                    values.push_back(std::shared_ptr<JSONValue>(value->copy()));
+                    value = share(value);
                 }
             }
         }
@@ -913,20 +1714,37 @@ namespace KayLib
 
         virtual void format(std::ostream &out, const std::string &current, const std::string &indent) const override
         {
-            out << "[" << std::endl;
-            bool first = true;
             std::unique_lock<std::mutex> uLock = getLock();
-            for(auto value : values)
+            if(values.empty())
+            {
+                out << "[]";
+                return;
+            }
+            std::string inner = current + indent;
+            out << "[\n";
+            bool first = true;
+            for(auto &value : values)
             {
                 if(!first)
                 {
-                    out << "," << std::endl;
+                    out << ",\n";
                 }
-                out << current + indent;
-                value->format(out, current + indent, indent);
+                out << inner;
+                value->format(out, inner, indent);
                 first = false;
             }
-            out << std::endl << current + "]";
+            out << "\n" << current << "]";
+        }
+
+        virtual void write(JSONWriter &writer) const override
+        {
+            std::unique_lock<std::mutex> uLock = getLock();
+            writer.startArray();
+            for(auto &value : values)
+            {
+                value->write(writer);
+            }
+            writer.endArray();
         }
 
         /**
@@ -936,20 +1754,132 @@ namespace KayLib
         std::vector<std::shared_ptr<JSONValue>> getArray() const
         {
             std::unique_lock<std::mutex> uLock = getLock();
-            return std::vector<std::shared_ptr < JSONValue >> (values);
+            if(arena == nullptr)
+            {
+                return std::vector<std::shared_ptr < JSONValue >> (values);
+            }
+            std::vector<std::shared_ptr < JSONValue>> array;
+            array.reserve(values.size());
+            for(auto &value : values)
+            {
+                array.push_back(share(value));
+            }
+            return array;
         }
 
         /**
          * Add another value to the array.
          * @param add The value to add.
          */
-        void add(const std::shared_ptr<JSONValue> &add)
+        void add(std::shared_ptr<JSONValue> add)
+        {
+            checkMutable();
+            std::unique_lock<std::mutex> uLock = getLock();
+            values.push_back(adopt(std::move(add)));
+        }
+
+        /**
+         * Create a value in place and add it to the array.
+         * @param args The arguments for the value constructor.
+         * @return The value.
+         */
+        template<typename T, typename... Args>
+        std::shared_ptr<T> emplace(Args&&... args)
+        {
+            checkMutable();
+            std::shared_ptr<T> value = std::make_shared<T>(std::forward<Args>(args)...);
+            std::unique_lock<std::mutex> uLock = getLock();
+            values.push_back(value);
+            return value;
+        }
+
+        /**
+         * Get the number of values.
+         * @return The number of values.
+         */
+        size_t size() const
+        {
+            std::unique_lock<std::mutex> uLock = getLock();
+            return values.size();
+        }
+
+        /**
+         * Get a value.
+         * @param index The index of the value.
+         * @return The value or nullptr if the index is out of range.
+         */
+        std::shared_ptr<JSONValue> at(size_t index) const
         {
             std::unique_lock<std::mutex> uLock = getLock();
-            values.push_back(add);
+            if(index >= values.size())
+            {
+                return nullptr;
+            }
+            return share(values[index]);
+        }
+
+        /**
+         * Iterate the values without copying them.
+         * The values are only valid while the array is, use at() to keep one.
+         * @note Iterating does not lock the array.  Only iterate arrays that are
+         * frozen or that no other thread changes.
+         */
+        std::vector<std::shared_ptr<JSONValue>>::const_iterator begin() const
+        {
+            return values.begin();
+        }
+
+        std::vector<std::shared_ptr<JSONValue>>::const_iterator end() const
+        {
+            return values.end();
+        }
+
+        /**
+         * Make the array, and all values it contains, read only.
+         */
+        void freeze() override
+        {
+            if(frozen)
+            {
+                return;
+            }
+            for(auto &value : values)
+            {
+                if(value)
+                {
+                    value->freeze();
+                }
+            }
+            frozen = true;
         }
 
     private:
+        friend class JSONDocument;
+        friend class JSONPointer;
+        friend class JSONSchema;
+        friend class JSONPatch;
+
+        /**
+         * Add a value while the array is being built by a single thread.
+         */
+        void append(std::shared_ptr<JSONValue> value)
+        {
+            values.push_back(adopt(std::move(value)));
+        }
+
+        void copyValues(const JSONArray &orig)
+        {
+            std::unique_lock<std::mutex> uLock = orig.getLock();
+            values.reserve(orig.values.size());
+            for(auto &value : orig.values)
+            {
+                if(value)
+                {
+                    values.push_back(std::shared_ptr<JSONValue>(value->copy()));
+                }
+            }
+        }
+
         std::vector<std::shared_ptr<JSONValue>> values;
     };
 
@@ -960,6 +1890,7 @@ namespace KayLib
         JSONDocument()
         {
             resetError();
+            options = JSONParseOptions::NONE;
             root = std::make_shared<JSONObject>();
         }
 
@@ -970,16 +1901,81 @@ namespace KayLib
         JSONDocument(const std::string &doc)
         {
             resetError();
-            root = parse(doc);
+            options = JSONParseOptions::NONE;
+            root = parse(doc.data(), doc.length());
+        }
+
+        /**
+         * Create a new JSONDocument from the string.
+         * @param doc The string containing the document to parse.
+         * @param nOptions The parser options.
+         * @note With JSONParseOptions::ARENA all values and their strings are allocated
+         * from an arena that is released in one step when the last reference to the document
+         * or any of its values is released.
+         * @note With JSONParseOptions::STRING_VIEWS names and strings that need no escaping
+         * refer to 'doc' directly.  'doc' must not change or be destroyed while the values are in use.
+         */
+        JSONDocument(const std::string &doc, JSONParseOptions nOptions)
+        {
+            load(doc.data(), doc.length(), nOptions);
+        }
+
+        /**
+         * Create a new JSONDocument from characters owned by the caller, such as a
+         * KMappedFile, without copying them.
+         * @param doc The characters containing the document to parse.
+         * @param length The number of characters.
+         * @param nOptions The parser options.
+         * @note With JSONParseOptions::STRING_VIEWS the values refer to 'doc', which must
+         * not change or be released while they are in use.
+         */
+        JSONDocument(const char *doc, size_t length, JSONParseOptions nOptions = JSONParseOptions::NONE)
+        {
+            load(doc, length, nOptions);
+        }
+
+        /**
+         * Create a document holding an existing value, such as a version made by JSONPatch.
+         * @param nRoot The root value.  It is shared, not copied.
+         */
+        explicit JSONDocument(std::shared_ptr<JSONValue> nRoot)
+        {
+            resetError();
+            options = JSONParseOptions::NONE;
+            root = std::move(nRoot);
         }
 
         JSONDocument(const JSONDocument& orig)
         {
             resetError();
-            if(root)
+            options = JSONParseOptions::NONE;
+            if(orig.root)
+            {
+                root.reset(orig.root->copy());
+            }
+        }
+
+        /**
+         * Replace this document with a copy of another, like the copy constructor.
+         * @param orig The document to copy.
+         * @return This document.
+         */
+        JSONDocument &operator=(const JSONDocument &orig)
+        {
+            if(this != &orig)
             {
-                root.reset(root->copy());
+                resetError();
+                options = JSONParseOptions::NONE;
+                // Copied values are not allocated from an arena.
+                std::shared_ptr<JSONValue> copy;
+                if(orig.root)
+                {
+                    copy.reset(orig.root->copy());
+                }
+                root = std::move(copy);
+                arena.reset();
             }
+            return *this;
         }
 
         virtual ~JSONDocument() { }
@@ -993,6 +1989,17 @@ namespace KayLib
             return root;
         };
 
+        /**
+         * Make the whole document read only so it can be read from many threads without locking.
+         */
+        void freeze()
+        {
+            if(root.get() != NULL)
+            {
+                root->freeze();
+            }
+        }
+
         /**
          * Return a formated string representation of the document.
          * @param indent The indention value to use.
@@ -1000,12 +2007,217 @@ namespace KayLib
          */
         std::string format(const std::string &indent) const
         {
-            std::stringstream out;
+            std::string out;
+            write(out, true, indent);
+            return out;
+        }
+
+        /**
+         * Append the document to a buffer.
+         * @param buffer The buffer.  Reusing it avoids allocating for every document.
+         * @param pretty True to put every member and element on its own line.
+         * @param indent The indention value to use when pretty.
+         */
+        void write(std::string &buffer, bool pretty = false, const std::string &indent = "  ") const
+        {
             if(root.get() != NULL)
             {
-                root->format(out, "", indent);
+                JSONWriter writer(buffer, pretty, indent);
+                root->write(writer);
+            }
+        }
+
+        /**
+         * Append the document to a buffer as CBOR (RFC 8949).
+         * Integers and doubles are written as binary numbers and strings without escapes.
+         * @param buffer The buffer.  Reusing it avoids allocating for every document.
+         */
+        void writeCBOR(std::string &buffer) const
+        {
+            writeCBOR(root.get(), buffer);
+        }
+
+        /**
+         * Append a value to a buffer as CBOR (RFC 8949).
+         * @param value The value.  nullptr is written as null.
+         * @param buffer The buffer.
+         */
+        static void writeCBOR(const JSONValue *value, std::string &buffer)
+        {
+            if(value == nullptr)
+            {
+                buffer.push_back((char) 0xF6);
+                return;
+            }
+            switch(value->type())
+            {
+                case JSONType::OBJECT:
+                {
+                    const JSONObject *object = static_cast<const JSONObject *> (value);
+                    std::unique_lock<std::mutex> uLock = object->getLock();
+                    writeCBORHead(buffer, 5, object->values.size());
+                    for(auto &member : object->values)
+                    {
+                        writeCBORText(buffer, member.name.data(), member.name.length());
+                        writeCBOR(member.value.get(), buffer);
+                    }
+                    break;
+                }
+                case JSONType::ARRAY:
+                {
+                    const JSONArray *array = static_cast<const JSONArray *> (value);
+                    std::unique_lock<std::mutex> uLock = array->getLock();
+                    writeCBORHead(buffer, 4, array->values.size());
+                    for(auto &element : array->values)
+                    {
+                        writeCBOR(element.get(), buffer);
+                    }
+                    break;
+                }
+                case JSONType::STRING:
+                {
+                    const JSONString *string = static_cast<const JSONString *> (value);
+                    std::unique_lock<std::mutex> uLock = string->getLock();
+                    writeCBORText(buffer, string->value.data(), string->value.length());
+                    break;
+                }
+                case JSONType::NUMBER:
+                {
+                    const JSONNumber *number = static_cast<const JSONNumber *> (value);
+                    if(number->isDouble())
+                    {
+                        writeCBORDouble(buffer, number->getDouble());
+                        break;
+                    }
+                    long lValue = number->getInt();
+                    if(lValue >= 0)
+                    {
+                        writeCBORHead(buffer, 0, (uint64_t) lValue);
+                    }
+                    else
+                    {
+                        // Negative integers are stored as -1 - n.
+                        writeCBORHead(buffer, 1, (uint64_t) (-1 - lValue));
+                    }
+                    break;
+                }
+                case JSONType::BOOL:
+                    buffer.push_back(static_cast<const JSONBool *> (value)->get() ? (char) 0xF5 : (char) 0xF4);
+                    break;
+                case JSONType::_NULL:
+                    buffer.push_back((char) 0xF6);
+                    break;
+            }
+        }
+
+        /**
+         * Replace the document with one read from CBOR (RFC 8949) data.
+         * Maps must have text keys, tags are ignored and byte strings are not supported.
+         * @param data The data.
+         * @param length The length of the data.
+         * @param nOptions The parser options.
+         * @note With JSONParseOptions::STRING_VIEWS names and strings that need no escaping
+         * refer to 'data' directly.  'data' must not change or be destroyed while the values are in use.
+         */
+        void readCBOR(const char *data, size_t length, JSONParseOptions nOptions = JSONParseOptions::NONE)
+        {
+            resetError();
+            options = nOptions;
+            arena.reset();
+            if(hasOption(JSONParseOptions::ARENA))
+            {
+                arena = std::make_shared<KArena>();
+            }
+            source = data;
+            sourceLength = length;
+            cborPos = 0;
+            root = readCBORValue(0);
+            if(lastError == JSONError::NONE && cborPos != sourceLength)
+            {
+                // Data after the document.
+                root = indexError(JSONError::InvalidSyntax, cborPos);
+            }
+            source = nullptr;
+            if(arena && root)
+            {
+                root = std::shared_ptr<JSONValue>(arena, root.get());
+            }
+        }
+
+        void readCBOR(const std::string &data, JSONParseOptions nOptions = JSONParseOptions::NONE)
+        {
+            readCBOR(data.data(), data.length(), nOptions);
+        }
+
+        /**
+         * Remove the escapes from JSON text.
+         * @param str The escaped text.
+         * @param length The length of the text.
+         * @param out The string to append the UTF-8 text to.
+         */
+        static void unescape(const char *str, size_t length, std::string &out)
+        {
+            out.reserve(out.length() + length);
+            for(size_t i = 0; i < length; i++)
+            {
+                char c = str[i];
+                if(c != '\\' || i + 1 == length)
+                {
+                    out.push_back(c);
+                    continue;
+                }
+                c = str[++i];
+                switch(c)
+                {
+                    case 'a':
+                        out.push_back('\a');
+                        break;
+                    case 'b':
+                        out.push_back('\b');
+                        break;
+                    case 'f':
+                        out.push_back('\f');
+                        break;
+                    case 'n':
+                        out.push_back('\n');
+                        break;
+                    case 'r':
+                        out.push_back('\r');
+                        break;
+                    case 't':
+                        out.push_back('\t');
+                        break;
+                    case 'v':
+                        out.push_back('\v');
+                        break;
+                    case 'u':
+                    {
+                        uint32_t code;
+                        if(i + 4 >= length || !readHex(str + i + 1, code))
+                        {
+                            // Not a valid escape, keep it as it is.
+                            out.push_back('\\');
+                            out.push_back(c);
+                            break;
+                        }
+                        i += 4;
+                        uint32_t low;
+                        if(code >= 0xD800 && code <= 0xDBFF && i + 6 < length && str[i + 1] == '\\' && str[i + 2] == 'u'
+                                && readHex(str + i + 3, low) && low >= 0xDC00 && low <= 0xDFFF)
+                        {
+                            // A surrogate pair.
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                            i += 6;
+                        }
+                        out.append(KUTF::codeToUTF8(code));
+                        break;
+                    }
+                    default:
+                        // Quotes, slashes and backslashes.
+                        out.push_back(c);
+                        break;
+                }
             }
-            return out.str();
         }
 
         /**
@@ -1027,7 +2239,7 @@ namespace KayLib
          * Get the last error code.
          * @return The error code.
          */
-        JSONError getError()
+        JSONError getError() const
         {
             return lastError;
         }
@@ -1036,11 +2248,38 @@ namespace KayLib
          * Get the parser index of the last error.
          * @return The index of the error.
          */
-        int getErrorIndex()
+        long getErrorIndex() const
         {
             return errorIndex;
         }
 
+        /**
+         * Get the line of the last parse error.
+         * @return The line, starting at 1, or -1.
+         */
+        long getErrorLine() const
+        {
+            return errorLine;
+        }
+
+        /**
+         * Get the column of the last parse error.
+         * @return The column, starting at 1, or -1.
+         */
+        long getErrorColumn() const
+        {
+            return errorColumn;
+        }
+
+        /**
+         * Get the text around the last parse error.
+         * @return The part of the line the error is on.
+         */
+        const std::string &getErrorExcerpt() const
+        {
+            return errorExcerpt;
+        }
+
         /**
          * Reset the error code.
          */
@@ -1048,20 +2287,198 @@ namespace KayLib
         {
             lastError = JSONError::NONE;
             errorIndex = -1;
+            errorLine = -1;
+            errorColumn = -1;
+            errorExcerpt.clear();
         }
 
     private:
         std::shared_ptr<JSONValue> root;
+        std::shared_ptr<KArena> arena;
+        JSONParseOptions options;
         JSONError lastError;
-        int errorIndex;
+        long errorIndex;
+        long errorLine;
+        long errorColumn;
+        std::string errorExcerpt;
+        // The string being parsed.
+        const char *source = nullptr;
+        size_t sourceLength = 0;
 
-        std::shared_ptr<JSONValue> parse(const std::string &doc)
+        bool hasOption(JSONParseOptions option) const
         {
-            StringParser<char> parser(doc);
-            return parse(parser);
+            return (options & option) == option;
         }
 
-        std::shared_ptr<JSONValue> parse(StringParser<char> &parser)
+        /**
+         * Create a new value, in the arena if the document has one.
+         * @param args The arguments for the value constructor.
+         * @return The value.  Arena values are returned without ownership.
+         */
+        template<typename T, typename... Args>
+        std::shared_ptr<T> create(Args&&... args)
+        {
+            if(arena)
+            {
+                T *value = arena->create<T>(std::forward<Args>(args)...);
+                value->arena = arena.get();
+                value->frozen = hasOption(JSONParseOptions::FROZEN);
+                return std::shared_ptr<T>(std::shared_ptr<T>(), value);
+            }
+            std::shared_ptr<T> value = std::make_shared<T>(std::forward<Args>(args)...);
+            value->frozen = hasOption(JSONParseOptions::FROZEN);
+            return value;
+        }
+
+        /**
+         * Find the extent of the quoted string at the parser position.
+         * @param parser The parser positioned on the opening quote.
+         * @param start Set to the index of the first character of the string.
+         * @param plain Set to false if the string must be escaped before it is stored.
+         * @return The length of the string.
+         */
+        long scanString(StringParser<char> &parser, long &start, bool &plain)
+        {
+            parser.skip(1);
+            start = parser.getIndex();
+            plain = true;
+            long sz = 0;
+            char c;
+            while((c = parser.getChar()) != '\"' && !parser.isEnd())
+            {
+                sz++;
+                if(c == '\\')
+                {
+                    // We have an escape character, skip it.
+                    sz++;
+                    parser.skip(1);
+                    plain = false;
+                }
+                else if(c == '\'' || c <= 0x0F)
+                {
+                    // KString::escape would change this character.
+                    plain = false;
+                }
+            }
+            return sz;
+        }
+
+        /**
+         * Store text from the source string according to the parser options.
+         * @param str The text.
+         * @param length The length of the text.
+         * @param view True if the text may refer to the source string.
+         * @return The text.
+         */
+        JSONText storeText(const char *str, size_t length, bool view)
+        {
+            if(view && hasOption(JSONParseOptions::STRING_VIEWS))
+            {
+                return JSONText::borrow(str, length);
+            }
+            if(arena)
+            {
+                return JSONText::borrow(arena->copyString(str, length), length);
+            }
+            return JSONText(std::string(str, length));
+        }
+
+        /**
+         * Parse a string value.
+         * @param parser The parser positioned on the opening quote.
+         * @return The value.
+         */
+        std::shared_ptr<JSONValue> parseString(StringParser<char> &parser)
+        {
+            long start;
+            bool plain;
+            long length = scanString(parser, start, plain);
+            return createString(source + start, length, plain);
+        }
+
+        /**
+         * Create a string value from the source string.
+         * @param str The string as it appears in the document.
+         * @param length The length of the string.
+         * @param plain True if the string can be stored without escaping.
+         * @return The value.
+         */
+        std::shared_ptr<JSONValue> createString(const char *str, size_t length, bool plain)
+        {
+            if(plain)
+            {
+                // Stored as it appears in the document.
+                return create<JSONString>(storeText(str, length, true));
+            }
+            std::string escaped = KString::escape(std::string(str, length), true);
+            return create<JSONString>(storeText(escaped.data(), escaped.length(), false));
+        }
+
+        /**
+         * Parse the name of an object value.
+         * @param parser The parser positioned on the opening quote.
+         * @return The name.
+         */
+        JSONText parseName(StringParser<char> &parser)
+        {
+            long start;
+            bool plain;
+            long length = scanString(parser, start, plain);
+            // Names are stored as they appear in the document.
+            return storeText(source + start, length, true);
+        }
+
+        void load(const char *doc, size_t length, JSONParseOptions nOptions)
+        {
+            resetError();
+            options = nOptions;
+            if(hasOption(JSONParseOptions::ARENA))
+            {
+                arena = std::make_shared<KArena>();
+            }
+            root = parse(doc, length);
+            if(arena && root)
+            {
+                // The root owns the arena so it can outlive the document.
+                root = std::shared_ptr<JSONValue>(arena, root.get());
+            }
+        }
+
+        std::shared_ptr<JSONValue> parse(const char *doc, size_t length)
+        {
+            source = doc;
+            sourceLength = length;
+            std::shared_ptr<JSONValue> value;
+            if(hasOption(JSONParseOptions::STRUCTURAL_INDEX) && length < 0xFFFFFFFF)
+            {
+                value = parseIndexed();
+            }
+            else
+            {
+                StringParser<char> parser(doc, length);
+                value = parse(parser);
+            }
+            source = nullptr;
+            if(lastError != JSONError::NONE)
+            {
+                locateError(doc, length);
+            }
+            return value;
+        }
+
+        /**
+         * Find the line and column of a parse error.  Only done once parsing
+         * has failed so documents without errors are not scanned for lines.
+         */
+        void locateError(const char *doc, size_t length)
+        {
+            StringParser<char> lines(doc, length);
+            errorLine = lines.getLine(errorIndex);
+            errorColumn = lines.getColumn(errorIndex);
+            errorExcerpt = lines.getExcerpt(errorIndex);
+        }
+
+        std::shared_ptr<JSONValue> parse(StringParser<char> &parser)
         {
             parser.skipWhitespace(true);
             if(parser.peekChar() == '{')
@@ -1075,32 +2492,38 @@ namespace KayLib
             if(parser.peekChar() == '\"')
             {
                 // A string.
-                std::string s = parser.getQuotedString();
-                return std::make_shared<JSONString>(s);
+                return parseString(parser);
             }
             if(parser.peekChar() == '-' || parser.isDigit())
             {
                 // A number.
+                if(source != nullptr)
+                {
+                    size_t used;
+                    std::shared_ptr<JSONValue> number = parseNumber(source + parser.getIndex(), source + sourceLength, used);
+                    parser.skip((long) used);
+                    return number;
+                }
                 if(parser.isDecimal())
                 {
-                    return std::make_shared<JSONNumber>(parser.getDouble());
+                    return create<JSONNumber>(parser.getDouble());
                 }
-                return std::make_shared<JSONNumber>(parser.getLong());
+                return create<JSONNumber>(parser.getLong());
             }
             if(parser.nextIs("true", true))
             {
                 // A true bool.
-                return std::make_shared<JSONBool>(true);
+                return create<JSONBool>(true);
             }
             if(parser.nextIs("false", true))
             {
                 // A false bool.
-                return std::make_shared<JSONBool>(false);
+                return create<JSONBool>(false);
             }
             if(parser.nextIs("null", true))
             {
                 // A null.
-                return std::make_shared<JSONNull>();
+                return create<JSONNull>();
             }
             // Set error.
             errorIndex = parser.getIndex();
@@ -1112,7 +2535,7 @@ namespace KayLib
         {
             parser.getChar();
             // An object.
-            std::shared_ptr<JSONObject> object = std::make_shared<JSONObject>();
+            std::shared_ptr<JSONObject> object = create<JSONObject>();
             // Skip whitespace.
             parser.skipWhitespace(true);
             if(parser.peekChar() == '}')
@@ -1136,7 +2559,7 @@ namespace KayLib
                     return object;
                 }
                 // Get value name.
-                std::string name = parser.getQuotedString();
+                JSONText name = parseName(parser);
                 // Skip whitespace.
                 parser.skipWhitespace(true);
                 // name and value must be separated by a colon.
@@ -1157,7 +2580,7 @@ namespace KayLib
                     object.reset();
                     return object;
                 }
-                object->setValue(name, child);
+                object->insert(std::move(name), std::move(child));
                 // Skip whitespace.
                 parser.skipWhitespace(true);
             }
@@ -1179,7 +2602,7 @@ namespace KayLib
         {
             parser.getChar();
             // An array.
-            std::shared_ptr<JSONArray> array = std::make_shared<JSONArray>();
+            std::shared_ptr<JSONArray> array = create<JSONArray>();
             // Skip whitespace.
             parser.skipWhitespace(true);
             if(parser.peekChar() == ']')
@@ -1199,7 +2622,7 @@ namespace KayLib
                     array.reset();
                     return array;
                 }
-                array->add(child);
+                array->append(std::move(child));
                 // Skip whitespace.
                 parser.skipWhitespace(true);
             }
@@ -1216,6 +2639,687 @@ namespace KayLib
             }
             return array;
         }
+
+        //---------------------------------------------------------------------
+        // Structural index parser.
+
+        // The unread entries of the structural index.
+        const uint32_t *token = nullptr;
+        const uint32_t *tokenEnd = nullptr;
+
+        std::shared_ptr<JSONValue> parseIndexed()
+        {
+            std::vector<uint32_t> index;
+            if(!JSONStructuralIndex::build(source, sourceLength, index))
+            {
+                // The document ends inside a string.  Whether that is an error
+                // and where depends on what comes before it, so let the
+                // default parser decide.
+                StringParser<char> parser(source, sourceLength);
+                return parse(parser);
+            }
+            token = index.data();
+            tokenEnd = token + index.size();
+            // Like the default parser anything after the top level value is ignored.
+            std::shared_ptr<JSONValue> value = parseIndexedValue(true);
+            token = nullptr;
+            tokenEnd = nullptr;
+            return value;
+        }
+
+        /**
+         * Set the error and return an empty value.
+         */
+        std::shared_ptr<JSONValue> indexError(JSONError error, size_t index)
+        {
+            errorIndex = index;
+            lastError = error;
+            return std::shared_ptr<JSONValue>();
+        }
+
+        /**
+         * Get the position of the next token or the end of the document.
+         */
+        size_t nextTokenIndex() const
+        {
+            return token != tokenEnd ? *token : sourceLength;
+        }
+
+        /**
+         * Check that only whitespace separates the end of a value from the next token.
+         * @param end The index just past the value.
+         * @return True if the value is properly terminated.
+         */
+        bool endsAtToken(size_t end) const
+        {
+            size_t next = nextTokenIndex();
+            while(end < next)
+            {
+                char c = source[end];
+                if(c != ' ' && c != '\t' && c != '\n' && c != '\r')
+                {
+                    return false;
+                }
+                end++;
+            }
+            return true;
+        }
+
+        /**
+         * Find the characters of the string starting at 'start'.
+         * @param start The index of the opening quote.
+         * @param length Set to the length of the string.
+         * @param plain Set to false if the string must be escaped before it is stored.
+         * @return The first character of the string.
+         */
+        const char *indexedString(size_t start, size_t &length, bool &plain) const
+        {
+            // Only whitespace lies between the closing quote and the next token.
+            size_t end = nextTokenIndex() - 1;
+            while(source[end] != '\"')
+            {
+                end--;
+            }
+            const char *str = source + start + 1;
+            length = end - start - 1;
+            plain = true;
+            for(size_t i = 0; i < length; i++)
+            {
+                char c = str[i];
+                if(c == '\\' || c == '\'' || c <= 0x0F)
+                {
+                    plain = false;
+                    break;
+                }
+            }
+            return str;
+        }
+
+        /**
+         * Parse the value at the next token.  Errors are reported where the
+         * default parser reports them.
+         * @param top True for the top level value.
+         * @return The value.
+         */
+        std::shared_ptr<JSONValue> parseIndexedValue(bool top = false)
+        {
+            if(token == tokenEnd)
+            {
+                return indexError(JSONError::InvalidSyntax, sourceLength);
+            }
+            size_t start = *token++;
+            char c = source[start];
+            if(c == '{')
+            {
+                return parseIndexedObject();
+            }
+            if(c == '[')
+            {
+                return parseIndexedArray();
+            }
+            if(c == '\"')
+            {
+                // A string.
+                size_t length;
+                bool plain;
+                const char *str = indexedString(start, length, plain);
+                return createString(str, length, plain);
+            }
+            size_t remain = sourceLength - start;
+            std::shared_ptr<JSONValue> value;
+            size_t end = start;
+            if(c == '-' || KString::digit(c) != -1)
+            {
+                // A number.
+                value = parseNumber(source + start, source + sourceLength, end);
+                end += start;
+            }
+            else if(remain >= 4 && std::memcmp(source + start, "true", 4) == 0)
+            {
+                value = create<JSONBool>(true);
+                end = start + 4;
+            }
+            else if(remain >= 5 && std::memcmp(source + start, "false", 5) == 0)
+            {
+                value = create<JSONBool>(false);
+                end = start + 5;
+            }
+            else if(remain >= 4 && std::memcmp(source + start, "null", 4) == 0)
+            {
+                value = create<JSONNull>();
+                end = start + 4;
+            }
+            if(!value)
+            {
+                return indexError(JSONError::InvalidSyntax, start);
+            }
+            if(!top && !endsAtToken(end))
+            {
+                // The default parser fails on the character after the value.
+                return indexError(JSONError::InvalidSyntax, end + 1);
+            }
+            return value;
+        }
+
+        std::shared_ptr<JSONValue> parseIndexedObject()
+        {
+            // An object.
+            std::shared_ptr<JSONObject> object = create<JSONObject>();
+            if(token != tokenEnd && source[*token] == '}')
+            {
+                // An empty object.
+                token++;
+                return object;
+            }
+            while(true)
+            {
+                if(token == tokenEnd)
+                {
+                    return indexError(JSONError::InvalidObjectName, sourceLength);
+                }
+                size_t start = *token++;
+                if(source[start] != '\"')
+                {
+                    return indexError(JSONError::InvalidObjectName, start);
+                }
+                // Get value name.
+                size_t length;
+                bool plain;
+                const char *str = indexedString(start, length, plain);
+                JSONText name = storeText(str, length, true);
+                // name and value must be separated by a colon.
+                if(token == tokenEnd || source[*token] != ':')
+                {
+                    return indexError(JSONError::InvalidSyntax, token == tokenEnd ? sourceLength : *token + 1);
+                }
+                token++;
+                // get the entries.
+                std::shared_ptr<JSONValue> child = parseIndexedValue();
+                if(lastError != JSONError::NONE)
+                {
+                    return std::shared_ptr<JSONValue>();
+                }
+                object->insert(std::move(name), std::move(child));
+                if(token == tokenEnd)
+                {
+                    return indexError(JSONError::InvalidSyntax, sourceLength);
+                }
+                char last = source[*token++];
+                if(last == '}')
+                {
+                    return object;
+                }
+                if(last != ',')
+                {
+                    // Reported after the character like the default parser.
+                    return indexError(JSONError::InvalidSyntax, token[-1] + 1);
+                }
+            }
+        }
+
+        std::shared_ptr<JSONValue> parseIndexedArray()
+        {
+            // An array.
+            std::shared_ptr<JSONArray> array = create<JSONArray>();
+            if(token != tokenEnd && source[*token] == ']')
+            {
+                // An empty array.
+                token++;
+                return array;
+            }
+            while(true)
+            {
+                // get the entries.
+                std::shared_ptr<JSONValue> child = parseIndexedValue();
+                if(lastError != JSONError::NONE)
+                {
+                    return std::shared_ptr<JSONValue>();
+                }
+                array->append(std::move(child));
+                if(token == tokenEnd)
+                {
+                    return indexError(JSONError::InvalidSyntax, sourceLength);
+                }
+                char last = source[*token++];
+                if(last == ']')
+                {
+                    return array;
+                }
+                if(last != ',')
+                {
+                    // Reported after the character like the default parser.
+                    return indexError(JSONError::InvalidSyntax, token[-1] + 1);
+                }
+            }
+        }
+
+        /**
+         * Parse a number from the source string.
+         * @param str The first character of the number.
+         * @param end The end of the document.
+         * @param used Set to the number of characters used.
+         * @return The value.
+         */
+        std::shared_ptr<JSONValue> parseNumber(const char *str, const char *end, size_t &used)
+        {
+            const char *p = str;
+            long lValue;
+            double dValue;
+            bool isDouble = JSONNumber::parseText(p, end, lValue, dValue);
+            used = p - str;
+            if(isDouble)
+            {
+                return create<JSONNumber>(dValue);
+            }
+            return create<JSONNumber>(lValue);
+        }
+
+        //---------------------------------------------------------------------
+        // CBOR reader and writer.
+
+        // The deepest nesting of arrays, maps and tags read from CBOR.
+        static const size_t CBOR_MAX_DEPTH = 1024;
+        // The read position in the CBOR data.
+        size_t cborPos = 0;
+
+        /**
+         * Write the initial byte of an item and its argument.
+         * @param buffer The buffer.
+         * @param major The major type.
+         * @param argument The length, count or value.
+         */
+        static void writeCBORHead(std::string &buffer, unsigned char major, uint64_t argument)
+        {
+            major <<= 5;
+            if(argument < 24)
+            {
+                buffer.push_back((char) (major | argument));
+                return;
+            }
+            int bytes = 8;
+            unsigned char info = 27;
+            if(argument <= 0xFF)
+            {
+                bytes = 1;
+                info = 24;
+            }
+            else if(argument <= 0xFFFF)
+            {
+                bytes = 2;
+                info = 25;
+            }
+            else if(argument <= 0xFFFFFFFF)
+            {
+                bytes = 4;
+                info = 26;
+            }
+            char head[9];
+            head[0] = (char) (major | info);
+            for(int i = 0; i < bytes; i++)
+            {
+                head[1 + i] = (char) (argument >> (8 * (bytes - 1 - i)));
+            }
+            buffer.append(head, bytes + 1);
+        }
+
+        /**
+         * Write a double, as a single precision float if that is exact.
+         */
+        static void writeCBORDouble(std::string &buffer, double value)
+        {
+            if(std::fabs(value) <= FLT_MAX && (double) (float) value == value)
+            {
+                float fValue = (float) value;
+                uint32_t bits;
+                std::memcpy(&bits, &fValue, 4);
+                buffer.push_back((char) 0xFA);
+                for(int shift = 24; shift >= 0; shift -= 8)
+                {
+                    buffer.push_back((char) (bits >> shift));
+                }
+                return;
+            }
+            uint64_t bits;
+            std::memcpy(&bits, &value, 8);
+            buffer.push_back((char) 0xFB);
+            for(int shift = 56; shift >= 0; shift -= 8)
+            {
+                buffer.push_back((char) (bits >> shift));
+            }
+        }
+
+        /**
+         * Write a name or string, removing its escapes.
+         * @param str The escaped text.
+         * @param length The length of the text.
+         */
+        static void writeCBORText(std::string &buffer, const char *str, size_t length)
+        {
+            if(std::memchr(str, '\\', length) == nullptr)
+            {
+                writeCBORHead(buffer, 3, length);
+                buffer.append(str, length);
+                return;
+            }
+            std::string text;
+            unescape(str, length, text);
+            writeCBORHead(buffer, 3, text.length());
+            buffer.append(text);
+        }
+
+        /**
+         * Read four hexadecimal digits.
+         * @return False if they are not all hexadecimal digits.
+         */
+        static bool readHex(const char *str, uint32_t &value)
+        {
+            value = 0;
+            for(int i = 0; i < 4; i++)
+            {
+                char c = str[i];
+                value <<= 4;
+                if(c >= '0' && c <= '9')
+                {
+                    value |= c - '0';
+                }
+                else if(c >= 'a' && c <= 'f')
+                {
+                    value |= c - 'a' + 10;
+                }
+                else if(c >= 'A' && c <= 'F')
+                {
+                    value |= c - 'A' + 10;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Read the initial byte of an item and its argument.
+         * @param major Set to the major type.
+         * @param info Set to the additional information, 31 for indefinite lengths.
+         * @param argument Set to the length, count or value.
+         * @return False if there is an error.
+         */
+        bool readCBORHead(unsigned char &major, unsigned char &info, uint64_t &argument)
+        {
+            if(cborPos >= sourceLength)
+            {
+                indexError(JSONError::UnexpectedEndOfDocument, cborPos);
+                return false;
+            }
+            unsigned char initial = (unsigned char) source[cborPos++];
+            major = initial >> 5;
+            info = initial & 0x1F;
+            argument = info;
+            if(info < 24 || (info == 31 && major >= 2))
+            {
+                return true;
+            }
+            if(info > 27)
+            {
+                indexError(JSONError::InvalidSyntax, cborPos - 1);
+                return false;
+            }
+            size_t bytes = (size_t) 1 << (info - 24);
+            if(sourceLength - cborPos < bytes)
+            {
+                indexError(JSONError::UnexpectedEndOfDocument, sourceLength);
+                return false;
+            }
+            argument = 0;
+            for(size_t i = 0; i < bytes; i++)
+            {
+                argument = (argument << 8) | (unsigned char) source[cborPos++];
+            }
+            return true;
+        }
+
+        /**
+         * Check for the end of an indefinite length array, map or string.
+         * @return True and skip it if the next byte is a break.
+         */
+        bool readCBORBreak()
+        {
+            if(cborPos < sourceLength && (unsigned char) source[cborPos] == 0xFF)
+            {
+                cborPos++;
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * Read the rest of a text string.
+         * @param info The additional information of the head.
+         * @param argument The argument of the head.
+         * @param text Set to the text as it should be stored.
+         * @return False if there is an error.
+         */
+        bool readCBORText(unsigned char info, uint64_t argument, JSONText &text)
+        {
+            if(info != 31)
+            {
+                if(sourceLength - cborPos < argument)
+                {
+                    indexError(JSONError::UnexpectedEndOfDocument, sourceLength);
+                    return false;
+                }
+                text = storeCBORText(source + cborPos, argument, true);
+                cborPos += argument;
+                return true;
+            }
+            // An indefinite length string is made of definite length chunks.
+            std::string chunks;
+            while(!readCBORBreak())
+            {
+                size_t start = cborPos;
+                unsigned char major;
+                if(!readCBORHead(major, info, argument))
+                {
+                    return false;
+                }
+                if(major != 3 || info == 31)
+                {
+                    indexError(JSONError::InvalidSyntax, start);
+                    return false;
+                }
+                if(sourceLength - cborPos < argument)
+                {
+                    indexError(JSONError::UnexpectedEndOfDocument, sourceLength);
+                    return false;
+                }
+                chunks.append(source + cborPos, argument);
+                cborPos += argument;
+            }
+            text = storeCBORText(chunks.data(), chunks.length(), false);
+            return true;
+        }
+
+        /**
+         * Store text read from CBOR, escaping it if needed.
+         * @param view True if the text may refer to the CBOR data.
+         */
+        JSONText storeCBORText(const char *str, size_t length, bool view)
+        {
+            if(JSONWriter::findEscape(str, length) == length)
+            {
+                return storeText(str, length, view);
+            }
+            std::string escaped;
+            JSONWriter::escape(str, length, escaped);
+            return storeText(escaped.data(), escaped.length(), false);
+        }
+
+        /**
+         * Read a half precision float.
+         */
+        static double halfToDouble(uint64_t half)
+        {
+            int exponent = (half >> 10) & 0x1F;
+            double mantissa = (double) (half & 0x3FF);
+            double value;
+            if(exponent == 0)
+            {
+                value = std::ldexp(mantissa, -24);
+            }
+            else if(exponent != 31)
+            {
+                value = std::ldexp(mantissa + 1024, exponent - 25);
+            }
+            else
+            {
+                value = mantissa == 0 ? INFINITY : NAN;
+            }
+            return (half & 0x8000) != 0 ? -value : value;
+        }
+
+        std::shared_ptr<JSONValue> readCBORValue(size_t depth)
+        {
+            if(depth > CBOR_MAX_DEPTH)
+            {
+                return indexError(JSONError::LimitExceeded, cborPos);
+            }
+            size_t start = cborPos;
+            unsigned char major;
+            unsigned char info;
+            uint64_t argument;
+            if(!readCBORHead(major, info, argument))
+            {
+                return std::shared_ptr<JSONValue>();
+            }
+            switch(major)
+            {
+                case 0:
+                    if(argument > (uint64_t) LONG_MAX)
+                    {
+                        return create<JSONNumber>((double) argument);
+                    }
+                    return create<JSONNumber>((long) argument);
+                case 1:
+                    if(argument > (uint64_t) LONG_MAX)
+                    {
+                        return create<JSONNumber>(-1.0 - (double) argument);
+                    }
+                    return create<JSONNumber>(-1 - (long) argument);
+                case 3:
+                {
+                    JSONText text;
+                    if(!readCBORText(info, argument, text))
+                    {
+                        return std::shared_ptr<JSONValue>();
+                    }
+                    return create<JSONString>(text);
+                }
+                case 4:
+                    return readCBORArray(info, argument, depth);
+                case 5:
+                    return readCBORMap(info, argument, depth);
+                case 6:
+                    // Tags only add meaning to the value that follows.
+                    return readCBORValue(depth + 1);
+                case 7:
+                    switch(info)
+                    {
+                        case 20:
+                            return create<JSONBool>(false);
+                        case 21:
+                            return create<JSONBool>(true);
+                        case 22:
+                        case 23:
+                            // null and undefined.
+                            return create<JSONNull>();
+                        case 25:
+                            return create<JSONNumber>(halfToDouble(argument));
+                        case 26:
+                        {
+                            uint32_t bits = (uint32_t) argument;
+                            float fValue;
+                            std::memcpy(&fValue, &bits, 4);
+                            return create<JSONNumber>((double) fValue);
+                        }
+                        case 27:
+                        {
+                            double dValue;
+                            std::memcpy(&dValue, &argument, 8);
+                            return create<JSONNumber>(dValue);
+                        }
+                    }
+                    break;
+            }
+            // Byte strings, unknown simple values and unexpected breaks.
+            return indexError(JSONError::InvalidSyntax, start);
+        }
+
+        std::shared_ptr<JSONValue> readCBORArray(unsigned char info, uint64_t count, size_t depth)
+        {
+            std::shared_ptr<JSONArray> array = create<JSONArray>();
+            bool indefinite = info == 31;
+            if(!indefinite)
+            {
+                // Every element uses at least one byte.
+                array->values.reserve(std::min(count, (uint64_t) (sourceLength - cborPos)));
+            }
+            for(uint64_t i = 0; indefinite || i < count; i++)
+            {
+                if(indefinite && readCBORBreak())
+                {
+                    break;
+                }
+                std::shared_ptr<JSONValue> child = readCBORValue(depth + 1);
+                if(lastError != JSONError::NONE)
+                {
+                    return std::shared_ptr<JSONValue>();
+                }
+                array->append(std::move(child));
+            }
+            return array;
+        }
+
+        std::shared_ptr<JSONValue> readCBORMap(unsigned char info, uint64_t count, size_t depth)
+        {
+            std::shared_ptr<JSONObject> object = create<JSONObject>();
+            bool indefinite = info == 31;
+            if(!indefinite)
+            {
+                // Every member uses at least two bytes.
+                object->values.reserve(std::min(count, (uint64_t) (sourceLength - cborPos) / 2));
+            }
+            for(uint64_t i = 0; indefinite || i < count; i++)
+            {
+                if(indefinite && readCBORBreak())
+                {
+                    break;
+                }
+                size_t start = cborPos;
+                unsigned char major;
+                uint64_t argument;
+                if(!readCBORHead(major, info, argument))
+                {
+                    return std::shared_ptr<JSONValue>();
+                }
+                JSONText name;
+                if(major != 3)
+                {
+                    return indexError(JSONError::InvalidObjectName, start);
+                }
+                if(!readCBORText(info, argument, name))
+                {
+                    return std::shared_ptr<JSONValue>();
+                }
+                std::shared_ptr<JSONValue> child = readCBORValue(depth + 1);
+                if(lastError != JSONError::NONE)
+                {
+                    return std::shared_ptr<JSONValue>();
+                }
+                object->insert(std::move(name), std::move(child));
+            }
+            return object;
+        }
     };
 
 }
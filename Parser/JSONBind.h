@@ -0,0 +1,826 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JSONBIND_H
+#define JSONBIND_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <type_traits>
+#include <limits>
+#include <climits>
+#include <cmath>
+
+#include "JSON.h"
+
+namespace KayLib
+{
+
+    template<typename T>
+    class JSONBind;
+
+    /**
+     * Declares the fields of a struct for JSONBind.
+     * By default the struct declares them itself with a static member:
+     *
+     *     static void jsonFields(JSONBind<Item> &fields)
+     *     {
+     *         fields.field("Name", &Item::Name);
+     *         fields.field("Qty", &Item::Qty);
+     *     }
+     *
+     * Specialize this template to bind a struct that cannot be changed.
+     */
+    template<typename T>
+    struct JSONFields
+    {
+
+        static void declare(JSONBind<T> &fields)
+        {
+            T::jsonFields(fields);
+        }
+    };
+
+    /**
+     * Reads JSON text directly into values for JSONBind.
+     */
+    class JSONBindReader
+    {
+    public:
+
+        // The deepest nesting of objects and arrays allowed.
+        static const size_t MAX_DEPTH = 1024;
+
+        JSONBindReader(const char *str, size_t length)
+        {
+            start = str;
+            pos = str;
+            end = str + length;
+            depth = 0;
+            error = JSONError::NONE;
+            errorIndex = -1;
+        }
+
+        JSONError getError() const
+        {
+            return error;
+        }
+
+        long getErrorIndex() const
+        {
+            return errorIndex;
+        }
+
+        /**
+         * Record an error at the current position.
+         * @return False.
+         */
+        bool fail(JSONError nError)
+        {
+            if(error == JSONError::NONE)
+            {
+                error = pos >= end ? JSONError::UnexpectedEndOfDocument : nError;
+                errorIndex = (long) (pos - start);
+            }
+            return false;
+        }
+
+        void skipWhitespace()
+        {
+            while(pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r'))
+            {
+                pos++;
+            }
+        }
+
+        /**
+         * Check that nothing but whitespace is left.
+         */
+        bool finish()
+        {
+            skipWhitespace();
+            return pos == end || fail(JSONError::InvalidSyntax);
+        }
+
+        /**
+         * Skip a null.
+         * @return True if the next value was null.
+         */
+        bool readNull()
+        {
+            skipWhitespace();
+            return readWord("null", 4);
+        }
+
+        bool readBool(bool &value)
+        {
+            skipWhitespace();
+            if(readWord("true", 4))
+            {
+                value = true;
+                return true;
+            }
+            if(readWord("false", 5))
+            {
+                value = false;
+                return true;
+            }
+            return fail(JSONError::InvalidSyntax);
+        }
+
+        /**
+         * Read a number.
+         * @param lValue Set to the value if it is an integer.
+         * @param dValue Set to the value if it is a double.
+         * @param isDouble Set to true if the number is a double.
+         */
+        bool readNumber(long &lValue, double &dValue, bool &isDouble)
+        {
+            skipWhitespace();
+            const char *last = KNumber::parse(pos, end, lValue, dValue, isDouble);
+            if(last == pos)
+            {
+                return fail(JSONError::InvalidSyntax);
+            }
+            pos = last;
+            return true;
+        }
+
+        /**
+         * Read an integer that must fit in T.
+         * @param value Set to the value.
+         * @return False if there is no number or it does not fit.
+         */
+        template<typename T>
+        bool readInteger(T &value)
+        {
+            skipWhitespace();
+            const char *number = pos;
+            unsigned long digits;
+            bool overflow;
+            if(std::is_unsigned<T>::value && readDigits(digits, overflow))
+            {
+                // Read exactly, unsigned values can be larger than a long.
+                if(overflow || digits > (unsigned long) std::numeric_limits<T>::max())
+                {
+                    pos = number;
+                    return fail(JSONError::InvalidNumber);
+                }
+                value = (T) digits;
+                return true;
+            }
+            long lValue;
+            double dValue;
+            bool isDouble;
+            if(!readNumber(lValue, dValue, isDouble))
+            {
+                return false;
+            }
+            if(isDouble ? !fits<T>(dValue) : !fits<T>(lValue))
+            {
+                // Reported at the start of the number.
+                pos = number;
+                return fail(JSONError::InvalidNumber);
+            }
+            value = isDouble ? (T) dValue : (T) lValue;
+            return true;
+        }
+
+        /**
+         * Read a string without removing its escapes.
+         * @param str Set to the first character of the string.
+         * @param length Set to the length of the string.
+         * @param escaped Set to true if the string has escapes.
+         */
+        bool readString(const char *&str, size_t &length, bool &escaped)
+        {
+            skipWhitespace();
+            if(pos >= end || *pos != '"')
+            {
+                return fail(JSONError::InvalidSyntax);
+            }
+            str = ++pos;
+            escaped = false;
+            while(true)
+            {
+                if(pos >= end)
+                {
+                    return fail(JSONError::UnexpectedEndOfDocument);
+                }
+                pos += JSONWriter::findEscape(pos, end - pos);
+                if(pos >= end)
+                {
+                    return fail(JSONError::UnexpectedEndOfDocument);
+                }
+                if(*pos == '"')
+                {
+                    break;
+                }
+                if(*pos == '\\')
+                {
+                    escaped = true;
+                    pos++;
+                }
+                // Escaped and control characters.
+                pos++;
+            }
+            length = pos - str;
+            pos++;
+            return true;
+        }
+
+        /**
+         * Read a string and remove its escapes.
+         * @param value Set to the string.
+         */
+        bool readString(std::string &value)
+        {
+            const char *str;
+            size_t length;
+            bool escaped;
+            if(!readString(str, length, escaped))
+            {
+                return false;
+            }
+            if(escaped)
+            {
+                value.clear();
+                JSONDocument::unescape(str, length, value);
+            }
+            else
+            {
+                value.assign(str, length);
+            }
+            return true;
+        }
+
+        /**
+         * Read an object.
+         * @param member Called as bool(const char *name, size_t length, bool escaped) for each member,
+         * with the reader positioned on the value.  It must read or skip the value.
+         */
+        template<typename Member>
+        bool readObject(Member member)
+        {
+            skipWhitespace();
+            if(pos >= end || *pos != '{')
+            {
+                return fail(JSONError::InvalidSyntax);
+            }
+            if(++depth > MAX_DEPTH)
+            {
+                return fail(JSONError::LimitExceeded);
+            }
+            pos++;
+            skipWhitespace();
+            if(!readChar('}'))
+            {
+                do
+                {
+                    const char *name;
+                    size_t length;
+                    bool escaped;
+                    skipWhitespace();
+                    if(pos >= end || *pos != '"')
+                    {
+                        return fail(JSONError::InvalidObjectName);
+                    }
+                    if(!readString(name, length, escaped))
+                    {
+                        return false;
+                    }
+                    skipWhitespace();
+                    if(!readChar(':'))
+                    {
+                        return fail(JSONError::InvalidSyntax);
+                    }
+                    if(!member(name, length, escaped))
+                    {
+                        return false;
+                    }
+                    skipWhitespace();
+                }
+                while(readChar(','));
+                if(!readChar('}'))
+                {
+                    return fail(JSONError::InvalidSyntax);
+                }
+            }
+            depth--;
+            return true;
+        }
+
+        /**
+         * Read an array.
+         * @param element Called as bool() for each element with the reader positioned on it.
+         * It must read or skip the element.
+         */
+        template<typename Element>
+        bool readArray(Element element)
+        {
+            skipWhitespace();
+            if(pos >= end || *pos != '[')
+            {
+                return fail(JSONError::InvalidSyntax);
+            }
+            if(++depth > MAX_DEPTH)
+            {
+                return fail(JSONError::LimitExceeded);
+            }
+            pos++;
+            skipWhitespace();
+            if(!readChar(']'))
+            {
+                do
+                {
+                    if(!element())
+                    {
+                        return false;
+                    }
+                    skipWhitespace();
+                }
+                while(readChar(','));
+                if(!readChar(']'))
+                {
+                    return fail(JSONError::InvalidSyntax);
+                }
+            }
+            depth--;
+            return true;
+        }
+
+        /**
+         * Skip a value.
+         * Objects and arrays are skipped by matching brackets, the values inside are not checked.
+         */
+        bool skipValue()
+        {
+            skipWhitespace();
+            if(pos >= end)
+            {
+                return fail(JSONError::UnexpectedEndOfDocument);
+            }
+            const char *str;
+            size_t length;
+            bool escaped;
+            switch(*pos)
+            {
+                case '"':
+                    return readString(str, length, escaped);
+                case '{':
+                case '[':
+                {
+                    size_t level = 0;
+                    while(pos < end)
+                    {
+                        char c = *pos;
+                        if(c == '"')
+                        {
+                            if(!readString(str, length, escaped))
+                            {
+                                return false;
+                            }
+                            continue;
+                        }
+                        if(c == '{' || c == '[')
+                        {
+                            level++;
+                        }
+                        else if((c == '}' || c == ']') && --level == 0)
+                        {
+                            pos++;
+                            return true;
+                        }
+                        pos++;
+                    }
+                    return fail(JSONError::UnexpectedEndOfDocument);
+                }
+                case 't':
+                case 'f':
+                {
+                    bool value;
+                    return readBool(value);
+                }
+                case 'n':
+                    return readNull() || fail(JSONError::InvalidSyntax);
+            }
+            long lValue;
+            double dValue;
+            bool isDouble;
+            return readNumber(lValue, dValue, isDouble);
+        }
+
+    private:
+        const char *start;
+        const char *pos;
+        const char *end;
+        size_t depth;
+        JSONError error;
+        long errorIndex;
+
+        template<typename T>
+        static bool fits(long value)
+        {
+            if(std::is_signed<T>::value)
+            {
+                return value >= (long long) std::numeric_limits<T>::min() && value <= (long long) std::numeric_limits<T>::max();
+            }
+            return value >= 0 && (unsigned long long) value <= (unsigned long long) std::numeric_limits<T>::max();
+        }
+
+        template<typename T>
+        static bool fits(double value)
+        {
+            // One past the largest value, a power of two so it is exact as a double.
+            // Fractions do not fit either.
+            double limit = (double) (std::numeric_limits<T>::max() / 2 + 1) * 2.0;
+            return value >= (double) std::numeric_limits<T>::min() && value < limit && std::trunc(value) == value;
+        }
+
+        /**
+         * Read an integer with no sign, fraction or exponent.
+         * @param value Set to the value.
+         * @param overflow Set to true if the value does not fit in an unsigned long.
+         * @return False, without reading anything, if the number is not a plain integer.
+         */
+        bool readDigits(unsigned long &value, bool &overflow)
+        {
+            const char *p = pos;
+            value = 0;
+            overflow = false;
+            while(p < end && *p >= '0' && *p <= '9')
+            {
+                unsigned long digit = *p - '0';
+                if(value > (ULONG_MAX - digit) / 10)
+                {
+                    overflow = true;
+                }
+                value = value * 10 + digit;
+                p++;
+            }
+            if(p == pos || (p < end && (*p == '.' || *p == 'e' || *p == 'E')))
+            {
+                return false;
+            }
+            pos = p;
+            return true;
+        }
+
+        bool readChar(char c)
+        {
+            if(pos < end && *pos == c)
+            {
+                pos++;
+                return true;
+            }
+            return false;
+        }
+
+        bool readWord(const char *word, size_t length)
+        {
+            if((size_t) (end - pos) >= length && std::memcmp(pos, word, length) == 0)
+            {
+                pos += length;
+                return true;
+            }
+            return false;
+        }
+    };
+
+    /**
+     * Reads and writes one type of value for JSONBind.
+     * The general case is a struct with its own JSONFields.
+     */
+    template<typename T, typename Enable = void>
+    struct JSONBindValue
+    {
+
+        static bool read(JSONBindReader &reader, T &value)
+        {
+            return JSONBind<T>::instance().readObject(reader, value);
+        }
+
+        static void write(JSONWriter &writer, const T &value)
+        {
+            JSONBind<T>::instance().writeObject(writer, value);
+        }
+    };
+
+    template<>
+    struct JSONBindValue<bool>
+    {
+
+        static bool read(JSONBindReader &reader, bool &value)
+        {
+            return reader.readBool(value);
+        }
+
+        static void write(JSONWriter &writer, bool value)
+        {
+            writer.boolean(value);
+        }
+    };
+
+    template<typename T>
+    struct JSONBindValue<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+    {
+
+        static bool read(JSONBindReader &reader, T &value)
+        {
+            return reader.readInteger(value);
+        }
+
+        static void write(JSONWriter &writer, T value)
+        {
+            if(std::is_unsigned<T>::value)
+            {
+                writer.number((unsigned long) value);
+                return;
+            }
+            writer.number((long) value);
+        }
+    };
+
+    template<typename T>
+    struct JSONBindValue<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+    {
+
+        static bool read(JSONBindReader &reader, T &value)
+        {
+            long lValue;
+            double dValue;
+            bool isDouble;
+            if(!reader.readNumber(lValue, dValue, isDouble))
+            {
+                return false;
+            }
+            value = isDouble ? (T) dValue : (T) lValue;
+            return true;
+        }
+
+        static void write(JSONWriter &writer, T value)
+        {
+            writer.number((double) value);
+        }
+    };
+
+    template<>
+    struct JSONBindValue<std::string>
+    {
+
+        static bool read(JSONBindReader &reader, std::string &value)
+        {
+            return reader.readString(value);
+        }
+
+        static void write(JSONWriter &writer, const std::string &value)
+        {
+            writer.string(value);
+        }
+    };
+
+    template<typename T>
+    struct JSONBindValue<std::vector<T>>
+    {
+
+        static bool read(JSONBindReader &reader, std::vector<T> &value)
+        {
+            value.clear();
+            return reader.readArray([&reader, &value]() -> bool
+            {
+                T element = T();
+                if(!reader.readNull() && !JSONBindValue<T>::read(reader, element))
+                {
+                    return false;
+                }
+                value.push_back(std::move(element));
+                return true;
+            });
+        }
+
+        static void write(JSONWriter &writer, const std::vector<T> &value)
+        {
+            writer.startArray();
+            for(auto &&element : value)
+            {
+                JSONBindValue<T>::write(writer, element);
+            }
+            writer.endArray();
+        }
+    };
+
+    /**
+     * Maps a struct to a JSON object, reading and writing its fields directly
+     * from and to JSON text without building JSONValues.
+     * The fields are declared once through JSONFields<T>.  Names are hashed when
+     * they are declared and members are expected in declaration order, so most
+     * names are matched with one comparison.  Unknown members are skipped, null
+     * and missing members leave their fields unchanged.
+     * Fields can be bool, integers, floating point numbers, std::string,
+     * std::vector of a field type or another bound struct.
+     */
+    template<typename T>
+    class JSONBind
+    {
+    public:
+
+        /**
+         * Read a JSON object into a value.
+         * @param json The JSON text.
+         * @param value The value to read into.
+         * @return The error code, JSONError::NONE on success.
+         */
+        static JSONError read(const std::string &json, T &value)
+        {
+            long errorIndex;
+            return read(json.data(), json.length(), value, errorIndex);
+        }
+
+        /**
+         * Read a JSON object into a value.
+         * @param json The JSON text.
+         * @param length The length of the text.
+         * @param value The value to read into.
+         * @param errorIndex Set to the location of the error, or -1.
+         * @return The error code, JSONError::NONE on success.
+         */
+        static JSONError read(const char *json, size_t length, T &value, long &errorIndex)
+        {
+            JSONBindReader reader(json, length);
+            if(JSONBindValue<T>::read(reader, value))
+            {
+                reader.finish();
+            }
+            errorIndex = reader.getErrorIndex();
+            return reader.getError();
+        }
+
+        /**
+         * Write a value as a JSON object.
+         * @param value The value.
+         * @param writer The writer.
+         */
+        static void write(const T &value, JSONWriter &writer)
+        {
+            JSONBindValue<T>::write(writer, value);
+        }
+
+        /**
+         * Append a value to a buffer as a JSON object.
+         * @param value The value.
+         * @param buffer The buffer.
+         * @param pretty True to put every member and element on its own line.
+         */
+        static void write(const T &value, std::string &buffer, bool pretty = false)
+        {
+            JSONWriter writer(buffer, pretty);
+            write(value, writer);
+        }
+
+        /**
+         * Declare a field.  Called from JSONFields<T>::declare().
+         * @param name The name of the member in JSON.
+         * @param member The field.
+         */
+        template<typename M>
+        void field(const std::string &name, M T::*member)
+        {
+            fields.push_back(std::unique_ptr<Field>(new MemberField<M>(name, member)));
+        }
+
+        /**
+         * Get the fields of T.
+         */
+        static const JSONBind &instance()
+        {
+            static const JSONBind bind;
+            return bind;
+        }
+
+        bool readObject(JSONBindReader &reader, T &value) const
+        {
+            size_t next = 0;
+            std::string unescaped;
+            return reader.readObject([this, &reader, &value, &next, &unescaped](const char *name, size_t length, bool escaped) -> bool
+            {
+                if(escaped)
+                {
+                    unescaped.clear();
+                    JSONDocument::unescape(name, length, unescaped);
+                    name = unescaped.data();
+                    length = unescaped.length();
+                }
+                const Field *found = find(name, length, next);
+                if(found == nullptr)
+                {
+                    return reader.skipValue();
+                }
+                return reader.readNull() || found->read(reader, value);
+            });
+        }
+
+        void writeObject(JSONWriter &writer, const T &value) const
+        {
+            writer.startObject();
+            for(auto &field : fields)
+            {
+                writer.escapedKey(field->escapedName.data(), field->escapedName.length());
+                field->write(writer, value);
+            }
+            writer.endObject();
+        }
+
+    private:
+
+        struct Field
+        {
+            std::string name;
+            std::string escapedName;
+            uint64_t hash;
+
+            Field(const std::string &nName)
+            {
+                name = nName;
+                JSONWriter::escape(name.data(), name.length(), escapedName);
+                hash = JSONMembers::hash(name.data(), name.length());
+            }
+
+            virtual ~Field() { }
+
+            bool matches(const char *str, size_t length, uint64_t h) const
+            {
+                return hash == h && name.length() == length && std::memcmp(name.data(), str, length) == 0;
+            }
+
+            virtual bool read(JSONBindReader &reader, T &value) const = 0;
+            virtual void write(JSONWriter &writer, const T &value) const = 0;
+        };
+
+        template<typename M>
+        struct MemberField : public Field
+        {
+            M T::*member;
+
+            MemberField(const std::string &nName, M T::*nMember) : Field(nName), member(nMember) { }
+
+            bool read(JSONBindReader &reader, T &value) const override
+            {
+                return JSONBindValue<M>::read(reader, value.*member);
+            }
+
+            void write(JSONWriter &writer, const T &value) const override
+            {
+                JSONBindValue<M>::write(writer, value.*member);
+            }
+        };
+
+        std::vector<std::unique_ptr<Field>> fields;
+
+        JSONBind()
+        {
+            JSONFields<T>::declare(*this);
+        }
+
+        JSONBind(const JSONBind& orig) = delete;
+
+        /**
+         * Find the field for a member name.
+         * @param next The field expected next.  Updated to follow the field found.
+         * @return The field or nullptr if there is none.
+         */
+        const Field *find(const char *name, size_t length, size_t &next) const
+        {
+            uint64_t h = JSONMembers::hash(name, length);
+            if(next < fields.size() && fields[next]->matches(name, length, h))
+            {
+                return fields[next++].get();
+            }
+            for(size_t i = 0; i < fields.size(); i++)
+            {
+                if(fields[i]->matches(name, length, h))
+                {
+                    next = i + 1;
+                    return fields[i].get();
+                }
+            }
+            return nullptr;
+        }
+    };
+
+}
+
+#endif /* JSONBIND_H */
@@ -0,0 +1,267 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JSONINDEX_H
+#define JSONINDEX_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../Utility/KSimd.h"
+
+namespace KayLib
+{
+
+    /**
+     * Finds the structural characters of a JSON document 64 bytes at a time.
+     * The index holds the offset of every '{', '}', '[', ']', ':' and ',' outside
+     * of a string, every opening quote and the first character of every other
+     * token (numbers, true, false and null).
+     */
+    class JSONStructuralIndex
+    {
+    public:
+
+        /**
+         * Build the index of a document.
+         * @param data The document.
+         * @param length The length of the document.  Must be less than 4GB.
+         * @param index Receives the offsets.  Any previous content is discarded.
+         * @return True on success.  False if the document ends inside a string.
+         */
+        static bool build(const char *data, size_t length, std::vector<uint32_t> &index)
+        {
+            index.clear();
+            switch(KSimd::level())
+            {
+#ifdef KAYLIB_SIMD_X86
+                case KSimd::Level::AVX2:
+                    return scan(data, length, index, &classifyAVX2);
+                case KSimd::Level::SSE2:
+                    return scan(data, length, index, &classifySSE2);
+#endif
+                default:
+                    return scan(data, length, index, &classifyScalar);
+            }
+        }
+
+    private:
+
+        /**
+         * Character classes of one 64 byte block, one bit per byte.
+         */
+        struct Block
+        {
+            uint64_t quote;
+            uint64_t backslash;
+            uint64_t op;
+            uint64_t space;
+        };
+
+        typedef void (*Classifier)(const char *, Block &);
+
+        static bool scan(const char *data, size_t length, std::vector<uint32_t> &index, Classifier classify)
+        {
+            // Most documents have a structural character every few bytes.
+            index.reserve(length / 4 + 16);
+            uint64_t nextIsEscaped = 0;
+            uint64_t inString = 0;
+            uint64_t prevScalar = 0;
+            Block block;
+            char tail[64];
+            for(size_t base = 0; base < length; base += 64)
+            {
+                const char *chunk = data + base;
+                if(length - base < 64)
+                {
+                    // Pad the last block with whitespace.
+                    std::memset(tail, ' ', sizeof (tail));
+                    std::memcpy(tail, chunk, length - base);
+                    chunk = tail;
+                }
+                classify(chunk, block);
+                // Find the characters that are escaped by a backslash.
+                uint64_t escaped = findEscaped(block.backslash, nextIsEscaped);
+                uint64_t quote = block.quote & ~escaped;
+                // Every bit from an opening quote up to, but not including, its closing quote.
+                uint64_t stringMask = prefixXor(quote) ^ inString;
+                inString = (uint64_t) ((int64_t) stringMask >> 63);
+                uint64_t outside = ~stringMask;
+                uint64_t op = block.op & outside;
+                uint64_t scalar = outside & ~(block.op | block.space | quote);
+                uint64_t scalarStart = scalar & ~((scalar << 1) | prevScalar);
+                prevScalar = scalar >> 63;
+                uint64_t bits = op | (quote & stringMask) | scalarStart;
+                while(bits != 0)
+                {
+                    index.push_back((uint32_t) (base + KSimd::trailingZeros(bits)));
+                    bits &= bits - 1;
+                }
+            }
+            return inString == 0;
+        }
+
+        /**
+         * Find the characters preceded by an odd number of backslashes.
+         * @param backslash The backslash bits of the block.
+         * @param nextIsEscaped Carries an unfinished escape into the next block.
+         * @return The escaped character bits.
+         */
+        static uint64_t findEscaped(uint64_t backslash, uint64_t &nextIsEscaped)
+        {
+            const uint64_t oddBits = 0xAAAAAAAAAAAAAAAAULL;
+            if(backslash == 0)
+            {
+                uint64_t escaped = nextIsEscaped;
+                nextIsEscaped = 0;
+                return escaped;
+            }
+            // A backslash escaped by the previous block does not start an escape.
+            uint64_t potential = backslash & ~nextIsEscaped;
+            // Subtracting each run from its successor's bit flips the parity of the run
+            // so every other backslash, and the character after an odd run, stands out.
+            uint64_t codes = (((potential << 1) | oddBits) - potential) ^ oddBits;
+            uint64_t escaped = codes ^ (backslash | nextIsEscaped);
+            nextIsEscaped = (codes & backslash) >> 63;
+            return escaped;
+        }
+
+        /**
+         * Get the running exclusive or of the bits, from the lowest bit up.
+         */
+        static uint64_t prefixXor(uint64_t bits)
+        {
+            bits ^= bits << 1;
+            bits ^= bits << 2;
+            bits ^= bits << 4;
+            bits ^= bits << 8;
+            bits ^= bits << 16;
+            bits ^= bits << 32;
+            return bits;
+        }
+
+        static void classifyScalar(const char *chunk, Block &block)
+        {
+            block.quote = 0;
+            block.backslash = 0;
+            block.op = 0;
+            block.space = 0;
+            for(int i = 0; i < 64; i++)
+            {
+                uint64_t bit = 1ULL << i;
+                switch(chunk[i])
+                {
+                    case '"':
+                        block.quote |= bit;
+                        break;
+                    case '\\':
+                        block.backslash |= bit;
+                        break;
+                    case '{':
+                    case '}':
+                    case '[':
+                    case ']':
+                    case ':':
+                    case ',':
+                        block.op |= bit;
+                        break;
+                    case ' ':
+                    case '\t':
+                    case '\n':
+                    case '\r':
+                        block.space |= bit;
+                        break;
+                }
+            }
+        }
+
+#ifdef KAYLIB_SIMD_X86
+
+        static void classifySSE2(const char *chunk, Block &block)
+        {
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i lower = _mm_set1_epi8(0x20);
+            // '[' and ']' differ from '{' and '}' only by 0x20.
+            const __m128i open = _mm_set1_epi8('{');
+            const __m128i close = _mm_set1_epi8('}');
+            const __m128i colon = _mm_set1_epi8(':');
+            const __m128i comma = _mm_set1_epi8(',');
+            const __m128i space = _mm_set1_epi8(' ');
+            const __m128i tab = _mm_set1_epi8('\t');
+            const __m128i lf = _mm_set1_epi8('\n');
+            const __m128i cr = _mm_set1_epi8('\r');
+            block.quote = 0;
+            block.backslash = 0;
+            block.op = 0;
+            block.space = 0;
+            for(int i = 0; i < 4; i++)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *> (chunk + i * 16));
+                __m128i vl = _mm_or_si128(v, lower);
+                __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(vl, open), _mm_cmpeq_epi8(vl, close)),
+                                          _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+                __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                                          _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+                int shift = i * 16;
+                block.quote |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << shift;
+                block.backslash |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << shift;
+                block.op |= (uint64_t) (uint16_t) _mm_movemask_epi8(op) << shift;
+                block.space |= (uint64_t) (uint16_t) _mm_movemask_epi8(ws) << shift;
+            }
+        }
+
+        __attribute__((target("avx2")))
+        static void classifyAVX2(const char *chunk, Block &block)
+        {
+            const __m256i quote = _mm256_set1_epi8('"');
+            const __m256i backslash = _mm256_set1_epi8('\\');
+            const __m256i lower = _mm256_set1_epi8(0x20);
+            const __m256i open = _mm256_set1_epi8('{');
+            const __m256i close = _mm256_set1_epi8('}');
+            const __m256i colon = _mm256_set1_epi8(':');
+            const __m256i comma = _mm256_set1_epi8(',');
+            const __m256i space = _mm256_set1_epi8(' ');
+            const __m256i tab = _mm256_set1_epi8('\t');
+            const __m256i lf = _mm256_set1_epi8('\n');
+            const __m256i cr = _mm256_set1_epi8('\r');
+            block.quote = 0;
+            block.backslash = 0;
+            block.op = 0;
+            block.space = 0;
+            for(int i = 0; i < 2; i++)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *> (chunk + i * 32));
+                __m256i vl = _mm256_or_si256(v, lower);
+                __m256i op = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(vl, open), _mm256_cmpeq_epi8(vl, close)),
+                                             _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)));
+                __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+                                             _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+                int shift = i * 32;
+                block.quote |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << shift;
+                block.backslash |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) << shift;
+                block.op |= (uint64_t) (uint32_t) _mm256_movemask_epi8(op) << shift;
+                block.space |= (uint64_t) (uint32_t) _mm256_movemask_epi8(ws) << shift;
+            }
+        }
+#endif
+
+    };
+
+}
+
+#endif /* JSONINDEX_H */
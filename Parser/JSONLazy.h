@@ -0,0 +1,764 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JSONLAZY_H
+#define JSONLAZY_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+#include "JSON.h"
+
+namespace KayLib
+{
+
+    class JSONLazyDocument;
+
+    /**
+     * A value of a JSONLazyDocument.
+     * Values are small handles that refer to the document text.  They are only
+     * valid while their document exists.
+     */
+    class JSONLazyValue
+    {
+        friend class JSONLazyDocument;
+    public:
+
+        JSONLazyValue() : doc(nullptr), start(0) { }
+
+        /**
+         * Check if the value exists.
+         * @return False for the result of looking up a missing value.
+         */
+        bool isValid() const
+        {
+            return doc != nullptr;
+        }
+
+        /**
+         * Get the type of the value.
+         * @return The value type.  JSONType::_NULL if the value is not valid.
+         */
+        JSONType type() const;
+
+        /**
+         * Get the number of members of an object or elements of an array.
+         * @return The number of members or elements, zero for other values.
+         */
+        size_t size() const;
+
+        /**
+         * Get the named value of an object.
+         * @param valName The value to get.
+         * @return The value.  Not valid if not found.
+         */
+        JSONLazyValue getValue(const std::string &valName) const;
+
+        /**
+         * Check if the named value exists.
+         * @param valName The value to check for.
+         * @return True if the value exists. False if not.
+         */
+        bool hasValue(const std::string &valName) const
+        {
+            return getValue(valName).isValid();
+        }
+
+        /**
+         * Get the names of all values of an object.
+         * @return The list of value names in document order.
+         */
+        std::vector<std::string> getValueNames() const;
+
+        /**
+         * Get an element of an array.
+         * @param index The index of the element.
+         * @return The element.  Not valid if out of range.
+         */
+        JSONLazyValue at(size_t index) const;
+
+        /**
+         * Get the named value if it can be represented as a string.
+         * @return The value or an empty string if not found.
+         * @see JSONObject::getString()
+         */
+        std::string getString(const std::string &valName) const
+        {
+            return getValue(valName).asString();
+        }
+
+        /**
+         * Get the named value if it can be represented as a int.
+         * @return The value or zero if not found.
+         * @see JSONObject::getInt()
+         */
+        long getInt(const std::string &valName) const
+        {
+            return getValue(valName).asInt();
+        }
+
+        /**
+         * Get the named value if it can be represented as a double.
+         * @return The value or zero if not found.
+         * @see JSONObject::getDouble()
+         */
+        double getDouble(const std::string &valName) const
+        {
+            return getValue(valName).asDouble();
+        }
+
+        /**
+         * Get the named value if it can be represented as a bool.
+         * @return The 0 if false, 1 if true or -1 if not found.
+         * @see JSONObject::getBool()
+         */
+        int getBool(const std::string &valName) const
+        {
+            return getValue(valName).asBool();
+        }
+
+        /**
+         * Convert this value the same way JSONObject::getString() converts a member.
+         */
+        std::string asString() const
+        {
+            return scalar(JSONObject::valueToString);
+        }
+
+        long asInt() const
+        {
+            return scalar(JSONObject::valueToInt);
+        }
+
+        double asDouble() const
+        {
+            return scalar(JSONObject::valueToDouble);
+        }
+
+        int asBool() const
+        {
+            return scalar(JSONObject::valueToBool);
+        }
+
+        /**
+         * Get the text of the value as it appears in the document.
+         * @return The text.
+         */
+        std::string getText() const;
+
+        /**
+         * Fully parse the value.
+         * @return The parsed value or nullptr if it is not valid.
+         */
+        std::shared_ptr<JSONValue> parse() const;
+
+    private:
+        JSONLazyDocument *doc;
+        // Offset of the first character of the value.
+        size_t start;
+
+        JSONLazyValue(JSONLazyDocument *nDoc, size_t nStart) : doc(nDoc), start(nStart) { }
+
+        /**
+         * Convert a scalar value with one of the JSONObject conversions.
+         */
+        template<typename Convert>
+        auto scalar(Convert convert) const -> decltype(convert(nullptr));
+    };
+
+    /**
+     * A JSON document that is parsed on demand.
+     * Construction only finds the root value.  The members of an object, or the
+     * elements of an array, are located the first time the container is used,
+     * and the values inside are skipped by matching brackets rather than parsed.
+     * Parts of the document that are never used are never checked for errors.
+     * @note Reading changes the internal state, the document is not thread safe.
+     */
+    class JSONLazyDocument
+    {
+        friend class JSONLazyValue;
+    public:
+
+        /**
+         * Create a document from a copy of the text.
+         * @param doc The document text.
+         */
+        JSONLazyDocument(const std::string &doc) : owned(doc)
+        {
+            init(owned.data(), owned.length());
+        }
+
+        /**
+         * Create a document that refers to text owned by the caller.
+         * @param data The document text.  Must not change or be destroyed while the document is in use.
+         * @param length The length of the text.
+         */
+        JSONLazyDocument(const char *data, size_t length)
+        {
+            init(data, length);
+        }
+
+        JSONLazyDocument(const JSONLazyDocument& orig) = delete;
+        JSONLazyDocument &operator=(const JSONLazyDocument& orig) = delete;
+
+        virtual ~JSONLazyDocument() { }
+
+        /**
+         * Get the documents root element.
+         * @return The root element.  Not valid if the document is empty.
+         */
+        JSONLazyValue getRoot()
+        {
+            if(rootStart == std::string::npos)
+            {
+                return JSONLazyValue();
+            }
+            return JSONLazyValue(this, rootStart);
+        }
+
+        std::string getString(const std::string &valName)
+        {
+            return getRoot().getString(valName);
+        }
+
+        long getInt(const std::string &valName)
+        {
+            return getRoot().getInt(valName);
+        }
+
+        double getDouble(const std::string &valName)
+        {
+            return getRoot().getDouble(valName);
+        }
+
+        int getBool(const std::string &valName)
+        {
+            return getRoot().getBool(valName);
+        }
+
+        /**
+         * Get the last error code.
+         * Only the parts of the document that have been used are checked.
+         * @return The error code.
+         */
+        JSONError getError() const
+        {
+            return lastError;
+        }
+
+        /**
+         * Get the location of the last error.
+         * @return The location.
+         */
+        long getErrorIndex() const
+        {
+            return errorIndex;
+        }
+
+    private:
+
+        /**
+         * A member of an object or element of an array.
+         */
+        struct Entry
+        {
+            // The member name as it appears in the document, empty for elements.
+            size_t nameStart;
+            size_t nameLength;
+            size_t start;
+        };
+
+        /**
+         * The located members or elements of a container.
+         */
+        struct Container
+        {
+            std::vector<Entry> entries;
+            // Hashes of the member names, kept apart so lookups scan a small array.
+            std::vector<uint64_t> hashes;
+        };
+
+        std::string owned;
+        const char *source;
+        size_t length;
+        size_t rootStart;
+        JSONError lastError;
+        long errorIndex;
+        // Containers by the offset of their opening bracket.
+        std::unordered_map<size_t, Container> containers;
+
+        void init(const char *data, size_t nLength)
+        {
+            source = data;
+            length = nLength;
+            lastError = JSONError::NONE;
+            errorIndex = -1;
+            rootStart = skipWhitespace(0);
+            if(rootStart >= length)
+            {
+                // There is no value at all.
+                rootStart = std::string::npos;
+                setError(JSONError::UnexpectedEndOfDocument, 0);
+            }
+        }
+
+        void setError(JSONError error, size_t index)
+        {
+            if(lastError == JSONError::NONE)
+            {
+                lastError = error;
+                errorIndex = (long) index;
+            }
+        }
+
+        size_t skipWhitespace(size_t pos) const
+        {
+            while(pos < length && (source[pos] == ' ' || source[pos] == '\t' || source[pos] == '\n' || source[pos] == '\r'))
+            {
+                pos++;
+            }
+            return pos;
+        }
+
+        /**
+         * Find the end of the value starting at 'pos'.
+         * @return The offset after the value or npos if the document ends first.
+         */
+        size_t skipValue(size_t pos) const
+        {
+            char c = source[pos];
+            if(c == '{' || c == '[')
+            {
+                return skipContainer(pos);
+            }
+            if(c == '"')
+            {
+                return skipString(pos);
+            }
+            while(pos < length)
+            {
+                c = source[pos];
+                if(c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r')
+                {
+                    break;
+                }
+                pos++;
+            }
+            return pos;
+        }
+
+        /**
+         * Find the end of the string starting at 'pos'.
+         * @return The offset after the closing quote or npos if the document ends first.
+         */
+        size_t skipString(size_t pos) const
+        {
+            pos++;
+            while(pos < length)
+            {
+                char c = source[pos];
+                if(c == '\\')
+                {
+                    pos += 2;
+                    continue;
+                }
+                if(c == '"')
+                {
+                    return pos + 1;
+                }
+                pos++;
+            }
+            return std::string::npos;
+        }
+
+        /**
+         * Find the end of the object or array starting at 'pos' by counting brackets.
+         * @return The offset after the closing bracket or npos if the document ends first.
+         */
+        size_t skipContainer(size_t pos) const
+        {
+            size_t depth = 0;
+            bool inString = false;
+            while(pos < length)
+            {
+                char c = source[pos];
+                if(inString)
+                {
+                    if(c == '\\')
+                    {
+                        pos += 2;
+                        pos = nextBracketOrQuote(pos);
+                        continue;
+                    }
+                    if(c == '"')
+                    {
+                        inString = false;
+                    }
+                }
+                else if(c == '"')
+                {
+                    inString = true;
+                }
+                else if(c == '{' || c == '[')
+                {
+                    depth++;
+                }
+                else if(c == '}' || c == ']')
+                {
+                    if(--depth == 0)
+                    {
+                        return pos + 1;
+                    }
+                }
+                pos = nextBracketOrQuote(pos + 1);
+            }
+            return std::string::npos;
+        }
+
+        /**
+         * Find the next bracket, quote or backslash.
+         * @return Its offset or the document length.
+         */
+        size_t nextBracketOrQuote(size_t pos) const
+        {
+#ifdef KAYLIB_SIMD_X86
+            if(KSimd::level() != KSimd::Level::SCALAR)
+            {
+                const __m128i quote = _mm_set1_epi8('"');
+                const __m128i backslash = _mm_set1_epi8('\\');
+                const __m128i lower = _mm_set1_epi8(0x20);
+                // '[' and ']' differ from '{' and '}' only by 0x20.
+                const __m128i open = _mm_set1_epi8('{');
+                const __m128i close = _mm_set1_epi8('}');
+                for(; pos + 16 <= length; pos += 16)
+                {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *> (source + pos));
+                    __m128i vl = _mm_or_si128(v, lower);
+                    __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                               _mm_or_si128(_mm_cmpeq_epi8(vl, open), _mm_cmpeq_epi8(vl, close)));
+                    int mask = _mm_movemask_epi8(hit);
+                    if(mask != 0)
+                    {
+                        return pos + KSimd::trailingZeros((uint64_t) mask);
+                    }
+                }
+            }
+#endif
+            while(pos < length)
+            {
+                char c = source[pos];
+                if(c == '"' || c == '\\' || c == '{' || c == '}' || c == '[' || c == ']')
+                {
+                    break;
+                }
+                pos++;
+            }
+            return pos;
+        }
+
+        /**
+         * Locate the members or elements of a container, once.
+         * @param pos The offset of the opening bracket.
+         * @return The container.
+         */
+        const Container &getContainer(size_t pos)
+        {
+            auto itr = containers.find(pos);
+            if(itr != containers.end())
+            {
+                return itr->second;
+            }
+            Container &container = containers[pos];
+            bool object = source[pos] == '{';
+            char close = object ? '}' : ']';
+            pos = skipWhitespace(pos + 1);
+            if(pos < length && source[pos] == close)
+            {
+                return container;
+            }
+            while(true)
+            {
+                Entry entry = {0, 0, 0};
+                if(object)
+                {
+                    if(pos >= length || source[pos] != '"')
+                    {
+                        setError(pos >= length ? JSONError::UnexpectedEndOfDocument : JSONError::InvalidObjectName, pos);
+                        return container;
+                    }
+                    size_t end = skipString(pos);
+                    if(end == std::string::npos)
+                    {
+                        setError(JSONError::UnexpectedEndOfDocument, length);
+                        return container;
+                    }
+                    entry.nameStart = pos + 1;
+                    entry.nameLength = end - pos - 2;
+                    pos = skipWhitespace(end);
+                    if(pos >= length || source[pos] != ':')
+                    {
+                        setError(pos >= length ? JSONError::UnexpectedEndOfDocument : JSONError::InvalidSyntax, pos);
+                        return container;
+                    }
+                    pos = skipWhitespace(pos + 1);
+                }
+                if(pos >= length)
+                {
+                    setError(JSONError::UnexpectedEndOfDocument, pos);
+                    return container;
+                }
+                entry.start = pos;
+                size_t end = skipValue(pos);
+                if(end == std::string::npos || end == pos)
+                {
+                    setError(end == pos ? JSONError::InvalidSyntax : JSONError::UnexpectedEndOfDocument, end == pos ? pos : length);
+                    return container;
+                }
+                container.entries.push_back(entry);
+                if(object)
+                {
+                    container.hashes.push_back(JSONMembers::hash(source + entry.nameStart, entry.nameLength));
+                }
+                pos = skipWhitespace(end);
+                if(pos < length && source[pos] == ',')
+                {
+                    pos = skipWhitespace(pos + 1);
+                    continue;
+                }
+                if(pos < length && source[pos] == close)
+                {
+                    return container;
+                }
+                setError(pos >= length ? JSONError::UnexpectedEndOfDocument : JSONError::InvalidSyntax, pos);
+                return container;
+            }
+        }
+
+        /**
+         * Find a member of the object at 'pos'.
+         * A repeated name finds the last member, as in JSONObject.
+         * @return The offset of the value or npos if not found.
+         */
+        size_t findMember(size_t pos, const std::string &valName)
+        {
+            if(source[pos] != '{')
+            {
+                return std::string::npos;
+            }
+            const Container &container = getContainer(pos);
+            uint64_t h = JSONMembers::hash(valName.data(), valName.length());
+            for(size_t i = container.hashes.size(); i > 0; i--)
+            {
+                const Entry &entry = container.entries[i - 1];
+                if(container.hashes[i - 1] == h && entry.nameLength == valName.length()
+                        && valName.compare(0, std::string::npos, source + entry.nameStart, entry.nameLength) == 0)
+                {
+                    return entry.start;
+                }
+            }
+            return std::string::npos;
+        }
+    };
+
+    inline JSONType JSONLazyValue::type() const
+    {
+        if(doc == nullptr)
+        {
+            return JSONType::_NULL;
+        }
+        switch(doc->source[start])
+        {
+            case '{':
+                return JSONType::OBJECT;
+            case '[':
+                return JSONType::ARRAY;
+            case '"':
+                return JSONType::STRING;
+            case 't':
+            case 'f':
+                return JSONType::BOOL;
+            case 'n':
+                return JSONType::_NULL;
+        }
+        return JSONType::NUMBER;
+    }
+
+    inline size_t JSONLazyValue::size() const
+    {
+        JSONType t = type();
+        if(doc == nullptr || (t != JSONType::OBJECT && t != JSONType::ARRAY))
+        {
+            return 0;
+        }
+        return doc->getContainer(start).entries.size();
+    }
+
+    inline JSONLazyValue JSONLazyValue::getValue(const std::string &valName) const
+    {
+        if(doc == nullptr)
+        {
+            return JSONLazyValue();
+        }
+        size_t pos = doc->findMember(start, valName);
+        if(pos == std::string::npos)
+        {
+            return JSONLazyValue();
+        }
+        return JSONLazyValue(doc, pos);
+    }
+
+    inline std::vector<std::string> JSONLazyValue::getValueNames() const
+    {
+        std::vector<std::string> names;
+        if(type() != JSONType::OBJECT || doc == nullptr)
+        {
+            return names;
+        }
+        for(auto &entry : doc->getContainer(start).entries)
+        {
+            names.push_back(std::string(doc->source + entry.nameStart, entry.nameLength));
+        }
+        return names;
+    }
+
+    inline JSONLazyValue JSONLazyValue::at(size_t index) const
+    {
+        if(type() != JSONType::ARRAY || doc == nullptr)
+        {
+            return JSONLazyValue();
+        }
+        auto &entries = doc->getContainer(start).entries;
+        if(index >= entries.size())
+        {
+            return JSONLazyValue();
+        }
+        return JSONLazyValue(doc, entries[index].start);
+    }
+
+    inline std::string JSONLazyValue::getText() const
+    {
+        if(doc == nullptr)
+        {
+            return "";
+        }
+        size_t end = doc->skipValue(start);
+        if(end == std::string::npos)
+        {
+            end = doc->length;
+        }
+        return std::string(doc->source + start, end - start);
+    }
+
+    inline std::shared_ptr<JSONValue> JSONLazyValue::parse() const
+    {
+        if(doc == nullptr)
+        {
+            return nullptr;
+        }
+        JSONDocument parsed(getText());
+        return parsed.getRoot();
+    }
+
+    template<typename Convert>
+    inline auto JSONLazyValue::scalar(Convert convert) const -> decltype(convert(nullptr))
+    {
+        if(doc == nullptr)
+        {
+            return convert(nullptr);
+        }
+        const char *str = doc->source + start;
+        const char *last = doc->source + doc->length;
+        switch(*str)
+        {
+            case '{':
+            {
+                JSONObject object;
+                return convert(&object);
+            }
+            case '[':
+            {
+                JSONArray array;
+                return convert(&array);
+            }
+            case '"':
+            {
+                size_t end = doc->skipString(start);
+                size_t length = (end == std::string::npos ? doc->length + 1 : end) - start - 2;
+                // Stored the same way JSONDocument stores strings.
+                bool plain = true;
+                for(size_t i = 1; i <= length; i++)
+                {
+                    char c = str[i];
+                    if(c == '\\' || c == '\'' || c <= 0x0F)
+                    {
+                        plain = false;
+                        break;
+                    }
+                }
+                if(plain)
+                {
+                    JSONString string(JSONText::borrow(str + 1, length));
+                    return convert(&string);
+                }
+                JSONString string(std::string(str + 1, length));
+                return convert(&string);
+            }
+            case 't':
+            case 'f':
+            {
+                if(last - str >= 4 && std::memcmp(str, "true", 4) == 0)
+                {
+                    JSONBool value(true);
+                    return convert(&value);
+                }
+                if(last - str >= 5 && std::memcmp(str, "false", 5) == 0)
+                {
+                    JSONBool value(false);
+                    return convert(&value);
+                }
+                break;
+            }
+            case 'n':
+            {
+                if(last - str >= 4 && std::memcmp(str, "null", 4) == 0)
+                {
+                    JSONNull value;
+                    return convert(&value);
+                }
+                break;
+            }
+            default:
+            {
+                long lValue;
+                double dValue;
+                if(JSONNumber::parseText(str, last, lValue, dValue))
+                {
+                    JSONNumber value(dValue);
+                    return convert(&value);
+                }
+                JSONNumber value(lValue);
+                return convert(&value);
+            }
+        }
+        doc->setError(JSONError::InvalidSyntax, start);
+        return convert(nullptr);
+    }
+
+}
+
+#endif /* JSONLAZY_H */
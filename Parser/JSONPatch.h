@@ -0,0 +1,657 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JSONPATCH_H
+#define JSONPATCH_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "JSON.h"
+#include "JSONPointer.h"
+#include "JSONWriter.h"
+
+namespace KayLib
+{
+
+    /**
+     * A JSON Patch (RFC 6902) compiled for applying to documents.
+     * Patching does not change any value.  It makes a new version of the document
+     * that shares every value the patch does not touch with the original, so only
+     * the objects and arrays on the path to a change are copied.  Versions are
+     * frozen, so readers can keep using older versions while new ones are made.
+     * Merge patches (RFC 7396) are applied the same way with merge().
+     */
+    class JSONPatch
+    {
+    public:
+
+        /**
+         * Compile a patch.
+         * @param patch The array of operations.
+         */
+        JSONPatch(const JSONValue &patch)
+        {
+            compile(&patch);
+        }
+
+        /**
+         * Compile a patch.
+         * @param patch The patch document.
+         */
+        JSONPatch(const JSONDocument &patch)
+        {
+            if(patch.getError() != JSONError::NONE)
+            {
+                error = "The patch is not valid JSON.";
+                return;
+            }
+            compile(patch.getRoot().get());
+        }
+
+        /**
+         * Compile a patch.
+         * @param patch The patch text.
+         */
+        JSONPatch(const std::string &patch) : JSONPatch(JSONDocument(patch)) { }
+
+        virtual ~JSONPatch() { }
+
+        /**
+         * Check if the patch compiled.
+         * @return True if valid.
+         */
+        bool isValid() const
+        {
+            return error.empty();
+        }
+
+        /**
+         * Get the reason the patch did not compile.
+         * @return The error or an empty string.
+         */
+        std::string getError() const
+        {
+            return error;
+        }
+
+        /**
+         * Make a patched version of a value.
+         * @param root The value to patch.  It is frozen if it is not already.
+         * @param failure Receives the reason an operation failed, or nullptr.
+         * @return The new version, or nullptr if an operation failed.  The original
+         * is never changed.
+         */
+        std::shared_ptr<JSONValue> apply(const std::shared_ptr<JSONValue> &root, std::string *failure = nullptr) const
+        {
+            std::string reason = error;
+            std::shared_ptr<JSONValue> version;
+            if(reason.empty() && !root)
+            {
+                reason = "There is no value to patch.";
+            }
+            if(reason.empty())
+            {
+                root->freeze();
+                version = JSONValue::share(root);
+                for(auto &operation : operations)
+                {
+                    if(!applyOperation(operation, version, reason))
+                    {
+                        break;
+                    }
+                }
+            }
+            if(!reason.empty())
+            {
+                if(failure != nullptr)
+                {
+                    *failure = reason;
+                }
+                return nullptr;
+            }
+            // Only the copied objects and arrays are not frozen yet.
+            version->freeze();
+            return version;
+        }
+
+        /**
+         * Make a patched version of a document.
+         * @param doc The document to patch.  It is frozen if it is not already.
+         * @param failure Receives the reason an operation failed, or nullptr.
+         * @return The new version, or nullptr if an operation failed.
+         */
+        std::shared_ptr<JSONValue> apply(const JSONDocument &doc, std::string *failure = nullptr) const
+        {
+            return apply(doc.getRoot(), failure);
+        }
+
+        /**
+         * Make a version of a value with a merge patch (RFC 7396) applied.
+         * Members set to null by the patch are removed, objects are merged
+         * and any other value replaces the original.
+         * @param root The value to patch or nullptr.  It is frozen if it is not already.
+         * @param patch The merge patch.  Its values are copied.
+         * @return The new version.
+         */
+        static std::shared_ptr<JSONValue> merge(const std::shared_ptr<JSONValue> &root, const JSONValue &patch)
+        {
+            if(root)
+            {
+                root->freeze();
+            }
+            std::shared_ptr<JSONValue> version = mergeValue(JSONValue::share(root), patch);
+            version->freeze();
+            return version;
+        }
+
+    private:
+
+        enum class Op
+        {
+            ADD, REMOVE, REPLACE, MOVE, COPY, TEST
+        };
+
+        struct Operation
+        {
+            Op op;
+            JSONPointer path;
+            JSONPointer from;
+            // Frozen so every version can share it.
+            std::shared_ptr<JSONValue> value;
+        };
+
+        typedef JSONPointer::Token Token;
+
+        std::vector<Operation> operations;
+        std::string error;
+
+        //
+        // Compiling
+        //
+
+        void compile(const JSONValue *patch)
+        {
+            if(patch == nullptr || patch->type() != JSONType::ARRAY)
+            {
+                error = "A patch must be an array of operations.";
+                return;
+            }
+            for(auto &entry : static_cast<const JSONArray &> (*patch).getArray())
+            {
+                if(!entry || entry->type() != JSONType::OBJECT)
+                {
+                    error = "A patch operation must be an object.";
+                    return;
+                }
+                const JSONObject &object = static_cast<const JSONObject &> (*entry);
+                std::string op = getText(object, "op");
+                static const char *names[] = {"add", "remove", "replace", "move", "copy", "test"};
+                int index = 0;
+                while(index < 6 && op != names[index])
+                {
+                    index++;
+                }
+                if(index == 6)
+                {
+                    error = "Unknown patch operation \"" + op + "\".";
+                    return;
+                }
+                Operation operation = {(Op) index, JSONPointer(getText(object, "path")), JSONPointer(getText(object, "from")), nullptr};
+                if(!object.hasValue("path") || !operation.path.isValid())
+                {
+                    error = "The " + op + " operation needs a valid path.";
+                    return;
+                }
+                if((operation.op == Op::MOVE || operation.op == Op::COPY) && (!object.hasValue("from") || !operation.from.isValid()))
+                {
+                    error = "The " + op + " operation needs a valid from path.";
+                    return;
+                }
+                if(operation.op == Op::ADD || operation.op == Op::REPLACE || operation.op == Op::TEST)
+                {
+                    std::shared_ptr<JSONValue> value = object.getValue("value");
+                    if(!value)
+                    {
+                        error = "The " + op + " operation needs a value.";
+                        return;
+                    }
+                    operation.value.reset(value->copy());
+                    operation.value->freeze();
+                }
+                operations.push_back(operation);
+            }
+        }
+
+        /**
+         * Get an unescaped string member.
+         * @return The string or an empty string if there is none.
+         */
+        static std::string getText(const JSONObject &object, const std::string &name)
+        {
+            std::shared_ptr<JSONValue> value = object.getValue(name);
+            if(!value || value->type() != JSONType::STRING)
+            {
+                return "";
+            }
+            std::string text = static_cast<const JSONString &> (*value).getValue();
+            std::string plain;
+            JSONDocument::unescape(text.data(), text.length(), plain);
+            return plain;
+        }
+
+        //
+        // Applying
+        //
+
+        bool applyOperation(const Operation &operation, std::shared_ptr<JSONValue> &version, std::string &reason) const
+        {
+            const std::vector<Token> &path = operation.path.tokens;
+            switch(operation.op)
+            {
+                case Op::ADD:
+                    return add(version, path, operation.value, reason);
+                case Op::REMOVE:
+                {
+                    std::shared_ptr<JSONValue> removed;
+                    return remove(version, path, removed, reason);
+                }
+                case Op::REPLACE:
+                    if(path.empty())
+                    {
+                        version = operation.value;
+                        return true;
+                    }
+                    return modify(version, path, 0, [&operation](JSONValue & parent, const Token & token)
+                    {
+                        std::shared_ptr<JSONValue> *slot = childSlot(parent, token);
+                        if(slot == nullptr)
+                        {
+                            return false;
+                        }
+                        *slot = operation.value;
+                        return true;
+                    }, reason);
+                case Op::MOVE:
+                {
+                    const std::vector<Token> &from = operation.from.tokens;
+                    if(from.size() < path.size() && std::equal(from.begin(), from.end(), path.begin(), [](const Token &a, const Token & b)
+                        {
+                            return a.name == b.name;
+                        }))
+                    {
+                        reason = "A value can not be moved into itself.";
+                        return false;
+                    }
+                    std::shared_ptr<JSONValue> moved;
+                    return remove(version, from, moved, reason) && add(version, path, moved, reason);
+                }
+                case Op::COPY:
+                {
+                    std::shared_ptr<JSONValue> copied = find(version, operation.from.tokens);
+                    if(!copied)
+                    {
+                        reason = "The path \"" + operation.from.toString() + "\" does not exist.";
+                        return false;
+                    }
+                    // The copy is shared, not duplicated.  A value this patch already changed
+                    // is frozen first so a later change to either path copies it.
+                    copied->freeze();
+                    return add(version, path, copied, reason);
+                }
+                default:
+                {
+                    std::shared_ptr<JSONValue> found = find(version, path);
+                    if(!found || !equal(found.get(), operation.value.get()))
+                    {
+                        reason = "The test of \"" + operation.path.toString() + "\" failed.";
+                        return false;
+                    }
+                    return true;
+                }
+            }
+        }
+
+        bool add(std::shared_ptr<JSONValue> &version, const std::vector<Token> &path, const std::shared_ptr<JSONValue> &value, std::string &reason) const
+        {
+            if(path.empty())
+            {
+                version = value;
+                return true;
+            }
+            return modify(version, path, 0, [&value](JSONValue & parent, const Token & token)
+            {
+                if(parent.type() == JSONType::OBJECT)
+                {
+                    JSONObject &object = static_cast<JSONObject &> (parent);
+                    const JSONMembers::Member *member = findMember(object, token);
+                    if(member != nullptr)
+                    {
+                        const_cast<JSONMembers::Member *> (member)->value = value;
+                    }
+                    else
+                    {
+                        object.values.set(storedName(token), value);
+                    }
+                    return true;
+                }
+                std::vector<std::shared_ptr<JSONValue>> &values = static_cast<JSONArray &> (parent).values;
+                if(token.name == "-")
+                {
+                    values.push_back(value);
+                    return true;
+                }
+                if(token.index < 0 || (size_t) token.index > values.size())
+                {
+                    return false;
+                }
+                values.insert(values.begin() + token.index, value);
+                return true;
+            }, reason);
+        }
+
+        bool remove(std::shared_ptr<JSONValue> &version, const std::vector<Token> &path, std::shared_ptr<JSONValue> &removed, std::string &reason) const
+        {
+            if(path.empty())
+            {
+                reason = "The whole document can not be removed.";
+                return false;
+            }
+            return modify(version, path, 0, [&removed](JSONValue & parent, const Token & token)
+            {
+                std::shared_ptr<JSONValue> *slot = childSlot(parent, token);
+                if(slot == nullptr)
+                {
+                    return false;
+                }
+                removed = *slot;
+                if(parent.type() == JSONType::OBJECT)
+                {
+                    // Remove the member by the name it is stored under.
+                    JSONObject &object = static_cast<JSONObject &> (parent);
+                    std::string name = findMember(object, token)->name.str();
+                    object.values.remove(name.data(), name.length());
+                }
+                else
+                {
+                    std::vector<std::shared_ptr<JSONValue>> &values = static_cast<JSONArray &> (parent).values;
+                    values.erase(values.begin() + token.index);
+                }
+                return true;
+            }, reason);
+        }
+
+        /**
+         * Change the object or array a path ends in, copying the frozen objects and
+         * arrays on the way so the original version is not changed.
+         * @param value The value the path starts from.  Replaced by its copy when it is frozen.
+         * @param path The path.
+         * @param pos The token of the path that 'value' is the parent of.
+         * @param change Called as bool(JSONValue &parent, const Token &last).
+         * @param reason Receives the reason the change failed.
+         * @return False if the path does not exist or the change failed.
+         */
+        template<typename Change>
+        bool modify(std::shared_ptr<JSONValue> &value, const std::vector<Token> &path, size_t pos, const Change &change, std::string &reason) const
+        {
+            if(!value || (value->type() != JSONType::OBJECT && value->type() != JSONType::ARRAY))
+            {
+                reason = "The path \"" + pathText(path, pos) + "\" is not an object or array.";
+                return false;
+            }
+            writable(value);
+            if(pos + 1 == path.size())
+            {
+                if(!change(*value, path[pos]))
+                {
+                    reason = "The path \"" + pathText(path, pos + 1) + "\" can not be changed.";
+                    return false;
+                }
+                return true;
+            }
+            std::shared_ptr<JSONValue> *slot = childSlot(*value, path[pos]);
+            if(slot == nullptr)
+            {
+                reason = "The path \"" + pathText(path, pos + 1) + "\" does not exist.";
+                return false;
+            }
+            return modify(*slot, path, pos + 1, change, reason);
+        }
+
+        /**
+         * Replace a frozen object or array by a copy that shares its values.
+         * @param value The object or array.
+         */
+        static void writable(std::shared_ptr<JSONValue> &value)
+        {
+            if(!value->frozen)
+            {
+                // Made by this patch, it can be changed in place.
+                return;
+            }
+            if(value->type() == JSONType::OBJECT)
+            {
+                const JSONObject &orig = static_cast<const JSONObject &> (*value);
+                std::shared_ptr<JSONObject> copy = std::make_shared<JSONObject>();
+                copy->values = orig.values;
+                for(auto &member : copy->values)
+                {
+                    if(orig.arena != nullptr)
+                    {
+                        member.name.own();
+                    }
+                    member.value = JSONValue::share(member.value);
+                }
+                value = copy;
+                return;
+            }
+            const JSONArray &orig = static_cast<const JSONArray &> (*value);
+            std::shared_ptr<JSONArray> copy = std::make_shared<JSONArray>();
+            copy->values.reserve(orig.values.size() + 1);
+            for(auto &element : orig.values)
+            {
+                copy->values.push_back(JSONValue::share(element));
+            }
+            value = copy;
+        }
+
+        /**
+         * Get the pointer a container holds a child in.
+         * @return The pointer or nullptr if there is no such child.
+         */
+        static std::shared_ptr<JSONValue> *childSlot(JSONValue &parent, const Token &token)
+        {
+            if(parent.type() == JSONType::OBJECT)
+            {
+                const JSONMembers::Member *member = findMember(static_cast<const JSONObject &> (parent), token);
+                return member == nullptr ? nullptr : &const_cast<JSONMembers::Member *> (member)->value;
+            }
+            std::vector<std::shared_ptr<JSONValue>> &values = static_cast<JSONArray &> (parent).values;
+            if(token.index < 0 || (size_t) token.index >= values.size())
+            {
+                return nullptr;
+            }
+            return &values[token.index];
+        }
+
+        static const JSONMembers::Member *findMember(const JSONObject &object, const Token &token)
+        {
+            return JSONPointer::findMember(object, token);
+        }
+
+        /**
+         * Get a name the way objects store it, escaped as it would be in a document.
+         */
+        static JSONText storedName(const Token &token)
+        {
+            return JSONText(token.escaped.empty() ? token.name : token.escaped);
+        }
+
+        static std::shared_ptr<JSONValue> find(const std::shared_ptr<JSONValue> &root, const std::vector<Token> &path)
+        {
+            std::shared_ptr<JSONValue> value = root;
+            for(auto &token : path)
+            {
+                if(!value || (value->type() != JSONType::OBJECT && value->type() != JSONType::ARRAY))
+                {
+                    return nullptr;
+                }
+                std::shared_ptr<JSONValue> *slot = childSlot(*value, token);
+                if(slot == nullptr)
+                {
+                    return nullptr;
+                }
+                value = JSONValue::share(*slot);
+            }
+            return value;
+        }
+
+        static std::string pathText(const std::vector<Token> &path, size_t count)
+        {
+            std::string text;
+            for(size_t i = 0; i < count; i++)
+            {
+                text.push_back('/');
+                for(char c : path[i].name)
+                {
+                    text += c == '~' ? "~0" : c == '/' ? "~1" : std::string(1, c);
+                }
+            }
+            return text;
+        }
+
+        /**
+         * Compare two values the way the test operation does.
+         * Strings are compared unescaped and numbers by value.
+         */
+        static bool equal(const JSONValue *a, const JSONValue *b)
+        {
+            if(a == nullptr || b == nullptr || a->type() != b->type())
+            {
+                return a == b;
+            }
+            switch(a->type())
+            {
+                case JSONType::OBJECT:
+                {
+                    const JSONMembers &am = static_cast<const JSONObject *> (a)->values;
+                    const JSONMembers &bm = static_cast<const JSONObject *> (b)->values;
+                    if(am.size() != bm.size())
+                    {
+                        return false;
+                    }
+                    for(auto &member : am)
+                    {
+                        const JSONMembers::Member *other = bm.find(member.name.data(), member.name.length(), member.hash);
+                        if(other == nullptr || !equal(member.value.get(), other->value.get()))
+                        {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+                case JSONType::ARRAY:
+                {
+                    const std::vector<std::shared_ptr<JSONValue>> &av = static_cast<const JSONArray *> (a)->values;
+                    const std::vector<std::shared_ptr<JSONValue>> &bv = static_cast<const JSONArray *> (b)->values;
+                    if(av.size() != bv.size())
+                    {
+                        return false;
+                    }
+                    for(size_t i = 0; i < av.size(); i++)
+                    {
+                        if(!equal(av[i].get(), bv[i].get()))
+                        {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+                case JSONType::STRING:
+                {
+                    std::string as = static_cast<const JSONString *> (a)->getValue();
+                    std::string bs = static_cast<const JSONString *> (b)->getValue();
+                    std::string ap;
+                    std::string bp;
+                    JSONDocument::unescape(as.data(), as.length(), ap);
+                    JSONDocument::unescape(bs.data(), bs.length(), bp);
+                    return ap == bp;
+                }
+                case JSONType::NUMBER:
+                {
+                    const JSONNumber *an = static_cast<const JSONNumber *> (a);
+                    const JSONNumber *bn = static_cast<const JSONNumber *> (b);
+                    if(!an->isDouble() && !bn->isDouble())
+                    {
+                        return an->getInt() == bn->getInt();
+                    }
+                    return an->getDouble() == bn->getDouble();
+                }
+                case JSONType::BOOL:
+                    return static_cast<const JSONBool *> (a)->get() == static_cast<const JSONBool *> (b)->get();
+                default:
+                    return true;
+            }
+        }
+
+        static std::shared_ptr<JSONValue> mergeValue(std::shared_ptr<JSONValue> target, const JSONValue &patch)
+        {
+            if(patch.type() != JSONType::OBJECT)
+            {
+                return std::shared_ptr<JSONValue>(patch.copy());
+            }
+            if(!target || target->type() != JSONType::OBJECT)
+            {
+                target = std::make_shared<JSONObject>();
+            }
+            else
+            {
+                writable(target);
+            }
+            JSONMembers &values = static_cast<JSONObject &> (*target).values;
+            const JSONObject &changes = static_cast<const JSONObject &> (patch);
+            std::unique_lock<std::mutex> uLock = changes.getLock();
+            for(auto &member : changes.values)
+            {
+                if(!member.value)
+                {
+                    continue;
+                }
+                if(member.value->type() == JSONType::_NULL)
+                {
+                    values.remove(member.name.data(), member.name.length());
+                    continue;
+                }
+                const JSONMembers::Member *found = values.find(member.name.data(), member.name.length(), member.hash);
+                if(found != nullptr)
+                {
+                    std::shared_ptr<JSONValue> &slot = const_cast<JSONMembers::Member *> (found)->value;
+                    slot = mergeValue(slot, *member.value);
+                }
+                else
+                {
+                    values.add(JSONText(member.name.str()), mergeValue(nullptr, *member.value), member.hash);
+                }
+            }
+            return target;
+        }
+    };
+
+}
+
+#endif /* JSONPATCH_H */
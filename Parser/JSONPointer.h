@@ -0,0 +1,429 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JSONPOINTER_H
+#define JSONPOINTER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+
+#include "JSON.h"
+
+namespace KayLib
+{
+
+    /**
+     * A compiled JSON Pointer (RFC 6901) such as "/events/0/payload/id".
+     * The pointer is parsed and every name is hashed once, so the same pointer can
+     * be evaluated against any number of documents without allocating.
+     * When wildcards are enabled a "*" token matches every member of an object
+     * or every element of an array.
+     */
+    class JSONPointer
+    {
+        friend class JSONPatch;
+    public:
+
+        /**
+         * Compile a pointer.
+         * @param pointer The pointer text.  An empty pointer refers to the whole document.
+         * @param nWildcards True to treat "*" tokens as wildcards.
+         */
+        JSONPointer(const std::string &pointer, bool nWildcards = false)
+        {
+            text = pointer;
+            wildcards = false;
+            valid = compile(pointer, nWildcards);
+            if(!valid)
+            {
+                // Drop the tokens read before the error so nothing can match.
+                tokens.clear();
+                wildcards = false;
+            }
+        }
+
+        virtual ~JSONPointer() { }
+
+        /**
+         * Check if the pointer text was valid.
+         * @return True if valid.
+         */
+        bool isValid() const
+        {
+            return valid;
+        }
+
+        /**
+         * Check if the pointer has wildcard tokens.
+         * @return True if it can match more than one value.
+         */
+        bool hasWildcards() const
+        {
+            return wildcards;
+        }
+
+        /**
+         * Get the text the pointer was compiled from.
+         * @return The pointer text.
+         */
+        std::string toString() const
+        {
+            return text;
+        }
+
+        /**
+         * Find the value the pointer refers to.
+         * @param root The value to start from.
+         * @return The value, the first match of a wildcard pointer, or nullptr if there is none.
+         * The value is only valid while the document holding it is not changed.
+         */
+        const JSONValue *find(const JSONValue &root) const
+        {
+            const JSONValue *found = nullptr;
+            forEach(root, [&found](const JSONValue & value)
+            {
+                found = &value;
+                return false;
+            });
+            return found;
+        }
+
+        /**
+         * Get the value the pointer refers to.
+         * @param root The value to start from.
+         * @return The value, the first match of a wildcard pointer, or nullptr if there is
+         * none or the pointer is not valid.
+         */
+        std::shared_ptr<JSONValue> get(const std::shared_ptr<JSONValue> &root) const
+        {
+            if(!root || !valid)
+            {
+                return nullptr;
+            }
+            if(tokens.empty())
+            {
+                return root;
+            }
+            std::shared_ptr<JSONValue> found;
+            step(*root, 0, [&found](const std::shared_ptr<JSONValue> &value)
+            {
+                found = JSONValue::share(value);
+                return false;
+            });
+            return found;
+        }
+
+        /**
+         * Get the value the pointer refers to.
+         * @param doc The document.
+         * @return The value or nullptr if there is none.
+         */
+        std::shared_ptr<JSONValue> get(const JSONDocument &doc) const
+        {
+            return get(doc.getRoot());
+        }
+
+        /**
+         * Find every value a wildcard pointer matches, in document order.
+         * @param root The value to start from.
+         * @param results Receives the matches.  They are only valid while the document is not changed.
+         */
+        void findAll(const JSONValue &root, std::vector<const JSONValue *> &results) const
+        {
+            forEach(root, [&results](const JSONValue & value)
+            {
+                results.push_back(&value);
+                return true;
+            });
+        }
+
+        /**
+         * Call a function for every value the pointer matches, in document order.
+         * No lock is held while the callback runs, so it can read or change the values
+         * on the way to the match.
+         * @param root The value to start from.
+         * @param callback Called as bool(const JSONValue &).  Return false to stop.
+         * @return False if the callback stopped the search.
+         */
+        template<typename Callback>
+        bool forEach(const JSONValue &root, Callback callback) const
+        {
+            if(!valid)
+            {
+                return true;
+            }
+            if(tokens.empty())
+            {
+                return callback(root);
+            }
+            return step(root, 0, [&callback](const std::shared_ptr<JSONValue> &value)
+            {
+                return callback(*value);
+            });
+        }
+
+    private:
+
+        struct Token
+        {
+            // The unescaped name.
+            std::string name;
+            uint64_t hash;
+            // The name escaped as objects store it, empty if it has nothing to escape.
+            std::string escaped;
+            uint64_t escapedHash;
+            // The array index or -1 if the token is not an index.
+            long index;
+            bool wildcard;
+        };
+
+        std::string text;
+        std::vector<Token> tokens;
+        bool wildcards;
+        bool valid;
+
+        bool compile(const std::string &pointer, bool allowWildcards)
+        {
+            if(pointer.empty())
+            {
+                return true;
+            }
+            if(pointer[0] != '/')
+            {
+                return false;
+            }
+            size_t pos = 1;
+            while(true)
+            {
+                size_t end = pointer.find('/', pos);
+                if(end == std::string::npos)
+                {
+                    end = pointer.length();
+                }
+                Token token;
+                for(size_t i = pos; i < end; i++)
+                {
+                    char c = pointer[i];
+                    if(c == '~')
+                    {
+                        // ~0 is '~' and ~1 is '/', anything else is invalid.
+                        if(i + 1 >= end || (pointer[i + 1] != '0' && pointer[i + 1] != '1'))
+                        {
+                            return false;
+                        }
+                        c = pointer[++i] == '0' ? '~' : '/';
+                    }
+                    token.name.push_back(c);
+                }
+                token.hash = JSONMembers::hash(token.name.data(), token.name.length());
+                if(JSONWriter::findEscape(token.name.data(), token.name.length()) < token.name.length())
+                {
+                    JSONWriter::escape(token.name.data(), token.name.length(), token.escaped);
+                }
+                token.escapedHash = JSONMembers::hash(token.escaped.data(), token.escaped.length());
+                token.index = toIndex(token.name);
+                // Only an unescaped '*' is a wildcard.
+                token.wildcard = allowWildcards && end - pos == 1 && pointer[pos] == '*';
+                wildcards = wildcards || token.wildcard;
+                tokens.push_back(token);
+                if(end == pointer.length())
+                {
+                    return true;
+                }
+                pos = end + 1;
+            }
+        }
+
+        /**
+         * Get the array index of a token.
+         * @return The index or -1 if the token is not a valid index.
+         */
+        static long toIndex(const std::string &name)
+        {
+            if(name.empty() || name.length() > 18 || (name[0] == '0' && name.length() > 1))
+            {
+                return -1;
+            }
+            long index = 0;
+            for(char c : name)
+            {
+                if(c < '0' || c > '9')
+                {
+                    return -1;
+                }
+                index = index * 10 + (c - '0');
+            }
+            return index;
+        }
+
+        /**
+         * Find the member a token names.  Objects keep member names as they are
+         * written in the document, escapes included, so names that could have been
+         * escaped are also looked for in their escaped form.
+         * @param object The object, its lock must be held.
+         * @param token The token.
+         * @return The member or nullptr if there is none.
+         */
+        static const JSONMembers::Member *findMember(const JSONObject &object, const Token &token)
+        {
+            const JSONMembers::Member *member = object.values.find(token.name.data(), token.name.length(), token.hash);
+            if(member != nullptr)
+            {
+                return member;
+            }
+            if(!token.escaped.empty())
+            {
+                member = object.values.find(token.escaped.data(), token.escaped.length(), token.escapedHash);
+                if(member != nullptr)
+                {
+                    return member;
+                }
+            }
+            else if(std::find_if(token.name.begin(), token.name.end(), [](char c)
+            {
+                return (unsigned char) c >= 0x80;
+            }) == token.name.end())
+            {
+                // Only names with characters that are not ASCII are looked for as \u escapes.
+                return nullptr;
+            }
+            std::string plain;
+            for(auto &candidate : object.values)
+            {
+                const char *name = candidate.name.data();
+                size_t length = candidate.name.length();
+                if(std::memchr(name, '\\', length) != nullptr)
+                {
+                    plain.clear();
+                    JSONDocument::unescape(name, length, plain);
+                    if(plain == token.name)
+                    {
+                        return &candidate;
+                    }
+                }
+            }
+            return nullptr;
+        }
+
+        /**
+         * Get the child a token names.
+         * @param value The value to look in.
+         * @param token The token, it must not be a wildcard.
+         * @return The child or nullptr if there is none.
+         */
+        static std::shared_ptr<JSONValue> child(const JSONValue &value, const Token &token)
+        {
+            if(value.type() == JSONType::OBJECT)
+            {
+                const JSONObject &object = static_cast<const JSONObject &> (value);
+                std::unique_lock<std::mutex> uLock = object.getLock();
+                const JSONMembers::Member *member = findMember(object, token);
+                return member != nullptr ? member->value : nullptr;
+            }
+            if(value.type() == JSONType::ARRAY)
+            {
+                const JSONArray &array = static_cast<const JSONArray &> (value);
+                std::unique_lock<std::mutex> uLock = array.getLock();
+                if(token.index >= 0 && (size_t) token.index < array.values.size())
+                {
+                    return array.values[token.index];
+                }
+            }
+            return nullptr;
+        }
+
+        /**
+         * Get a child by position, for wildcards.
+         * @param value The value to look in.
+         * @param i The position of the member or element.
+         * @param out Set to the child.
+         * @return False if there is no child at the position.
+         */
+        static bool childAt(const JSONValue &value, size_t i, std::shared_ptr<JSONValue> &out)
+        {
+            if(value.type() == JSONType::OBJECT)
+            {
+                const JSONObject &object = static_cast<const JSONObject &> (value);
+                std::unique_lock<std::mutex> uLock = object.getLock();
+                if(i >= object.values.size())
+                {
+                    return false;
+                }
+                out = (object.values.begin() + i)->value;
+                return true;
+            }
+            if(value.type() == JSONType::ARRAY)
+            {
+                const JSONArray &array = static_cast<const JSONArray &> (value);
+                std::unique_lock<std::mutex> uLock = array.getLock();
+                if(i >= array.values.size())
+                {
+                    return false;
+                }
+                out = array.values[i];
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * Follow the tokens from a value.  Each child is taken while its parent is
+         * locked and followed after the lock is released.
+         * @param value The value reached by the tokens before 'pos'.
+         * @param pos The token to follow.
+         * @param callback Called as bool(const std::shared_ptr<JSONValue> &) for each match of the last token.
+         * @return False if the callback stopped the search.
+         */
+        template<typename Callback>
+        bool step(const JSONValue &value, size_t pos, const Callback &callback) const
+        {
+            const Token &token = tokens[pos];
+            if(!token.wildcard)
+            {
+                return visit(child(value, token), pos, callback);
+            }
+            std::shared_ptr<JSONValue> next;
+            for(size_t i = 0; childAt(value, i, next); i++)
+            {
+                if(!visit(next, pos, callback))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        template<typename Callback>
+        bool visit(const std::shared_ptr<JSONValue> &child, size_t pos, const Callback &callback) const
+        {
+            if(!child)
+            {
+                return true;
+            }
+            if(pos + 1 == tokens.size())
+            {
+                return callback(child);
+            }
+            return step(*child, pos + 1, callback);
+        }
+    };
+
+}
+
+#endif /* JSONPOINTER_H */
@@ -0,0 +1,692 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JSONREADER_H
+#define JSONREADER_H
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <unistd.h>
+
+#include "JSON.h"
+
+namespace KayLib
+{
+
+    /**
+     * Receives the events of a JSONReader.
+     * Every method returns true to continue reading or false to stop.
+     * @note Strings and names are passed as they appear in the document, escape
+     * sequences are not decoded.  The text is only valid during the call.
+     */
+    class JSONHandler
+    {
+    public:
+
+        virtual ~JSONHandler() { }
+
+        virtual bool startObject()
+        {
+            return true;
+        }
+
+        virtual bool endObject()
+        {
+            return true;
+        }
+
+        virtual bool startArray()
+        {
+            return true;
+        }
+
+        virtual bool endArray()
+        {
+            return true;
+        }
+
+        virtual bool key(const char * /*str*/, size_t /*length*/)
+        {
+            return true;
+        }
+
+        virtual bool string(const char * /*str*/, size_t /*length*/)
+        {
+            return true;
+        }
+
+        virtual bool number(long /*value*/)
+        {
+            return true;
+        }
+
+        virtual bool number(double /*value*/)
+        {
+            return true;
+        }
+
+        virtual bool boolean(bool /*value*/)
+        {
+            return true;
+        }
+
+        virtual bool null()
+        {
+            return true;
+        }
+
+        /**
+         * Called when a top level value is complete.
+         */
+        virtual bool endDocument()
+        {
+            return true;
+        }
+    };
+
+    /**
+     * An incremental, event driven JSON reader.
+     * Input is fed in chunks of any size and memory use only depends on the
+     * longest token and the deepest nesting, not on the size of the document.
+     * Errors have the same codes and offsets as JSONDocument, except that
+     * JSONDocument ignores anything after the top level value and accepts an
+     * unterminated top level string, while the reader reports both.
+     */
+    class JSONReader
+    {
+    public:
+
+        JSONReader(JSONHandler &nHandler) : handler(nHandler)
+        {
+            maxTokenLength = 64 * 1024 * 1024;
+            maxDepth = 64 * 1024;
+            multipleDocuments = false;
+            reset();
+        }
+
+        virtual ~JSONReader() { }
+
+        /**
+         * Allow more than one top level value, such as newline delimited JSON.
+         * @param multiple True to allow more than one value.
+         */
+        void setMultipleDocuments(bool multiple)
+        {
+            multipleDocuments = multiple;
+        }
+
+        /**
+         * Set the limits that keep the memory use of the reader bounded.
+         * @param nMaxTokenLength The longest string, name or number allowed.
+         * @param nMaxDepth The deepest nesting of objects and arrays allowed.
+         */
+        void setLimits(size_t nMaxTokenLength, size_t nMaxDepth)
+        {
+            maxTokenLength = nMaxTokenLength;
+            maxDepth = nMaxDepth;
+        }
+
+        /**
+         * Reset the reader so it can read a new document.
+         */
+        void reset()
+        {
+            state = State::VALUE;
+            stack.clear();
+            token.clear();
+            inToken = Token::NONE;
+            escape = false;
+            offset = 0;
+            tokenStart = 0;
+            stopped = false;
+            resetError();
+        }
+
+        /**
+         * Read the next chunk of the document.
+         * @param data The chunk.
+         * @param length The length of the chunk.
+         * @return False if there was an error or the handler stopped the reader.
+         */
+        bool feed(const char *data, size_t length)
+        {
+            if(lastError != JSONError::NONE || stopped)
+            {
+                return false;
+            }
+            size_t i = 0;
+            // Where the part of the current token in this chunk starts.
+            size_t from = 0;
+            while(i < length)
+            {
+                if(inToken == Token::STRING)
+                {
+                    size_t end = findStringEnd(data, length, i);
+                    if(end == length)
+                    {
+                        i = length;
+                        break;
+                    }
+                    if(!endString(data + from, end - from))
+                    {
+                        return false;
+                    }
+                    i = end + 1;
+                    continue;
+                }
+                if(inToken == Token::SCALAR)
+                {
+                    size_t end = i;
+                    while(end < length && !isDelimiter(data[end]))
+                    {
+                        end++;
+                    }
+                    if(end == length)
+                    {
+                        i = length;
+                        break;
+                    }
+                    if(!endScalar(data + from, end - from))
+                    {
+                        return false;
+                    }
+                    i = end;
+                    continue;
+                }
+                char c = data[i];
+                switch(c)
+                {
+                    case ' ':
+                    case '\t':
+                    case '\r':
+                    case '\n':
+                        i++;
+                        continue;
+                    case '\"':
+                        if(state != State::OBJECT_KEY_OR_END && state != State::OBJECT_KEY && !isValueState())
+                        {
+                            return unexpected(offset + i);
+                        }
+                        inToken = Token::STRING;
+                        tokenStart = offset + i;
+                        i++;
+                        from = i;
+                        continue;
+                    case '{':
+                    case '}':
+                    case '[':
+                    case ']':
+                    case ':':
+                    case ',':
+                        if(!structural(c, offset + i))
+                        {
+                            return false;
+                        }
+                        i++;
+                        continue;
+                    default:
+                        inToken = Token::SCALAR;
+                        tokenStart = offset + i;
+                        from = i;
+                        continue;
+                }
+            }
+            if(inToken != Token::NONE)
+            {
+                // Keep the part of the token we have until the next chunk.
+                if(token.length() + (length - from) > maxTokenLength)
+                {
+                    return setError(JSONError::LimitExceeded, tokenStart);
+                }
+                token.append(data + from, length - from);
+            }
+            offset += length;
+            return true;
+        }
+
+        /**
+         * Signal the end of the input.
+         * @return False if the document was incomplete or invalid.
+         */
+        bool finish()
+        {
+            if(lastError != JSONError::NONE || stopped)
+            {
+                return false;
+            }
+            if(inToken == Token::SCALAR)
+            {
+                if(!endScalar(nullptr, 0))
+                {
+                    return false;
+                }
+            }
+            if(inToken == Token::STRING || !stack.empty() || (state != State::DONE && !(multipleDocuments && state == State::VALUE)))
+            {
+                // Reported like JSONDocument, which expects a name or a character at the end.
+                if(inToken != Token::STRING && (state == State::OBJECT_KEY_OR_END || state == State::OBJECT_KEY))
+                {
+                    return setError(JSONError::InvalidObjectName, offset);
+                }
+                return setError(JSONError::InvalidSyntax, offset);
+            }
+            return true;
+        }
+
+        /**
+         * Read a document from a stream until the end of the stream.
+         * @param in The stream.
+         * @param chunkSize The number of bytes to read at a time.
+         * @return False if there was an error or the handler stopped the reader.
+         */
+        bool read(std::istream &in, size_t chunkSize = 64 * 1024)
+        {
+            std::vector<char> buffer(chunkSize);
+            while(in)
+            {
+                in.read(buffer.data(), chunkSize);
+                std::streamsize got = in.gcount();
+                if(got > 0 && !feed(buffer.data(), got))
+                {
+                    return false;
+                }
+            }
+            return finish();
+        }
+
+        /**
+         * Read a document from a file descriptor until the end of the file.
+         * @param fd The file descriptor.
+         * @param chunkSize The number of bytes to read at a time.
+         * @return False if there was an error or the handler stopped the reader.
+         */
+        bool read(int fd, size_t chunkSize = 64 * 1024)
+        {
+            std::vector<char> buffer(chunkSize);
+            while(true)
+            {
+                ssize_t got = ::read(fd, buffer.data(), chunkSize);
+                if(got < 0)
+                {
+                    if(errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return setError(JSONError::UnexpectedEndOfDocument, offset);
+                }
+                if(got == 0)
+                {
+                    break;
+                }
+                if(!feed(buffer.data(), got))
+                {
+                    return false;
+                }
+            }
+            return finish();
+        }
+
+        /**
+         * Did the handler stop the reader?
+         * @return True if stopped.
+         */
+        bool isStopped() const
+        {
+            return stopped;
+        }
+
+        /**
+         * Get the last error code.
+         * @return The error code.
+         */
+        JSONError getError() const
+        {
+            return lastError;
+        }
+
+        /**
+         * Get the offset in the input of the last error.
+         * @return The offset of the error.
+         */
+        long getErrorIndex() const
+        {
+            return errorIndex;
+        }
+
+        /**
+         * Reset the error code.
+         */
+        void resetError()
+        {
+            lastError = JSONError::NONE;
+            errorIndex = -1;
+        }
+
+    private:
+
+        enum class State
+        {
+            // A value is expected.
+            VALUE,
+            // After '{'.
+            OBJECT_KEY_OR_END,
+            // After ',' in an object.
+            OBJECT_KEY,
+            // After a name.
+            COLON,
+            // After a value in an object.
+            OBJECT_COMMA_OR_END,
+            // After '['.
+            ARRAY_VALUE_OR_END,
+            // After a value in an array.
+            ARRAY_COMMA_OR_END,
+            // The top level value is complete.
+            DONE
+        };
+
+        enum class Token
+        {
+            NONE, STRING, SCALAR
+        };
+
+        JSONHandler &handler;
+        State state;
+        // The open objects '{' and arrays '['.
+        std::vector<char> stack;
+        // The start of a token that was split between chunks.
+        std::string token;
+        Token inToken;
+        bool escape;
+        // The input offset of the current chunk.
+        long offset;
+        long tokenStart;
+        bool stopped;
+        bool multipleDocuments;
+        size_t maxTokenLength;
+        size_t maxDepth;
+        JSONError lastError;
+        long errorIndex;
+
+        bool setError(JSONError error, long index)
+        {
+            lastError = error;
+            errorIndex = index;
+            return false;
+        }
+
+        bool check(bool keepGoing)
+        {
+            if(!keepGoing)
+            {
+                stopped = true;
+            }
+            return keepGoing;
+        }
+
+        static bool isDelimiter(char c)
+        {
+            switch(c)
+            {
+                case ' ':
+                case '\t':
+                case '\r':
+                case '\n':
+                case ',':
+                case ':':
+                case '{':
+                case '}':
+                case '[':
+                case ']':
+                case '\"':
+                    return true;
+            }
+            return false;
+        }
+
+        /**
+         * Find the closing quote of the current string.
+         * @return The index of the quote or 'length' if it is not in this chunk.
+         */
+        size_t findStringEnd(const char *data, size_t length, size_t i)
+        {
+            for(; i < length; i++)
+            {
+                char c = data[i];
+                if(escape)
+                {
+                    escape = false;
+                }
+                else if(c == '\\')
+                {
+                    escape = true;
+                }
+                else if(c == '\"')
+                {
+                    return i;
+                }
+            }
+            return length;
+        }
+
+        /**
+         * Get the complete text of a token that ends in the current chunk.
+         */
+        void tokenText(const char *&str, size_t &length)
+        {
+            if(!token.empty())
+            {
+                token.append(str, length);
+                str = token.data();
+                length = token.length();
+            }
+        }
+
+        bool isValueState() const
+        {
+            return state == State::VALUE || state == State::ARRAY_VALUE_OR_END ||
+                    (state == State::DONE && multipleDocuments);
+        }
+
+        /**
+         * Update the state after a complete value.
+         */
+        bool endValue()
+        {
+            if(stack.empty())
+            {
+                state = State::DONE;
+                return check(handler.endDocument());
+            }
+            state = stack.back() == '{' ? State::OBJECT_COMMA_OR_END : State::ARRAY_COMMA_OR_END;
+            return true;
+        }
+
+        bool endString(const char *str, size_t length)
+        {
+            inToken = Token::NONE;
+            if(token.length() + length > maxTokenLength)
+            {
+                return setError(JSONError::LimitExceeded, tokenStart);
+            }
+            tokenText(str, length);
+            bool keepGoing;
+            if(state == State::OBJECT_KEY_OR_END || state == State::OBJECT_KEY)
+            {
+                state = State::COLON;
+                keepGoing = check(handler.key(str, length));
+            }
+            else
+            {
+                // The state was checked at the opening quote.
+                keepGoing = check(handler.string(str, length)) && endValue();
+            }
+            token.clear();
+            return keepGoing;
+        }
+
+        bool endScalar(const char *str, size_t length)
+        {
+            inToken = Token::NONE;
+            if(token.length() + length > maxTokenLength)
+            {
+                return setError(JSONError::LimitExceeded, tokenStart);
+            }
+            tokenText(str, length);
+            if(!isValueState())
+            {
+                return unexpected(tokenStart);
+            }
+            bool keepGoing;
+            if(length == 4 && std::memcmp(str, "true", 4) == 0)
+            {
+                keepGoing = check(handler.boolean(true));
+            }
+            else if(length == 5 && std::memcmp(str, "false", 5) == 0)
+            {
+                keepGoing = check(handler.boolean(false));
+            }
+            else if(length == 4 && std::memcmp(str, "null", 4) == 0)
+            {
+                keepGoing = check(handler.null());
+            }
+            else if(str[0] == '-' || KString::digit(str[0]) != -1)
+            {
+                const char *p = str;
+                long lValue;
+                double dValue;
+                bool isDouble = JSONNumber::parseText(p, str + length, lValue, dValue);
+                if(p != str + length)
+                {
+                    return trailing(p - str);
+                }
+                keepGoing = check(isDouble ? handler.number(dValue) : handler.number(lValue));
+            }
+            else if(length > 4 && (std::memcmp(str, "true", 4) == 0 || std::memcmp(str, "null", 4) == 0))
+            {
+                return trailing(4);
+            }
+            else if(length > 5 && std::memcmp(str, "false", 5) == 0)
+            {
+                return trailing(5);
+            }
+            else
+            {
+                return setError(JSONError::InvalidSyntax, tokenStart);
+            }
+            token.clear();
+            return keepGoing && endValue();
+        }
+
+        bool structural(char c, long index)
+        {
+            switch(c)
+            {
+                case '{':
+                case '[':
+                    if(!isValueState())
+                    {
+                        return unexpected(index);
+                    }
+                    if(stack.size() >= maxDepth)
+                    {
+                        return setError(JSONError::LimitExceeded, index);
+                    }
+                    stack.push_back(c);
+                    if(c == '{')
+                    {
+                        state = State::OBJECT_KEY_OR_END;
+                        return check(handler.startObject());
+                    }
+                    state = State::ARRAY_VALUE_OR_END;
+                    return check(handler.startArray());
+                case '}':
+                    if(state != State::OBJECT_KEY_OR_END && state != State::OBJECT_COMMA_OR_END)
+                    {
+                        return unexpected(index);
+                    }
+                    stack.pop_back();
+                    return check(handler.endObject()) && endValue();
+                case ']':
+                    if(state != State::ARRAY_VALUE_OR_END && state != State::ARRAY_COMMA_OR_END)
+                    {
+                        return unexpected(index);
+                    }
+                    stack.pop_back();
+                    return check(handler.endArray()) && endValue();
+                case ':':
+                    if(state != State::COLON)
+                    {
+                        return unexpected(index);
+                    }
+                    state = State::VALUE;
+                    return true;
+                case ',':
+                    if(state == State::OBJECT_COMMA_OR_END)
+                    {
+                        state = State::OBJECT_KEY;
+                        return true;
+                    }
+                    if(state == State::ARRAY_COMMA_OR_END)
+                    {
+                        state = State::VALUE;
+                        return true;
+                    }
+                    return unexpected(index);
+            }
+            return unexpected(index);
+        }
+
+        /**
+         * Report a token that is not allowed in the current state where
+         * JSONDocument does.  It reads the character after a name or value
+         * before checking it, so those errors are one past the character.
+         * @param index The position of the token.
+         * @return False.
+         */
+        bool unexpected(long index)
+        {
+            switch(state)
+            {
+                case State::OBJECT_KEY_OR_END:
+                case State::OBJECT_KEY:
+                    return setError(JSONError::InvalidObjectName, index);
+                case State::COLON:
+                case State::OBJECT_COMMA_OR_END:
+                case State::ARRAY_COMMA_OR_END:
+                    return setError(JSONError::InvalidSyntax, index + 1);
+                default:
+                    return setError(JSONError::InvalidSyntax, index);
+            }
+        }
+
+        /**
+         * Report a scalar that only starts with a valid value.  JSONDocument
+         * reads the value and then fails on the character after it.
+         * @param used The length of the valid value.
+         * @return False.
+         */
+        bool trailing(size_t used)
+        {
+            return setError(JSONError::InvalidSyntax, tokenStart + (long) used + 1);
+        }
+
+    };
+
+}
+
+#endif /* JSONREADER_H */
@@ -0,0 +1,1539 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JSONSCHEMA_H
+#define JSONSCHEMA_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <regex>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "JSON.h"
+#include "JSONReader.h"
+#include "JSONWriter.h"
+
+namespace KayLib
+{
+
+    /**
+     * A value that does not follow a schema.
+     */
+    struct JSONSchemaError
+    {
+        // A JSON Pointer to the value, "" for the whole document.
+        std::string path;
+        // The keyword that failed, such as "type" or "required".
+        std::string keyword;
+        std::string message;
+    };
+
+    /**
+     * A JSON Schema compiled for validating documents.
+     * The draft-07 keywords type, enum, properties, required, additionalProperties,
+     * items, additionalItems, minimum, maximum, exclusiveMinimum, exclusiveMaximum,
+     * minLength, maxLength, minItems, maxItems, minProperties, maxProperties and
+     * pattern are supported.  Other keywords are ignored.
+     * Names are hashed and patterns are compiled once, so validating does not
+     * allocate unless a value fails or an enum has to be compared.
+     * A schema can be shared by any number of threads once it is compiled.
+     * @note Validating locks each value like any other reader.  Documents parsed
+     * with JSONParseOptions::FROZEN are validated without locking.
+     */
+    class JSONSchema
+    {
+        friend class JSONSchemaValidator;
+    public:
+
+        /**
+         * Compile a schema.
+         * @param schema The schema, an object or a boolean.
+         */
+        JSONSchema(const JSONValue &schema)
+        {
+            compile(&schema);
+        }
+
+        /**
+         * Compile a schema.
+         * @param schema The schema document.
+         */
+        JSONSchema(const JSONDocument &schema)
+        {
+            if(schema.getError() != JSONError::NONE)
+            {
+                error = "The schema is not valid JSON.";
+                return;
+            }
+            compile(schema.getRoot().get());
+        }
+
+        /**
+         * Compile a schema.
+         * @param schema The schema text.
+         */
+        JSONSchema(const std::string &schema) : JSONSchema(JSONDocument(schema)) { }
+
+        virtual ~JSONSchema() { }
+
+        /**
+         * Check if the schema compiled.
+         * @return True if valid.
+         */
+        bool isValid() const
+        {
+            return error.empty();
+        }
+
+        /**
+         * Get the reason the schema did not compile.
+         * @return The error or an empty string.
+         */
+        std::string getError() const
+        {
+            return error;
+        }
+
+        /**
+         * Validate a value.
+         * @param value The value.
+         * @param errors Receives every failure, or nullptr to stop at the first one.
+         * @return True if the value follows the schema.  Invalid schemas accept nothing.
+         */
+        bool validate(const JSONValue &value, std::vector<JSONSchemaError> *errors = nullptr) const
+        {
+            TreePath path = {nullptr, nullptr, 0, 0};
+            if(!error.empty())
+            {
+                return fail(errors, path, "", "The schema is not valid.");
+            }
+            return root < 0 || validateValue(root, value, path, errors);
+        }
+
+        /**
+         * Validate a document.
+         * @param doc The document.
+         * @param errors Receives every failure, or nullptr to stop at the first one.
+         * @return True if the document follows the schema.
+         */
+        bool validate(const JSONDocument &doc, std::vector<JSONSchemaError> *errors = nullptr) const
+        {
+            std::shared_ptr<JSONValue> value = doc.getRoot();
+            if(!value)
+            {
+                TreePath path = {nullptr, nullptr, 0, 0};
+                return fail(errors, path, "", "The document has no value.");
+            }
+            return validate(*value, errors);
+        }
+
+    private:
+        static const size_t MAX_DEPTH = 1024;
+
+        static const unsigned TYPE_NULL = 1;
+        static const unsigned TYPE_BOOLEAN = 2;
+        static const unsigned TYPE_OBJECT = 4;
+        static const unsigned TYPE_ARRAY = 8;
+        static const unsigned TYPE_NUMBER = 16;
+        static const unsigned TYPE_INTEGER = 32;
+        static const unsigned TYPE_STRING = 64;
+
+        struct Property
+        {
+            // The unescaped name.
+            std::string name;
+            uint64_t hash;
+            // The schema of the value or -1 for any value.
+            int node;
+            // The position in the required list or -1 if not required.
+            int required;
+        };
+
+        struct Node
+        {
+            // Set by a false schema, no value is allowed.
+            bool reject;
+            // The allowed types or 0 for any type.
+            unsigned types;
+            // The canonical text of each enum value.
+            std::vector<std::string> enumValues;
+            // The unescaped enum values that are strings, compared without building canonical text.
+            std::vector<std::string> enumStrings;
+            double minimum;
+            double maximum;
+            double exclusiveMinimum;
+            double exclusiveMaximum;
+            size_t minLength;
+            size_t maxLength;
+            std::shared_ptr<std::regex> pattern;
+            std::string patternText;
+            size_t minItems;
+            size_t maxItems;
+            // The schema of every item, or of the items after 'tupleItems'.
+            int items;
+            std::vector<int> tupleItems;
+            size_t minProperties;
+            size_t maxProperties;
+            // Sorted by hash.
+            std::vector<Property> properties;
+            size_t requiredCount;
+            int additionalProperties;
+
+            Node()
+            {
+                reject = false;
+                types = 0;
+                minimum = -std::numeric_limits<double>::infinity();
+                maximum = std::numeric_limits<double>::infinity();
+                exclusiveMinimum = minimum;
+                exclusiveMaximum = maximum;
+                minLength = 0;
+                maxLength = std::numeric_limits<size_t>::max();
+                minItems = 0;
+                maxItems = std::numeric_limits<size_t>::max();
+                items = -1;
+                minProperties = 0;
+                maxProperties = std::numeric_limits<size_t>::max();
+                requiredCount = 0;
+                additionalProperties = -1;
+            }
+
+            bool checksText() const
+            {
+                return pattern || minLength > 0 || maxLength != std::numeric_limits<size_t>::max();
+            }
+        };
+
+        /**
+         * The location of a value in a document, kept on the stack and only
+         * turned into text when a value fails.
+         */
+        struct TreePath
+        {
+            const TreePath *parent;
+            // The name as it is stored in the object, or nullptr for an array index.
+            const char *name;
+            size_t length;
+            size_t index;
+
+            void build(std::string &out) const
+            {
+                if(parent == nullptr)
+                {
+                    return;
+                }
+                parent->build(out);
+                if(name != nullptr)
+                {
+                    appendToken(name, length, out);
+                }
+                else
+                {
+                    out += "/" + std::to_string(index);
+                }
+            }
+        };
+
+        std::vector<Node> nodes;
+        // The schema of the document or -1 for any value.
+        int root;
+        std::string error;
+
+        //
+        // Compiling
+        //
+
+        void compile(const JSONValue *schema)
+        {
+            root = -1;
+            if(schema == nullptr)
+            {
+                error = "The schema has no value.";
+                return;
+            }
+            root = compileNode(*schema, 0);
+            if(!error.empty())
+            {
+                nodes.clear();
+                root = -1;
+            }
+        }
+
+        /**
+         * Compile a schema and the schemas inside it.
+         * @param schema The schema.
+         * @param depth The nesting of the schema.
+         * @return The node or -1 if the schema accepts any value.
+         */
+        int compileNode(const JSONValue &schema, size_t depth)
+        {
+            if(depth > MAX_DEPTH)
+            {
+                return setError("The schema is nested too deeply.");
+            }
+            if(schema.type() == JSONType::BOOL)
+            {
+                if(static_cast<const JSONBool &> (schema).get())
+                {
+                    return -1;
+                }
+                nodes.push_back(Node());
+                nodes.back().reject = true;
+                return nodes.size() - 1;
+            }
+            if(schema.type() != JSONType::OBJECT)
+            {
+                return setError("A schema must be an object or a boolean.");
+            }
+            const JSONObject &object = static_cast<const JSONObject &> (schema);
+            // Reserve the node first so children are numbered after their parent.
+            int index = nodes.size();
+            nodes.push_back(Node());
+            Node node;
+            bool empty = true;
+            for(const std::string &stored : object.getValueNames())
+            {
+                std::shared_ptr<JSONValue> value = object.getValue(stored);
+                std::string name = decode(stored);
+                if(!value)
+                {
+                    continue;
+                }
+                bool known = true;
+                if(name == "type")
+                {
+                    compileType(*value, node);
+                }
+                else if(name == "enum")
+                {
+                    if(value->type() != JSONType::ARRAY)
+                    {
+                        return setError("enum must be an array.");
+                    }
+                    for(auto &option : static_cast<const JSONArray &> (*value).getArray())
+                    {
+                        std::string text;
+                        JSONWriter writer(text);
+                        canonical(option.get(), writer);
+                        node.enumValues.push_back(text);
+                        if(option && option->type() == JSONType::STRING)
+                        {
+                            node.enumStrings.push_back(decode(static_cast<const JSONString &> (*option).getValue()));
+                        }
+                    }
+                }
+                else if(name == "minimum")
+                {
+                    node.minimum = toNumber(*value, name);
+                }
+                else if(name == "maximum")
+                {
+                    node.maximum = toNumber(*value, name);
+                }
+                else if(name == "exclusiveMinimum")
+                {
+                    node.exclusiveMinimum = toNumber(*value, name);
+                }
+                else if(name == "exclusiveMaximum")
+                {
+                    node.exclusiveMaximum = toNumber(*value, name);
+                }
+                else if(name == "minLength")
+                {
+                    node.minLength = toCount(*value, name);
+                }
+                else if(name == "maxLength")
+                {
+                    node.maxLength = toCount(*value, name);
+                }
+                else if(name == "minItems")
+                {
+                    node.minItems = toCount(*value, name);
+                }
+                else if(name == "maxItems")
+                {
+                    node.maxItems = toCount(*value, name);
+                }
+                else if(name == "minProperties")
+                {
+                    node.minProperties = toCount(*value, name);
+                }
+                else if(name == "maxProperties")
+                {
+                    node.maxProperties = toCount(*value, name);
+                }
+                else if(name == "pattern")
+                {
+                    compilePattern(*value, node);
+                }
+                else if(name == "properties")
+                {
+                    compileProperties(*value, node, depth);
+                }
+                else if(name == "required")
+                {
+                    compileRequired(*value, node);
+                }
+                else if(name == "additionalProperties")
+                {
+                    node.additionalProperties = compileNode(*value, depth + 1);
+                }
+                else if(name == "items")
+                {
+                    if(value->type() == JSONType::ARRAY)
+                    {
+                        for(auto &item : static_cast<const JSONArray &> (*value).getArray())
+                        {
+                            node.tupleItems.push_back(item ? compileNode(*item, depth + 1) : -1);
+                        }
+                    }
+                    else
+                    {
+                        node.items = compileNode(*value, depth + 1);
+                    }
+                }
+                else
+                {
+                    // Unsupported keywords are ignored.
+                    known = false;
+                }
+                empty = empty && !known;
+                if(!error.empty())
+                {
+                    return -1;
+                }
+            }
+            // additionalItems only applies when items is an array.
+            std::shared_ptr<JSONValue> additional = object.getValue("additionalItems");
+            if(additional && !node.tupleItems.empty())
+            {
+                node.items = compileNode(*additional, depth + 1);
+                if(!error.empty())
+                {
+                    return -1;
+                }
+            }
+            if(empty)
+            {
+                // An empty schema accepts any value.
+                nodes.pop_back();
+                return -1;
+            }
+            std::sort(node.properties.begin(), node.properties.end(), [](const Property &a, const Property & b)
+            {
+                return a.hash < b.hash;
+            });
+            nodes[index] = std::move(node);
+            return index;
+        }
+
+        int setError(const std::string &message)
+        {
+            if(error.empty())
+            {
+                error = message;
+            }
+            return -1;
+        }
+
+        void compileType(const JSONValue &value, Node &node)
+        {
+            if(value.type() == JSONType::STRING)
+            {
+                node.types |= toType(static_cast<const JSONString &> (value).getValue());
+                return;
+            }
+            if(value.type() != JSONType::ARRAY)
+            {
+                setError("type must be a string or an array of strings.");
+                return;
+            }
+            for(auto &type : static_cast<const JSONArray &> (value).getArray())
+            {
+                if(!type || type->type() != JSONType::STRING)
+                {
+                    setError("type must be a string or an array of strings.");
+                    return;
+                }
+                node.types |= toType(static_cast<const JSONString &> (*type).getValue());
+            }
+        }
+
+        unsigned toType(const std::string &name)
+        {
+            static const char *names[] = {"null", "boolean", "object", "array", "number", "integer", "string"};
+            for(unsigned i = 0; i < 7; i++)
+            {
+                if(name == names[i])
+                {
+                    return 1u << i;
+                }
+            }
+            setError("Unknown type \"" + name + "\".");
+            return 0;
+        }
+
+        double toNumber(const JSONValue &value, const std::string &name)
+        {
+            if(value.type() != JSONType::NUMBER)
+            {
+                setError(name + " must be a number.");
+                return 0;
+            }
+            return static_cast<const JSONNumber &> (value).getDouble();
+        }
+
+        size_t toCount(const JSONValue &value, const std::string &name)
+        {
+            double count = toNumber(value, name);
+            if(count < 0 || count != std::floor(count))
+            {
+                setError(name + " must be a non-negative integer.");
+                return 0;
+            }
+            return count >= (double) std::numeric_limits<size_t>::max() ? std::numeric_limits<size_t>::max() : (size_t) count;
+        }
+
+        void compilePattern(const JSONValue &value, Node &node)
+        {
+            if(value.type() != JSONType::STRING)
+            {
+                setError("pattern must be a string.");
+                return;
+            }
+            node.patternText = decode(static_cast<const JSONString &> (value).getValue());
+            try
+            {
+                node.pattern = std::make_shared<std::regex>(node.patternText, std::regex::ECMAScript | std::regex::optimize);
+            }
+            catch(const std::regex_error &)
+            {
+                setError("The pattern \"" + node.patternText + "\" is not valid.");
+            }
+        }
+
+        void compileProperties(const JSONValue &value, Node &node, size_t depth)
+        {
+            if(value.type() != JSONType::OBJECT)
+            {
+                setError("properties must be an object.");
+                return;
+            }
+            const JSONObject &object = static_cast<const JSONObject &> (value);
+            for(const std::string &stored : object.getValueNames())
+            {
+                std::shared_ptr<JSONValue> schema = object.getValue(stored);
+                Property &property = addProperty(node, decode(stored));
+                property.node = schema ? compileNode(*schema, depth + 1) : -1;
+            }
+        }
+
+        void compileRequired(const JSONValue &value, Node &node)
+        {
+            if(value.type() != JSONType::ARRAY)
+            {
+                setError("required must be an array of strings.");
+                return;
+            }
+            for(auto &name : static_cast<const JSONArray &> (value).getArray())
+            {
+                if(!name || name->type() != JSONType::STRING)
+                {
+                    setError("required must be an array of strings.");
+                    return;
+                }
+                Property &property = addProperty(node, decode(static_cast<const JSONString &> (*name).getValue()));
+                if(property.required < 0)
+                {
+                    property.required = node.requiredCount++;
+                }
+            }
+        }
+
+        static Property &addProperty(Node &node, const std::string &name)
+        {
+            for(auto &property : node.properties)
+            {
+                if(property.name == name)
+                {
+                    return property;
+                }
+            }
+            Property property;
+            property.name = name;
+            property.hash = JSONMembers::hash(name.data(), name.length());
+            property.node = -1;
+            property.required = -1;
+            node.properties.push_back(property);
+            return node.properties.back();
+        }
+
+        //
+        // Checks shared by the tree and stream validators
+        //
+
+        /**
+         * Find the property a member name belongs to.
+         * @param node The schema of the object.
+         * @param name The unescaped name.
+         * @param length The length of the name.
+         * @param hash The hash of the name.
+         * @return The property or nullptr if the name is not a property.
+         */
+        static const Property *findProperty(const Node &node, const char *name, size_t length, uint64_t hash)
+        {
+            auto it = std::lower_bound(node.properties.begin(), node.properties.end(), hash, [](const Property &p, uint64_t h)
+            {
+                return p.hash < h;
+            });
+            for(; it != node.properties.end() && it->hash == hash; ++it)
+            {
+                if(it->name.length() == length && std::memcmp(it->name.data(), name, length) == 0)
+                {
+                    return &*it;
+                }
+            }
+            return nullptr;
+        }
+
+        /**
+         * Find the property of an escaped member name.
+         */
+        static const Property *findEscapedProperty(const Node &node, const char *name, size_t length)
+        {
+            if(std::memchr(name, '\\', length) == nullptr)
+            {
+                return findProperty(node, name, length, JSONMembers::hash(name, length));
+            }
+            std::string plain;
+            JSONDocument::unescape(name, length, plain);
+            return findProperty(node, plain.data(), plain.length(), JSONMembers::hash(plain.data(), plain.length()));
+        }
+
+        template<typename Path>
+        static bool fail(std::vector<JSONSchemaError> *errors, const Path &path, const char *keyword, const std::string &message)
+        {
+            if(errors != nullptr)
+            {
+                JSONSchemaError failure;
+                path.build(failure.path);
+                failure.keyword = keyword;
+                failure.message = message;
+                errors->push_back(failure);
+            }
+            return false;
+        }
+
+        /**
+         * Check the type of a value and that the schema allows a value at all.
+         * @param types The type of the value, TYPE_INTEGER is included for integral numbers.
+         */
+        template<typename Path>
+        static bool checkType(const Node &node, unsigned types, const Path &path, std::vector<JSONSchemaError> *errors)
+        {
+            if(node.reject)
+            {
+                return fail(errors, path, "false", "No value is allowed.");
+            }
+            if(node.types != 0 && (node.types & types) == 0)
+            {
+                return fail(errors, path, "type", "Expected " + typeNames(node.types) + ".");
+            }
+            return true;
+        }
+
+        static std::string typeNames(unsigned types)
+        {
+            static const char *names[] = {"null", "boolean", "object", "array", "number", "integer", "string"};
+            std::string text;
+            for(unsigned i = 0; i < 7; i++)
+            {
+                if(types & (1u << i))
+                {
+                    text += text.empty() ? names[i] : std::string(" or ") + names[i];
+                }
+            }
+            return text;
+        }
+
+        template<typename Path>
+        static bool checkEnum(const Node &node, const std::string &canonicalValue, const Path &path, std::vector<JSONSchemaError> *errors)
+        {
+            for(auto &option : node.enumValues)
+            {
+                if(option == canonicalValue)
+                {
+                    return true;
+                }
+            }
+            return fail(errors, path, "enum", "The value is not one of the allowed values.");
+        }
+
+        /**
+         * Check a string against an enum.
+         * @param str The string as it appears in the document.
+         * @param length The length of the string.
+         */
+        template<typename Path>
+        static bool checkStringEnum(const Node &node, const char *str, size_t length, const Path &path, std::vector<JSONSchemaError> *errors)
+        {
+            std::string plain;
+            if(std::memchr(str, '\\', length) != nullptr)
+            {
+                JSONDocument::unescape(str, length, plain);
+                str = plain.data();
+                length = plain.length();
+            }
+            for(auto &option : node.enumStrings)
+            {
+                if(option.length() == length && std::memcmp(option.data(), str, length) == 0)
+                {
+                    return true;
+                }
+            }
+            return fail(errors, path, "enum", "The value is not one of the allowed values.");
+        }
+
+        template<typename Path>
+        static bool checkNumber(const Node &node, double value, const Path &path, std::vector<JSONSchemaError> *errors)
+        {
+            bool ok = true;
+            if(value < node.minimum)
+            {
+                ok = fail(errors, path, "minimum", "The value is less than " + numberText(node.minimum) + ".");
+            }
+            if(value > node.maximum && (ok || errors != nullptr))
+            {
+                ok = fail(errors, path, "maximum", "The value is greater than " + numberText(node.maximum) + ".");
+            }
+            if(value <= node.exclusiveMinimum && (ok || errors != nullptr))
+            {
+                ok = fail(errors, path, "exclusiveMinimum", "The value must be greater than " + numberText(node.exclusiveMinimum) + ".");
+            }
+            if(value >= node.exclusiveMaximum && (ok || errors != nullptr))
+            {
+                ok = fail(errors, path, "exclusiveMaximum", "The value must be less than " + numberText(node.exclusiveMaximum) + ".");
+            }
+            return ok;
+        }
+
+        /**
+         * Check the length and pattern of a string.
+         * @param str The string as it appears in the document.
+         * @param length The length of the string.
+         */
+        template<typename Path>
+        static bool checkString(const Node &node, const char *str, size_t length, const Path &path, std::vector<JSONSchemaError> *errors)
+        {
+            std::string plain;
+            if(std::memchr(str, '\\', length) != nullptr)
+            {
+                JSONDocument::unescape(str, length, plain);
+                str = plain.data();
+                length = plain.length();
+            }
+            bool ok = true;
+            if(node.minLength > 0 || node.maxLength != std::numeric_limits<size_t>::max())
+            {
+                // Lengths are counted in characters, not bytes.
+                size_t characters = 0;
+                for(size_t i = 0; i < length; i++)
+                {
+                    characters += (str[i] & 0xC0) != 0x80 ? 1 : 0;
+                }
+                if(characters < node.minLength)
+                {
+                    ok = fail(errors, path, "minLength", "The string is shorter than " + std::to_string(node.minLength) + " characters.");
+                }
+                if(characters > node.maxLength && (ok || errors != nullptr))
+                {
+                    ok = fail(errors, path, "maxLength", "The string is longer than " + std::to_string(node.maxLength) + " characters.");
+                }
+            }
+            if(node.pattern && (ok || errors != nullptr) && !std::regex_search(str, str + length, *node.pattern))
+            {
+                ok = fail(errors, path, "pattern", "The string does not match \"" + node.patternText + "\".");
+            }
+            return ok;
+        }
+
+        template<typename Path>
+        static bool checkSize(size_t count, size_t minimum, size_t maximum, const char *minKeyword, const char *maxKeyword, const char *what,
+                const Path &path, std::vector<JSONSchemaError> *errors)
+        {
+            if(count < minimum)
+            {
+                return fail(errors, path, minKeyword, "There are fewer than " + std::to_string(minimum) + " " + what + ".");
+            }
+            if(count > maximum)
+            {
+                return fail(errors, path, maxKeyword, "There are more than " + std::to_string(maximum) + " " + what + ".");
+            }
+            return true;
+        }
+
+        template<typename Path>
+        static bool missingRequired(const Property &property, const Path &path, std::vector<JSONSchemaError> *errors)
+        {
+            return fail(errors, path, "required", "The property \"" + property.name + "\" is missing.");
+        }
+
+        static std::string numberText(double value)
+        {
+            char buf[32];
+            return std::string(buf, KNumber::format(value, buf));
+        }
+
+        static bool isIntegral(double value)
+        {
+            return value == std::floor(value) && std::isfinite(value);
+        }
+
+        //
+        // Validating values
+        //
+
+        bool validateValue(int index, const JSONValue &value, const TreePath &path, std::vector<JSONSchemaError> *errors) const
+        {
+            const Node &node = nodes[index];
+            switch(value.type())
+            {
+                case JSONType::OBJECT:
+                    if(!checkType(node, TYPE_OBJECT, path, errors))
+                    {
+                        return false;
+                    }
+                    return checkValueEnum(node, value, path, errors) &
+                            validateObject(node, static_cast<const JSONObject &> (value), path, errors);
+                case JSONType::ARRAY:
+                    if(!checkType(node, TYPE_ARRAY, path, errors))
+                    {
+                        return false;
+                    }
+                    return checkValueEnum(node, value, path, errors) &
+                            validateArray(node, static_cast<const JSONArray &> (value), path, errors);
+                case JSONType::STRING:
+                {
+                    if(!checkType(node, TYPE_STRING, path, errors))
+                    {
+                        return false;
+                    }
+                    if(node.enumValues.empty() && !node.checksText())
+                    {
+                        return true;
+                    }
+                    const JSONString &str = static_cast<const JSONString &> (value);
+                    std::unique_lock<std::mutex> uLock = str.getLock();
+                    if(!node.enumValues.empty() && !checkStringEnum(node, str.value.data(), str.value.length(), path, errors))
+                    {
+                        return false;
+                    }
+                    return !node.checksText() || checkString(node, str.value.data(), str.value.length(), path, errors);
+                }
+                case JSONType::NUMBER:
+                {
+                    const JSONNumber &number = static_cast<const JSONNumber &> (value);
+                    double d;
+                    {
+                        std::unique_lock<std::mutex> uLock = number.getLock();
+                        d = number._isDouble ? number.dNumber : (double) number.lNumber;
+                    }
+                    unsigned types = isIntegral(d) ? TYPE_NUMBER | TYPE_INTEGER : TYPE_NUMBER;
+                    if(!checkType(node, types, path, errors) || !checkValueEnum(node, value, path, errors))
+                    {
+                        return false;
+                    }
+                    return checkNumber(node, d, path, errors);
+                }
+                case JSONType::BOOL:
+                    return checkType(node, TYPE_BOOLEAN, path, errors) && checkValueEnum(node, value, path, errors);
+                default:
+                    return checkType(node, TYPE_NULL, path, errors) && checkValueEnum(node, value, path, errors);
+            }
+        }
+
+        bool checkValueEnum(const Node &node, const JSONValue &value, const TreePath &path, std::vector<JSONSchemaError> *errors) const
+        {
+            if(node.enumValues.empty())
+            {
+                return true;
+            }
+            std::string text;
+            JSONWriter writer(text);
+            canonical(&value, writer);
+            return checkEnum(node, text, path, errors);
+        }
+
+        bool validateObject(const Node &node, const JSONObject &object, const TreePath &path, std::vector<JSONSchemaError> *errors) const
+        {
+            std::unique_lock<std::mutex> uLock = object.getLock();
+            const JSONMembers &members = object.values;
+            bool ok = checkSize(members.size(), node.minProperties, node.maxProperties, "minProperties", "maxProperties", "properties", path, errors);
+            if(!ok && errors == nullptr)
+            {
+                return false;
+            }
+            if(node.properties.empty() && node.additionalProperties < 0)
+            {
+                return ok;
+            }
+            size_t required = 0;
+            for(auto &member : members)
+            {
+                const char *name = member.name.data();
+                size_t length = member.name.length();
+                const Property *property = std::memchr(name, '\\', length) == nullptr ?
+                        findProperty(node, name, length, member.hash) : findEscapedProperty(node, name, length);
+                int child = node.additionalProperties;
+                if(property != nullptr)
+                {
+                    child = property->node;
+                    required += property->required >= 0 ? 1 : 0;
+                }
+                if(child >= 0 && member.value)
+                {
+                    TreePath childPath = {&path, name, length, 0};
+                    if(!validateValue(child, *member.value, childPath, errors))
+                    {
+                        ok = false;
+                        if(errors == nullptr)
+                        {
+                            return false;
+                        }
+                    }
+                }
+            }
+            if(required < node.requiredCount)
+            {
+                ok = false;
+                for(auto &property : node.properties)
+                {
+                    if(property.required >= 0 && members.find(property.name.data(), property.name.length(), property.hash) == nullptr)
+                    {
+                        missingRequired(property, path, errors);
+                    }
+                }
+            }
+            return ok;
+        }
+
+        bool validateArray(const Node &node, const JSONArray &array, const TreePath &path, std::vector<JSONSchemaError> *errors) const
+        {
+            std::unique_lock<std::mutex> uLock = array.getLock();
+            bool ok = checkSize(array.values.size(), node.minItems, node.maxItems, "minItems", "maxItems", "items", path, errors);
+            if(!ok && errors == nullptr)
+            {
+                return false;
+            }
+            for(size_t i = 0; i < array.values.size(); i++)
+            {
+                int child = i < node.tupleItems.size() ? node.tupleItems[i] : node.items;
+                if(child < 0)
+                {
+                    if(i >= node.tupleItems.size())
+                    {
+                        break;
+                    }
+                    continue;
+                }
+                if(array.values[i])
+                {
+                    TreePath childPath = {&path, nullptr, 0, i};
+                    if(!validateValue(child, *array.values[i], childPath, errors))
+                    {
+                        ok = false;
+                        if(errors == nullptr)
+                        {
+                            return false;
+                        }
+                    }
+                }
+            }
+            return ok;
+        }
+
+        //
+        // Text helpers
+        //
+
+        static std::string decode(const std::string &str)
+        {
+            if(str.find('\\') == std::string::npos)
+            {
+                return str;
+            }
+            std::string plain;
+            JSONDocument::unescape(str.data(), str.length(), plain);
+            return plain;
+        }
+
+        /**
+         * Add a name to a JSON Pointer.
+         * @param name The name as it appears in the document.
+         * @param length The length of the name.
+         * @param out The pointer to add to.
+         */
+        static void appendToken(const char *name, size_t length, std::string &out)
+        {
+            std::string plain;
+            JSONDocument::unescape(name, length, plain);
+            out.push_back('/');
+            for(char c : plain)
+            {
+                if(c == '~')
+                {
+                    out += "~0";
+                }
+                else if(c == '/')
+                {
+                    out += "~1";
+                }
+                else
+                {
+                    out.push_back(c);
+                }
+            }
+        }
+
+        /**
+         * Write the text enum values are compared by.  Strings are unescaped,
+         * integral numbers are written without a fraction and the members of
+         * objects are sorted by name.
+         * @param value The value.
+         * @param writer The writer.
+         */
+        static void canonical(const JSONValue *value, JSONWriter &writer)
+        {
+            if(value == nullptr)
+            {
+                writer.null();
+                return;
+            }
+            switch(value->type())
+            {
+                case JSONType::OBJECT:
+                {
+                    const JSONObject &object = static_cast<const JSONObject &> (*value);
+                    std::vector<std::pair<std::string, const JSONValue *>> members;
+                    std::unique_lock<std::mutex> uLock = object.getLock();
+                    for(auto &member : object.values)
+                    {
+                        members.push_back(std::make_pair(decode(member.name.str()), member.value.get()));
+                    }
+                    std::sort(members.begin(), members.end());
+                    writer.startObject();
+                    for(auto &member : members)
+                    {
+                        writer.key(member.first);
+                        canonical(member.second, writer);
+                    }
+                    writer.endObject();
+                    return;
+                }
+                case JSONType::ARRAY:
+                {
+                    const JSONArray &array = static_cast<const JSONArray &> (*value);
+                    std::unique_lock<std::mutex> uLock = array.getLock();
+                    writer.startArray();
+                    for(auto &element : array.values)
+                    {
+                        canonical(element.get(), writer);
+                    }
+                    writer.endArray();
+                    return;
+                }
+                case JSONType::STRING:
+                {
+                    const JSONString &str = static_cast<const JSONString &> (*value);
+                    std::unique_lock<std::mutex> uLock = str.getLock();
+                    canonicalString(str.value.data(), str.value.length(), writer);
+                    return;
+                }
+                case JSONType::NUMBER:
+                {
+                    const JSONNumber &number = static_cast<const JSONNumber &> (*value);
+                    if(number.isDouble())
+                    {
+                        canonicalNumber(number.getDouble(), writer);
+                    }
+                    else
+                    {
+                        writer.number(number.getInt());
+                    }
+                    return;
+                }
+                case JSONType::BOOL:
+                    writer.boolean(static_cast<const JSONBool &> (*value).get());
+                    return;
+                default:
+                    writer.null();
+                    return;
+            }
+        }
+
+        static void canonicalString(const char *str, size_t length, JSONWriter &writer)
+        {
+            if(std::memchr(str, '\\', length) == nullptr)
+            {
+                writer.string(str, length);
+                return;
+            }
+            std::string plain;
+            JSONDocument::unescape(str, length, plain);
+            writer.string(plain);
+        }
+
+        static void canonicalNumber(double value, JSONWriter &writer)
+        {
+            if(isIntegral(value) && std::fabs(value) < 9.2e18)
+            {
+                writer.number((long) value);
+            }
+            else
+            {
+                writer.number(value);
+            }
+        }
+    };
+
+    /**
+     * Validates a document against a JSONSchema while a JSONReader reads it,
+     * without building the document.
+     * Events can be passed on to another handler, so a document can be
+     * validated and processed in one pass.
+     * @note Enums of objects and arrays keep a copy of the value until it ends.
+     */
+    class JSONSchemaValidator : public JSONHandler
+    {
+    public:
+
+        /**
+         * Create a validator.
+         * @param nSchema The schema.  It must outlive the validator.
+         * @param nAllErrors True to find every failure, false to stop reading at the first one.
+         * @param nNext The handler to pass the events on to, or nullptr.
+         */
+        JSONSchemaValidator(const JSONSchema &nSchema, bool nAllErrors = true, JSONHandler *nNext = nullptr) :
+        schema(nSchema), capture(captured)
+        {
+            allErrors = nAllErrors;
+            next = nNext;
+            reset();
+        }
+
+        virtual ~JSONSchemaValidator() { }
+
+        /**
+         * Forget the errors and any unfinished document.
+         */
+        void reset()
+        {
+            errors.clear();
+            depth = 0;
+            capturing = 0;
+            captured.clear();
+            capture.reset();
+            if(!schema.isValid())
+            {
+                JSONSchema::fail(&errors, StreamPath{this, 0}, "", "The schema is not valid.");
+            }
+        }
+
+        /**
+         * Check if every document read so far follows the schema.
+         * @return True if valid.
+         */
+        bool isValid() const
+        {
+            return errors.empty();
+        }
+
+        /**
+         * Get the failures found so far.
+         * @return The failures.
+         */
+        const std::vector<JSONSchemaError> &getErrors() const
+        {
+            return errors;
+        }
+
+        virtual bool startObject() override
+        {
+            int node = startValue();
+            if(node >= 0 && !JSONSchema::checkType(schema.nodes[node], JSONSchema::TYPE_OBJECT, StreamPath{this, depth}, &errors))
+            {
+                // The members of a value of the wrong type are not checked.
+                node = -1;
+            }
+            push(node, true);
+            if(capturing > 0)
+            {
+                capture.startObject();
+                frames[depth - 1].capture = captured.length() - 1;
+            }
+            return proceed() && (next == nullptr || next->startObject());
+        }
+
+        virtual bool endObject() override
+        {
+            Frame &frame = frames[depth - 1];
+            if(frame.node >= 0)
+            {
+                const JSONSchema::Node &node = schema.nodes[frame.node];
+                StreamPath path = {this, depth - 1};
+                JSONSchema::checkSize(frame.count, node.minProperties, node.maxProperties, "minProperties", "maxProperties", "properties", path, &errors);
+                if(frame.required < node.requiredCount)
+                {
+                    for(auto &property : node.properties)
+                    {
+                        if(property.required >= 0 && !frame.seen[property.required])
+                        {
+                            JSONSchema::missingRequired(property, path, &errors);
+                        }
+                    }
+                }
+            }
+            if(capturing > 0)
+            {
+                capture.endObject();
+            }
+            pop();
+            return proceed() && (next == nullptr || next->endObject());
+        }
+
+        virtual bool startArray() override
+        {
+            int node = startValue();
+            if(node >= 0 && !JSONSchema::checkType(schema.nodes[node], JSONSchema::TYPE_ARRAY, StreamPath{this, depth}, &errors))
+            {
+                node = -1;
+            }
+            push(node, false);
+            if(capturing > 0)
+            {
+                capture.startArray();
+                frames[depth - 1].capture = captured.length() - 1;
+            }
+            return proceed() && (next == nullptr || next->startArray());
+        }
+
+        virtual bool endArray() override
+        {
+            Frame &frame = frames[depth - 1];
+            if(frame.node >= 0)
+            {
+                const JSONSchema::Node &node = schema.nodes[frame.node];
+                JSONSchema::checkSize(frame.count, node.minItems, node.maxItems, "minItems", "maxItems", "items", StreamPath{this, depth - 1}, &errors);
+            }
+            if(capturing > 0)
+            {
+                capture.endArray();
+            }
+            pop();
+            return proceed() && (next == nullptr || next->endArray());
+        }
+
+        virtual bool key(const char *str, size_t length) override
+        {
+            Frame &frame = frames[depth - 1];
+            frame.count++;
+            frame.key.assign(str, length);
+            frame.child = -1;
+            if(frame.node >= 0)
+            {
+                const JSONSchema::Node &node = schema.nodes[frame.node];
+                const JSONSchema::Property *property = JSONSchema::findEscapedProperty(node, str, length);
+                frame.child = node.additionalProperties;
+                if(property != nullptr)
+                {
+                    frame.child = property->node;
+                    if(property->required >= 0 && !frame.seen[property->required])
+                    {
+                        frame.seen[property->required] = true;
+                        frame.required++;
+                    }
+                }
+            }
+            if(capturing > 0)
+            {
+                capture.escapedKey(str, length);
+            }
+            return next == nullptr || next->key(str, length);
+        }
+
+        virtual bool string(const char *str, size_t length) override
+        {
+            int node = startValue();
+            if(node >= 0)
+            {
+                const JSONSchema::Node &schemaNode = schema.nodes[node];
+                StreamPath path = {this, depth};
+                if(JSONSchema::checkType(schemaNode, JSONSchema::TYPE_STRING, path, &errors) &&
+                        (schemaNode.enumValues.empty() || JSONSchema::checkStringEnum(schemaNode, str, length, path, &errors)) &&
+                        schemaNode.checksText())
+                {
+                    JSONSchema::checkString(schemaNode, str, length, path, &errors);
+                }
+            }
+            if(capturing > 0)
+            {
+                capture.escapedString(str, length);
+            }
+            return proceed() && (next == nullptr || next->string(str, length));
+        }
+
+        virtual bool number(long value) override
+        {
+            checkNumber((double) value, [value](JSONWriter & writer)
+            {
+                writer.number(value);
+            });
+            if(capturing > 0)
+            {
+                capture.number(value);
+            }
+            return proceed() && (next == nullptr || next->number(value));
+        }
+
+        virtual bool number(double value) override
+        {
+            checkNumber(value, [value](JSONWriter & writer)
+            {
+                JSONSchema::canonicalNumber(value, writer);
+            });
+            if(capturing > 0)
+            {
+                capture.number(value);
+            }
+            return proceed() && (next == nullptr || next->number(value));
+        }
+
+        virtual bool boolean(bool value) override
+        {
+            int node = startValue();
+            if(node >= 0)
+            {
+                StreamPath path = {this, depth};
+                if(JSONSchema::checkType(schema.nodes[node], JSONSchema::TYPE_BOOLEAN, path, &errors))
+                {
+                    checkScalarEnum(schema.nodes[node], path, [value](JSONWriter & writer)
+                    {
+                        writer.boolean(value);
+                    });
+                }
+            }
+            if(capturing > 0)
+            {
+                capture.boolean(value);
+            }
+            return proceed() && (next == nullptr || next->boolean(value));
+        }
+
+        virtual bool null() override
+        {
+            int node = startValue();
+            if(node >= 0)
+            {
+                StreamPath path = {this, depth};
+                if(JSONSchema::checkType(schema.nodes[node], JSONSchema::TYPE_NULL, path, &errors))
+                {
+                    checkScalarEnum(schema.nodes[node], path, [](JSONWriter & writer)
+                    {
+                        writer.null();
+                    });
+                }
+            }
+            if(capturing > 0)
+            {
+                capture.null();
+            }
+            return proceed() && (next == nullptr || next->null());
+        }
+
+        virtual bool endDocument() override
+        {
+            depth = 0;
+            return next == nullptr || next->endDocument();
+        }
+
+    private:
+
+        struct Frame
+        {
+            // The schema of the object or array, or -1 if it is not checked.
+            int node;
+            bool object;
+            // The number of members or items so far.
+            size_t count;
+            // The name of the current member as it appears in the document.
+            std::string key;
+            // The schema of the current member.
+            int child;
+            // The required properties that have been seen.
+            std::vector<bool> seen;
+            size_t required;
+            // Where the value starts in the captured text, or npos.
+            size_t capture;
+        };
+
+        /**
+         * The location of the value at a depth, only turned into text when a value fails.
+         */
+        struct StreamPath
+        {
+            const JSONSchemaValidator *validator;
+            size_t depth;
+
+            void build(std::string &out) const
+            {
+                for(size_t i = 0; i < depth; i++)
+                {
+                    const Frame &frame = validator->frames[i];
+                    if(frame.object)
+                    {
+                        JSONSchema::appendToken(frame.key.data(), frame.key.length(), out);
+                    }
+                    else
+                    {
+                        out += "/" + std::to_string(frame.count - 1);
+                    }
+                }
+            }
+        };
+
+        const JSONSchema &schema;
+        bool allErrors;
+        JSONHandler *next;
+        std::vector<JSONSchemaError> errors;
+        // Frames are kept when popped so their buffers are reused.
+        std::vector<Frame> frames;
+        size_t depth;
+        // The text of the objects and arrays being compared to an enum.
+        std::string captured;
+        JSONWriter capture;
+        size_t capturing;
+
+        bool proceed() const
+        {
+            return allErrors || errors.empty();
+        }
+
+        /**
+         * Find the schema of the value that is starting.
+         * @return The node or -1 if the value is not checked.
+         */
+        int startValue()
+        {
+            if(depth == 0)
+            {
+                return schema.root;
+            }
+            Frame &frame = frames[depth - 1];
+            if(frame.object)
+            {
+                return frame.child;
+            }
+            size_t index = frame.count++;
+            if(frame.node < 0)
+            {
+                return -1;
+            }
+            const JSONSchema::Node &node = schema.nodes[frame.node];
+            return index < node.tupleItems.size() ? node.tupleItems[index] : node.items;
+        }
+
+        void push(int node, bool object)
+        {
+            if(depth == frames.size())
+            {
+                frames.push_back(Frame());
+            }
+            Frame &frame = frames[depth++];
+            frame.node = node;
+            frame.object = object;
+            frame.count = 0;
+            frame.child = -1;
+            frame.required = 0;
+            frame.capture = std::string::npos;
+            if(node >= 0)
+            {
+                const JSONSchema::Node &schemaNode = schema.nodes[node];
+                frame.seen.assign(schemaNode.requiredCount, false);
+                if(!schemaNode.enumValues.empty())
+                {
+                    // The value is compared to the enum when it ends.
+                    capturing++;
+                }
+            }
+        }
+
+        void pop()
+        {
+            Frame &frame = frames[--depth];
+            if(frame.node >= 0 && !schema.nodes[frame.node].enumValues.empty())
+            {
+                JSONDocument doc(captured.substr(frame.capture));
+                std::string text;
+                JSONWriter writer(text);
+                JSONSchema::canonical(doc.getRoot().get(), writer);
+                JSONSchema::checkEnum(schema.nodes[frame.node], text, StreamPath{this, depth}, &errors);
+                capturing--;
+            }
+            if(capturing == 0)
+            {
+                captured.clear();
+                capture.reset();
+            }
+        }
+
+        template<typename Write>
+        bool checkScalarEnum(const JSONSchema::Node &node, const StreamPath &path, Write write)
+        {
+            if(node.enumValues.empty())
+            {
+                return true;
+            }
+            std::string text;
+            JSONWriter writer(text);
+            write(writer);
+            return JSONSchema::checkEnum(node, text, path, &errors);
+        }
+
+        template<typename Write>
+        void checkNumber(double value, Write write)
+        {
+            int node = startValue();
+            if(node < 0)
+            {
+                return;
+            }
+            const JSONSchema::Node &schemaNode = schema.nodes[node];
+            StreamPath path = {this, depth};
+            unsigned types = JSONSchema::isIntegral(value) ? JSONSchema::TYPE_NUMBER | JSONSchema::TYPE_INTEGER : JSONSchema::TYPE_NUMBER;
+            if(JSONSchema::checkType(schemaNode, types, path, &errors) && checkScalarEnum(schemaNode, path, write))
+            {
+                JSONSchema::checkNumber(schemaNode, value, path, &errors);
+            }
+        }
+    };
+
+}
+
+#endif /* JSONSCHEMA_H */
@@ -0,0 +1,419 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../String/KNumber.h"
+#include "../Utility/KSimd.h"
+
+namespace KayLib
+{
+
+    /**
+     * Writes JSON text to the end of a buffer owned by the caller.
+     * Clearing the buffer between documents keeps its capacity, so a writer
+     * that is reused does not allocate once the buffer is large enough.
+     * Separators and indentation are added automatically.
+     */
+    class JSONWriter
+    {
+    public:
+
+        /**
+         * Create a writer.
+         * @param nBuffer The buffer to append to.
+         * @param nPretty True to put every member and element on its own line.
+         * @param nIndent The indentation of each level when pretty.
+         */
+        JSONWriter(std::string &nBuffer, bool nPretty = false, const std::string &nIndent = "  ") : buffer(nBuffer)
+        {
+            pretty = nPretty;
+            indent = nIndent;
+            afterKey = false;
+        }
+
+        virtual ~JSONWriter() { }
+
+        /**
+         * Forget any unfinished objects or arrays.  The buffer is not changed.
+         */
+        void reset()
+        {
+            first.clear();
+            afterKey = false;
+        }
+
+        void startObject()
+        {
+            separate();
+            buffer.push_back('{');
+            first.push_back(true);
+        }
+
+        void endObject()
+        {
+            close('}');
+        }
+
+        void startArray()
+        {
+            separate();
+            buffer.push_back('[');
+            first.push_back(true);
+        }
+
+        void endArray()
+        {
+            close(']');
+        }
+
+        /**
+         * Write the name of an object member.
+         * @param name The name.  It is escaped as needed.
+         * @param length The length of the name.
+         */
+        void key(const char *name, size_t length)
+        {
+            separate();
+            buffer.push_back('"');
+            escape(name, length, buffer);
+            endKey();
+        }
+
+        void key(const std::string &name)
+        {
+            key(name.data(), name.length());
+        }
+
+        /**
+         * Write the name of an object member that is already escaped.
+         * @param name The escaped name.
+         * @param length The length of the name.
+         */
+        void escapedKey(const char *name, size_t length)
+        {
+            separate();
+            buffer.push_back('"');
+            buffer.append(name, length);
+            endKey();
+        }
+
+        /**
+         * Write a string.
+         * @param str The string.  It is escaped as needed.
+         * @param length The length of the string.
+         */
+        void string(const char *str, size_t length)
+        {
+            separate();
+            buffer.push_back('"');
+            escape(str, length, buffer);
+            buffer.push_back('"');
+        }
+
+        void string(const std::string &str)
+        {
+            string(str.data(), str.length());
+        }
+
+        /**
+         * Write a string that is already escaped.
+         * @param str The escaped string.
+         * @param length The length of the string.
+         */
+        void escapedString(const char *str, size_t length)
+        {
+            separate();
+            buffer.push_back('"');
+            buffer.append(str, length);
+            buffer.push_back('"');
+        }
+
+        void number(long value)
+        {
+            separate();
+            char buf[32];
+            buffer.append(buf, KNumber::format(value, buf));
+        }
+
+        void number(int value)
+        {
+            number((long) value);
+        }
+
+        /**
+         * Write an unsigned integer exactly, even above LONG_MAX.
+         * @param value The value.
+         */
+        void number(unsigned long value)
+        {
+            separate();
+            char buf[32];
+            buffer.append(buf, KNumber::format(value, buf));
+        }
+
+        /**
+         * Write a double with the fewest digits that read back to the same value.
+         * @param value The value.
+         */
+        void number(double value)
+        {
+            separate();
+            char buf[32];
+            buffer.append(buf, KNumber::format(value, buf));
+        }
+
+        void boolean(bool value)
+        {
+            separate();
+            if(value)
+            {
+                buffer.append("true", 4);
+            }
+            else
+            {
+                buffer.append("false", 5);
+            }
+        }
+
+        void null()
+        {
+            separate();
+            buffer.append("null", 4);
+        }
+
+        /**
+         * Append text, escaping quotes, backslashes and control characters.
+         * @param str The text.
+         * @param length The length of the text.
+         * @param out The string to append to.
+         */
+        static void escape(const char *str, size_t length, std::string &out)
+        {
+            static const char hex[] = "0123456789ABCDEF";
+            size_t pos = 0;
+            while(pos < length)
+            {
+                size_t clean = findEscape(str + pos, length - pos);
+                out.append(str + pos, clean);
+                pos += clean;
+                if(pos == length)
+                {
+                    break;
+                }
+                unsigned char c = (unsigned char) str[pos++];
+                out.push_back('\\');
+                switch(c)
+                {
+                    case '"':
+                    case '\\':
+                        out.push_back((char) c);
+                        break;
+                    case '\b':
+                        out.push_back('b');
+                        break;
+                    case '\f':
+                        out.push_back('f');
+                        break;
+                    case '\n':
+                        out.push_back('n');
+                        break;
+                    case '\r':
+                        out.push_back('r');
+                        break;
+                    case '\t':
+                        out.push_back('t');
+                        break;
+                    default:
+                        out.append("u00", 3);
+                        out.push_back(hex[c >> 4]);
+                        out.push_back(hex[c & 0xF]);
+                        break;
+                }
+            }
+        }
+
+        /**
+         * Find the first character that has to be escaped.
+         * @param str The text.
+         * @param length The length of the text.
+         * @return Its offset, or the length if there is none.
+         */
+        static size_t findEscape(const char *str, size_t length)
+        {
+            size_t pos = 0;
+#ifdef KAYLIB_SIMD_X86
+            KSimd::Level level = KSimd::level();
+            if(level == KSimd::Level::AVX2)
+            {
+                pos = findEscapeAVX2(str, length);
+            }
+            else if(level == KSimd::Level::SSE2)
+            {
+                pos = findEscapeSSE2(str, length);
+            }
+#endif
+            while(pos < length && !needsEscape(str[pos]))
+            {
+                pos++;
+            }
+            return pos;
+        }
+
+        /**
+         * Get the buffer being written to.
+         * @return The buffer.
+         */
+        std::string &getBuffer()
+        {
+            return buffer;
+        }
+
+    private:
+        std::string &buffer;
+        bool pretty;
+        std::string indent;
+        // One entry for each open object or array, true until it has a value.
+        std::vector<bool> first;
+        bool afterKey;
+
+        /**
+         * Write the separator before a value or member name.
+         */
+        void separate()
+        {
+            if(afterKey)
+            {
+                // Member values follow their names.
+                afterKey = false;
+                return;
+            }
+            if(first.empty())
+            {
+                return;
+            }
+            if(!first.back())
+            {
+                buffer.push_back(',');
+            }
+            first.back() = false;
+            if(pretty)
+            {
+                newLine(first.size());
+            }
+        }
+
+        void endKey()
+        {
+            if(pretty)
+            {
+                buffer.append("\" : ", 4);
+            }
+            else
+            {
+                buffer.append("\":", 2);
+            }
+            afterKey = true;
+        }
+
+        void close(char c)
+        {
+            if(first.empty())
+            {
+                return;
+            }
+            bool empty = first.back();
+            first.pop_back();
+            if(pretty && !empty)
+            {
+                newLine(first.size());
+            }
+            buffer.push_back(c);
+        }
+
+        void newLine(size_t depth)
+        {
+            buffer.push_back('\n');
+            for(size_t i = 0; i < depth; i++)
+            {
+                buffer.append(indent);
+            }
+        }
+
+        static bool needsEscape(char c)
+        {
+            return c == '"' || c == '\\' || (unsigned char) c < 0x20;
+        }
+
+#ifdef KAYLIB_SIMD_X86
+
+        /**
+         * Scan whole blocks of 16 characters.
+         * @return The offset of the first character to escape or of the first unscanned block.
+         */
+        static size_t findEscapeSSE2(const char *str, size_t length)
+        {
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i control = _mm_set1_epi8(0x1F);
+            size_t pos = 0;
+            for(; pos + 16 <= length; pos += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *> (str + pos));
+                // Unsigned v <= 0x1F when the maximum of the two is 0x1F.
+                __m128i ctl = _mm_cmpeq_epi8(_mm_max_epu8(v, control), control);
+                __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)), ctl);
+                int mask = _mm_movemask_epi8(hit);
+                if(mask != 0)
+                {
+                    return pos + KSimd::trailingZeros((uint64_t) mask);
+                }
+            }
+            return pos;
+        }
+
+        __attribute__((target("avx2")))
+        static size_t findEscapeAVX2(const char *str, size_t length)
+        {
+            const __m256i quote = _mm256_set1_epi8('"');
+            const __m256i backslash = _mm256_set1_epi8('\\');
+            const __m256i control = _mm256_set1_epi8(0x1F);
+            size_t pos = 0;
+            for(; pos + 32 <= length; pos += 32)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *> (str + pos));
+                __m256i ctl = _mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control);
+                __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)), ctl);
+                uint32_t mask = (uint32_t) _mm256_movemask_epi8(hit);
+                if(mask != 0)
+                {
+                    return pos + KSimd::trailingZeros(mask);
+                }
+            }
+            return pos;
+        }
+#endif
+
+    };
+
+}
+
+#endif /* JSONWRITER_H */
@@ -0,0 +1,568 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NDJSONREADER_H
+#define NDJSONREADER_H
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#include "JSON.h"
+
+namespace KayLib
+{
+
+    /**
+     * Receives the records of a NDJSONReader.
+     */
+    class NDJSONHandler
+    {
+    public:
+
+        virtual ~NDJSONHandler() { }
+
+        /**
+         * Receive a record.
+         * Records are always received on the thread that called NDJSONReader::read().
+         * @param doc The record.  Check doc.getError() for records that could not be parsed.
+         * @param offset The offset of the record in the input.
+         * @return True to continue reading or false to stop.
+         */
+        virtual bool record(JSONDocument &doc, size_t offset) = 0;
+    };
+
+    /**
+     * Reads newline delimited JSON, parsing the records on a pool of worker threads.
+     * The input is split into batches of whole lines that are parsed in parallel.
+     * Only a limited number of batches are in memory at once, so input of any size
+     * can be read.  Blank lines are skipped.
+     */
+    class NDJSONReader
+    {
+    public:
+
+        /**
+         * Create a reader.
+         * @param nHandler Receives the records.
+         * @param nThreads The number of worker threads, 0 for one per core.
+         */
+        NDJSONReader(NDJSONHandler &nHandler, unsigned int nThreads = 0) : handler(nHandler)
+        {
+            threads = nThreads;
+            if(threads == 0)
+            {
+                threads = std::thread::hardware_concurrency();
+            }
+            if(threads == 0)
+            {
+                threads = 1;
+            }
+            ordered = true;
+            options = JSONParseOptions::NONE;
+            batchSize = 32 * 1024;
+            maxPending = 4 * threads;
+            maxRecordLength = 64 * 1024 * 1024;
+            resetError();
+        }
+
+        virtual ~NDJSONReader() { }
+
+        /**
+         * Set whether records are received in input order.
+         * @param nOrdered False to receive each batch of records as soon as it is parsed.
+         */
+        void setOrdered(bool nOrdered)
+        {
+            ordered = nOrdered;
+        }
+
+        /**
+         * Set the options records are parsed with.
+         * @param nOptions The parser options.  JSONParseOptions::STRING_VIEWS is ignored.
+         */
+        void setOptions(JSONParseOptions nOptions)
+        {
+            options = nOptions;
+        }
+
+        /**
+         * Set the limits that keep the memory use of the reader bounded.
+         * @param nBatchSize The number of bytes of input parsed by a worker at a time.
+         * @param nMaxPending The most batches in memory at once.
+         * @param nMaxRecordLength The longest record allowed.
+         */
+        void setLimits(size_t nBatchSize, size_t nMaxPending, size_t nMaxRecordLength)
+        {
+            batchSize = nBatchSize > 0 ? nBatchSize : 1;
+            maxPending = nMaxPending > 0 ? nMaxPending : 1;
+            maxRecordLength = nMaxRecordLength;
+        }
+
+        /**
+         * Read records from memory, such as a memory mapped file.
+         * @param data The input.  It is not copied and must not change while reading.
+         * @param length The length of the input.
+         * @return False if there was an error or the handler stopped the reader.
+         */
+        bool read(const char *data, size_t length)
+        {
+            size_t pos = 0;
+            return run([this, data, length, &pos](Batch & batch) -> bool
+            {
+                if(pos == length)
+                {
+                    return false;
+                }
+                size_t end = lineEnd(data, length, std::min(length, pos + batchSize));
+                batch.data = data + pos;
+                batch.length = end - pos;
+                batch.offset = pos;
+                pos = end;
+                return true;
+            });
+        }
+
+        bool read(const std::string &data)
+        {
+            return read(data.data(), data.length());
+        }
+
+        /**
+         * Read records from a stream until the end of the stream.
+         * @param in The stream.
+         * @return False if there was an error or the handler stopped the reader.
+         */
+        bool read(std::istream &in)
+        {
+            return readChunks([&in](char *buffer, size_t length) -> long
+            {
+                in.read(buffer, length);
+                return (long) in.gcount();
+            });
+        }
+
+        /**
+         * Read records from a file descriptor until the end of the file.
+         * @param fd The file descriptor.
+         * @return False if there was an error or the handler stopped the reader.
+         */
+        bool read(int fd)
+        {
+            return readChunks([fd](char *buffer, size_t length) -> long
+            {
+                while(true)
+                {
+                    ssize_t got = ::read(fd, buffer, length);
+                    if(got >= 0 || errno != EINTR)
+                    {
+                        return (long) got;
+                    }
+                }
+            });
+        }
+
+        /**
+         * Did the handler stop the reader?
+         * @return True if stopped.
+         */
+        bool isStopped() const
+        {
+            return stopped;
+        }
+
+        /**
+         * Get the last error code.
+         * Errors in records are reported with the records, not here.
+         * @return The error code.
+         */
+        JSONError getError() const
+        {
+            return lastError;
+        }
+
+        /**
+         * Get the offset in the input of the last error.
+         * @return The offset of the error.
+         */
+        long getErrorIndex() const
+        {
+            return errorIndex;
+        }
+
+        /**
+         * Reset the error code.
+         */
+        void resetError()
+        {
+            lastError = JSONError::NONE;
+            errorIndex = -1;
+            stopped = false;
+        }
+
+    private:
+
+        struct Record
+        {
+            std::unique_ptr<JSONDocument> doc;
+            size_t offset;
+        };
+
+        /**
+         * Some whole lines of the input.
+         */
+        struct Batch
+        {
+            // The lines, in 'owned' when the input is read in chunks.
+            const char *data = nullptr;
+            size_t length = 0;
+            std::string owned;
+            // The offset of the first line in the input.
+            size_t offset = 0;
+            std::vector<Record> records;
+            bool parsed = false;
+        };
+
+        NDJSONHandler &handler;
+        unsigned int threads;
+        bool ordered;
+        JSONParseOptions options;
+        size_t batchSize;
+        size_t maxPending;
+        size_t maxRecordLength;
+        bool stopped;
+        JSONError lastError;
+        long errorIndex;
+
+        std::mutex lock;
+        // Signalled when there is work or the workers must stop.
+        std::condition_variable workReady;
+        // Signalled when a batch has been parsed.
+        std::condition_variable batchParsed;
+        // Batches waiting for a worker.
+        std::deque<Batch *> work;
+        // Batches not yet received by the handler, in input order.
+        std::deque<std::unique_ptr<Batch>> pending;
+        // Received batches for the workers to release, so memory is freed by the threads that allocated it.
+        std::vector<std::unique_ptr<Batch>> spent;
+        // Set when the workers must stop.
+        bool finished;
+        // Set when the remaining batches are not needed.
+        bool dropping;
+
+        /**
+         * Find the end of the line that contains 'pos'.
+         * @return The offset after the newline or the length.
+         */
+        static size_t lineEnd(const char *data, size_t length, size_t pos)
+        {
+            if(pos == 0 || pos >= length)
+            {
+                return length;
+            }
+            const void *nl = std::memchr(data + pos - 1, '\n', length - pos + 1);
+            return nl == nullptr ? length : (const char *) nl - data + 1;
+        }
+
+        /**
+         * Read input a chunk at a time.
+         * @param readChunk Called as long(char *buffer, size_t length) to read input.
+         * Returns the number of bytes read, 0 at the end of the input or -1 for an error.
+         */
+        template<typename ReadChunk>
+        bool readChunks(ReadChunk readChunk)
+        {
+            // The start of a line that continues in the next chunk.
+            std::string carry;
+            size_t offset = 0;
+            bool end = false;
+            return run([this, &readChunk, &carry, &offset, &end](Batch & batch) -> bool
+            {
+                if(end)
+                {
+                    return false;
+                }
+                std::string &text = batch.owned;
+                text.swap(carry);
+                carry.clear();
+                size_t lines = 0;
+                while(lines == 0)
+                {
+                    size_t from = text.length();
+                    text.resize(from + batchSize);
+                    long got = readChunk(&text[from], batchSize);
+                    if(got < 0)
+                    {
+                        setError(JSONError::UnexpectedEndOfDocument, offset + from);
+                        return false;
+                    }
+                    text.resize(from + got);
+                    if(got == 0)
+                    {
+                        end = true;
+                        lines = text.length();
+                        break;
+                    }
+                    for(size_t i = text.length(); i > from; i--)
+                    {
+                        if(text[i - 1] == '\n')
+                        {
+                            lines = i;
+                            break;
+                        }
+                    }
+                    if(lines == 0 && text.length() > maxRecordLength)
+                    {
+                        setError(JSONError::LimitExceeded, offset);
+                        return false;
+                    }
+                }
+                carry.assign(text, lines, std::string::npos);
+                text.resize(lines);
+                if(text.empty())
+                {
+                    return false;
+                }
+                batch.data = text.data();
+                batch.length = text.length();
+                batch.offset = offset;
+                offset += lines;
+                return true;
+            });
+        }
+
+        void setError(JSONError error, long index)
+        {
+            lastError = error;
+            errorIndex = index;
+        }
+
+        /**
+         * Parse batches on the workers and pass the records to the handler.
+         * @param nextBatch Called as bool(Batch &) to fill the next batch.  Returns false at the end of the input.
+         */
+        template<typename NextBatch>
+        bool run(NextBatch nextBatch)
+        {
+            resetError();
+            finished = false;
+            dropping = false;
+            std::vector<std::thread> workers;
+            for(unsigned int i = 0; i < threads; i++)
+            {
+                workers.push_back(std::thread([this]()
+                {
+                    parseBatches();
+                }));
+            }
+            bool more = true;
+            std::unique_lock<std::mutex> uLock(lock);
+            while(true)
+            {
+                if(!deliver(uLock))
+                {
+                    more = false;
+                }
+                if(more && pending.size() < maxPending)
+                {
+                    // Fill the next batch without holding the lock.
+                    uLock.unlock();
+                    std::unique_ptr<Batch> batch(new Batch());
+                    more = nextBatch(*batch);
+                    uLock.lock();
+                    if(lastError != JSONError::NONE)
+                    {
+                        dropping = true;
+                    }
+                    else if(more)
+                    {
+                        work.push_back(batch.get());
+                        pending.push_back(std::move(batch));
+                        workReady.notify_one();
+                    }
+                    continue;
+                }
+                if(pending.empty())
+                {
+                    break;
+                }
+                if(!ready())
+                {
+                    batchParsed.wait(uLock);
+                }
+            }
+            finished = true;
+            workReady.notify_all();
+            uLock.unlock();
+            for(auto &worker : workers)
+            {
+                worker.join();
+            }
+            return lastError == JSONError::NONE && !stopped;
+        }
+
+        /**
+         * Check if a batch can be passed to the handler.
+         */
+        bool ready() const
+        {
+            if(ordered)
+            {
+                return !pending.empty() && pending.front()->parsed;
+            }
+            for(auto &batch : pending)
+            {
+                if(batch->parsed)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Pass the parsed batches to the handler.
+         * Once the handler stops the batches are dropped.
+         * @param uLock The held lock.  It is released while the handler runs.
+         * @return False if the handler has stopped.
+         */
+        bool deliver(std::unique_lock<std::mutex> &uLock)
+        {
+            while(ready())
+            {
+                auto itr = pending.begin();
+                while(!(*itr)->parsed)
+                {
+                    itr++;
+                }
+                std::unique_ptr<Batch> batch = std::move(*itr);
+                pending.erase(itr);
+                if(dropping)
+                {
+                    spent.push_back(std::move(batch));
+                    workReady.notify_one();
+                    continue;
+                }
+                uLock.unlock();
+                bool keepGoing = true;
+                for(auto &record : batch->records)
+                {
+                    if(!handler.record(*record.doc, record.offset))
+                    {
+                        keepGoing = false;
+                        break;
+                    }
+                }
+                uLock.lock();
+                spent.push_back(std::move(batch));
+                workReady.notify_one();
+                if(!keepGoing)
+                {
+                    stopped = true;
+                    dropping = true;
+                }
+            }
+            return !dropping;
+        }
+
+        /**
+         * Run by each worker thread.
+         */
+        void parseBatches()
+        {
+            std::unique_lock<std::mutex> uLock(lock);
+            while(true)
+            {
+                if(!spent.empty())
+                {
+                    std::unique_ptr<Batch> batch = std::move(spent.back());
+                    spent.pop_back();
+                    uLock.unlock();
+                    batch.reset();
+                    uLock.lock();
+                    continue;
+                }
+                if(work.empty())
+                {
+                    if(finished)
+                    {
+                        return;
+                    }
+                    workReady.wait(uLock);
+                    continue;
+                }
+                Batch *batch = work.front();
+                work.pop_front();
+                bool skip = dropping;
+                uLock.unlock();
+                if(!skip)
+                {
+                    parseBatch(*batch);
+                }
+                uLock.lock();
+                batch->parsed = true;
+                batchParsed.notify_one();
+            }
+        }
+
+        void parseBatch(Batch &batch)
+        {
+            // Views would refer to the batch, which is released once it is received.
+            JSONParseOptions recordOptions = (JSONParseOptions) ((int) options & ~(int) JSONParseOptions::STRING_VIEWS);
+            size_t pos = 0;
+            while(pos < batch.length)
+            {
+                const char *start = batch.data + pos;
+                const char *nl = (const char *) std::memchr(start, '\n', batch.length - pos);
+                size_t length = nl == nullptr ? batch.length - pos : nl - start;
+                size_t offset = batch.offset + pos;
+                pos += length + 1;
+                if(isBlank(start, length))
+                {
+                    continue;
+                }
+                Record record;
+                record.doc.reset(new JSONDocument(start, length, recordOptions));
+                record.offset = offset;
+                batch.records.push_back(std::move(record));
+            }
+        }
+
+        static bool isBlank(const char *str, size_t length)
+        {
+            for(size_t i = 0; i < length; i++)
+            {
+                if(str[i] != ' ' && str[i] != '\t' && str[i] != '\r')
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+}
+
+#endif /* NDJSONREADER_H */
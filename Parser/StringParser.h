@@ -18,42 +18,255 @@
 #define STRINGPARSER_H
 
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <istream>
 #include <cmath>
+#include <cerrno>
+#include <unistd.h>
 #include "../String/KString.h"
 #include "../String/KUTF.h"
+#include "../Utility/KSimd.h"
 
 namespace KayLib
 {
 
+    /**
+     * Characters of the string a StringParser is reading, returned without copying them.
+     * A token is only valid while the string exists and, when the parser reads
+     * from a StringSource, until the parser reads more of the input.
+     */
+    template<typename T>
+    class StringToken
+    {
+    public:
+
+        StringToken() : ptr(nullptr), len(0) { }
+
+        StringToken(const T *str, size_t length) : ptr(str), len(length) { }
+
+        /**
+         * Get the characters of the token.
+         * @return The characters, not null terminated.
+         */
+        const T *data() const
+        {
+            return ptr;
+        }
+
+        /**
+         * Get the length of the token.
+         * @return The number of characters.
+         */
+        size_t length() const
+        {
+            return len;
+        }
+
+        /**
+         * Check if the token has no characters.
+         * @return True if empty.
+         */
+        bool empty() const
+        {
+            return len == 0;
+        }
+
+        /**
+         * Get a copy of the token.
+         * @return The token.
+         */
+        std::basic_string<T> str() const
+        {
+            return std::basic_string<T>(ptr, len);
+        }
+
+        bool operator==(const std::basic_string<T> &other) const
+        {
+            return other.length() == len && std::char_traits<T>::compare(ptr, other.data(), len) == 0;
+        }
+
+        bool operator!=(const std::basic_string<T> &other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        const T *ptr;
+        size_t len;
+    };
+
+    /**
+     * Supplies the characters of a StringParser that reads its input in chunks.
+     */
+    template<typename T>
+    class StringSource
+    {
+    public:
+
+        virtual ~StringSource() { }
+
+        /**
+         * Read the next characters.
+         * @param buffer Where to put the characters.
+         * @param size The most characters to read.
+         * @return The number of characters read, 0 at the end of the input.
+         */
+        virtual size_t read(T *buffer, size_t size) = 0;
+    };
+
+    /**
+     * Reads the characters of a StringParser from a stream.
+     */
+    template<typename T>
+    class StringStreamSource : public StringSource<T>
+    {
+    public:
+
+        StringStreamSource(std::basic_istream<T> &in) : in(in) { }
+
+        virtual size_t read(T *buffer, size_t size)
+        {
+            if(!in)
+            {
+                return 0;
+            }
+            in.read(buffer, size);
+            return (size_t) in.gcount();
+        }
+
+    private:
+        std::basic_istream<T> &in;
+    };
+
+    /**
+     * Reads the characters of a StringParser from a file descriptor, such as a pipe or socket.
+     */
+    class StringFileSource : public StringSource<char>
+    {
+    public:
+
+        StringFileSource(int fd) : fd(fd), error(0) { }
+
+        virtual size_t read(char *buffer, size_t size)
+        {
+            while(error == 0)
+            {
+                ssize_t got = ::read(fd, buffer, size);
+                if(got >= 0)
+                {
+                    return (size_t) got;
+                }
+                if(errno != EINTR)
+                {
+                    error = errno;
+                }
+            }
+            return 0;
+        }
+
+        /**
+         * Get the reason reading stopped early.
+         * @return The errno value or 0.
+         */
+        int getError() const
+        {
+            return error;
+        }
+
+    private:
+        int fd;
+        int error;
+    };
+
     template<typename T>
     class StringParser
     {
     public:
 
-        StringParser(const std::basic_string<T> &str) : string(str)
+        /**
+         * Create a parser with its own copy of a string.
+         * @param str The string to parse.
+         */
+        StringParser(const std::basic_string<T> &str) : owned(str)
         {
-            index = 0;
-            length = string.length();
-            tabAsWhitespace = true;
+            init(owned.data(), owned.length());
+        }
+
+        /**
+         * Create a parser over characters owned by the caller, such as a
+         * KMappedFile, without copying them.
+         * @param str The characters.  They must not change or be released while the parser is used.
+         * @param len The number of characters.
+         */
+        StringParser(const T *str, size_t len)
+        {
+            init(str, len);
+        }
+
+        /**
+         * Create a parser that reads its characters from a source as they are needed.
+         * Only a window of the input is kept, holding the text being parsed, so
+         * input larger than memory can be parsed.
+         * @param source The source of the characters.  It must exist while the parser is used.
+         * @param windowSize The number of characters to read at a time.  The window
+         * only grows beyond this to hold a string longer than the window.
+         */
+        StringParser(StringSource<T> &source, size_t windowSize = 64 * 1024)
+        {
+            window.resize(windowSize > 16 ? windowSize : 16);
+            init(window.data(), 0);
+            this->source = &source;
+        }
+
+        StringParser(const StringParser &orig) : owned(orig.owned), window(orig.window)
+        {
+            const T *str = orig.string;
+            if(orig.string == orig.owned.data())
+            {
+                str = owned.data();
+            }
+            else if(orig.source != nullptr)
+            {
+                str = window.data();
+            }
+            init(str, orig.length);
+            index = orig.index;
+            tabAsWhitespace = orig.tabAsWhitespace;
+            source = orig.source;
+            base = orig.base;
+            ended = orig.ended;
+            newlines = orig.newlines;
+            linesBefore = orig.linesBefore;
+            lastNewlineBefore = orig.lastNewlineBefore;
+            indexed = orig.indexed;
         }
 
+        StringParser &operator=(const StringParser &orig) = delete;
+
         /**
          * Get the current index being parsed.
          * @return The index.
          */
-        int getIndex() const
+        long getIndex() const
         {
-            return index;
+            return base + index;
         }
 
         /**
          * Set the current index being parsed.
          * @param i The index to set.
          * @return The index that was actually set.
+         * @note When reading from a source the index can not be moved back before
+         * the start of the window.
          */
-        int setIndex(int i) const
+        long setIndex(long i)
         {
-            index = i;
+            if(i - base > length)
+            {
+                available(i - base - index);
+            }
+            index = i - base;
             if(index < 0)
             {
                 index = 0;
@@ -62,7 +275,7 @@ namespace KayLib
             {
                 index = length;
             }
-            return index;
+            return base + index;
         }
 
         /**
@@ -89,8 +302,12 @@ namespace KayLib
          * Skip the next 'num' characters.
          * @param num The number of characters to skip.
          */
-        void skip(int num)
+        void skip(long num)
         {
+            if(num > 0)
+            {
+                available(num);
+            }
             index += num;
             if(index > length)
             {
@@ -100,27 +317,27 @@ namespace KayLib
 
         /**
          * Get the string being parsed.
-         * @return A copy of the string being parsed.
+         * @return A copy of the string being parsed, or of the window when reading from a source.
          */
         std::basic_string<T> getParseString() const
         {
-            return std::basic_string<T>(string);
+            return std::basic_string<T>(string, length);
         }
 
         /**
          * Check if the parser has reached the end of the string.
          * @return True if the parser has reached the end of the string.
          */
-        bool isEnd() const
+        bool isEnd()
         {
-            return index >= length;
+            return !available(1);
         }
 
         /**
          * Is the next character part of a newline designator '\r' or '\n'?
          * @return True if the next char is part of a newline.
          */
-        bool isNewline() const
+        bool isNewline()
         {
             T c = peekChar();
             return (c == '\r' || c == '\n');
@@ -130,7 +347,7 @@ namespace KayLib
          * Is the next character a numerical digit?
          * @return True if the next character is a digit.
          */
-        bool isDigit() const
+        bool isDigit()
         {
             return KString::digit(peekChar()) != -1;
         }
@@ -141,21 +358,22 @@ namespace KayLib
          */
         bool isDecimal()
         {
-            int i = index;
-            if(string[i] == '-' || string[i] == '+')
+            // Offsets from the index, the window may move while looking ahead.
+            long i = 0;
+            if(available(i + 1) && (string[index + i] == '-' || string[index + i] == '+'))
             {
                 i++;
             }
-            int v;
-            while((v = KString::digit(string[i])) != -1 && i < length)
+            while(available(i + 1) && KString::digit(string[index + i]) != -1)
             {
                 i++;
             }
-            return string[i] == '.';
+            return available(i + 1) && string[index + i] == '.';
         }
 
         /**
          * Reset the parser to the beginning of the string.
+         * @note When reading from a source this is the start of the window.
          */
         void reset()
         {
@@ -166,9 +384,9 @@ namespace KayLib
          * Gets the next character but does not advance the pointer.
          * @return The next character in the string.
          */
-        T peekChar() const
+        T peekChar()
         {
-            if(index >= length)
+            if(!available(1))
             {
                 return 0;
             }
@@ -181,7 +399,7 @@ namespace KayLib
          */
         T getChar()
         {
-            if(index >= length)
+            if(!available(1))
             {
                 return 0;
             }
@@ -194,23 +412,37 @@ namespace KayLib
          */
         std::basic_string<T> getWord()
         {
-            int start = index;
-            int sz = 0;
+            return viewWord().str();
+        }
+
+        /**
+         * Gets next word (space or tab separated) from the string.
+         * @param out Set to the next word, reusing its memory.
+         */
+        void getWord(std::basic_string<T> &out)
+        {
+            StringToken<T> word = viewWord();
+            out.assign(word.data(), word.length());
+        }
+
+        /**
+         * Gets next word (space or tab separated) from the string without copying it.
+         * @return The next word.
+         */
+        StringToken<T> viewWord()
+        {
+            mark = index;
             T c;
-            while((c = peekChar()) != ' ' && index < length)
+            while(true)
             {
-                if(c == '\t')
+                index += scan(string + index, length - index, true, ' ', '\t', ' ', ' ');
+                if((c = peekChar()) == ' ' || index >= length || c == '\t')
                 {
                     break;
                 }
-                sz++;
                 index++;
             }
-            if(sz == 0)
-            {
-                return "";
-            }
-            return string.substr(start, sz);
+            return takeMarked();
         }
 
         /**
@@ -221,14 +453,79 @@ namespace KayLib
          */
         std::basic_string<T> getTo(const T separator, bool includeNewline = true)
         {
-            int start = index;
-            int sz = 0;
-            while(peekChar() != separator && index < length && (includeNewline || !isNewline()))
+            return viewTo(separator, includeNewline).str();
+        }
+
+        /**
+         * Gets a string from the current position to the separator or end of string or optionally newline if the separator is not found.
+         * @param out Set to the string, reusing its memory.
+         * @param separator The word separator to look for.
+         * @param includeNewline True if newlines should be included in the fetched string.
+         */
+        void getTo(std::basic_string<T> &out, const T separator, bool includeNewline = true)
+        {
+            StringToken<T> str = viewTo(separator, includeNewline);
+            out.assign(str.data(), str.length());
+        }
+
+        /**
+         * Gets a string from the current position to the separator without copying it.
+         * @param separator The word separator to look for.
+         * @param includeNewline True if newlines should be included in the fetched string.
+         * @return The string.
+         */
+        StringToken<T> viewTo(const T separator, bool includeNewline = true)
+        {
+            mark = index;
+            T cr = includeNewline ? separator : '\r';
+            T lf = includeNewline ? separator : '\n';
+            while(true)
             {
-                sz++;
+                index += scan(string + index, length - index, true, separator, separator, cr, lf);
+                if(peekChar() == separator || index >= length || (!includeNewline && isNewline()))
+                {
+                    break;
+                }
+                index++;
+            }
+            return takeMarked();
+        }
+
+        /**
+         * Gets a string from the current position to the first whitespace or any of the separators, without copying it.
+         * @param separators The characters that end the string.
+         * @param andNewLine True if newlines end the string as well.
+         * @return The string.
+         */
+        StringToken<T> viewToAny(const std::basic_string<T> &separators, bool andNewLine = true)
+        {
+            mark = index;
+            while(!isEnd() && !isWhitespace(andNewLine) && separators.find(string[index]) == std::basic_string<T>::npos)
+            {
+                index++;
+            }
+            return takeMarked();
+        }
+
+        /**
+         * Gets a string from the current position to the next occurrence of another string, without copying it.
+         * The index is left at the start of the other string.
+         * @param end The string to look for.
+         * @return The string, to the end of the input if 'end' is not found.
+         */
+        StringToken<T> viewToString(const std::basic_string<T> &end)
+        {
+            mark = index;
+            while(!end.empty())
+            {
+                index += scan(string + index, length - index, true, end[0], end[0], end[0], end[0]);
+                if(isEnd() || nextIs(end))
+                {
+                    break;
+                }
                 index++;
             }
-            return string.substr(start, sz);
+            return takeMarked();
         }
 
         /**
@@ -295,7 +592,7 @@ namespace KayLib
         {
             long value = 0;
             int v;
-            while((v = digitHex(peekChar())) != -1 && index < length)
+            while((v = KString::digitHex(peekChar())) != -1 && index < length)
             {
                 value *= 16;
                 value += v;
@@ -422,8 +719,16 @@ namespace KayLib
          */
         void skipWhitespace(bool andNewLine)
         {
-            while(isWhitespace(andNewLine) && index < length)
+            T tab = tabAsWhitespace ? '\t' : ' ';
+            T cr = andNewLine ? '\r' : ' ';
+            T lf = andNewLine ? '\n' : ' ';
+            while(true)
             {
+                index += scan(string + index, length - index, false, ' ', tab, cr, lf);
+                if(!isWhitespace(andNewLine) || index >= length)
+                {
+                    break;
+                }
                 index++;
             }
         }
@@ -436,18 +741,55 @@ namespace KayLib
          * @note If the string is contained in double quotes single quotes will be ignored.
          */
         std::basic_string<T> getQuotedString()
+        {
+            return viewQuotedString().str();
+        }
+
+        /**
+         * Gets the string contained in single or double quotes.
+         * @param out Set to the string, reusing its memory.
+         * @param decode True if escape sequences should be decoded, see unescape.
+         * @note The index must be pointing to the initial quote.
+         */
+        void getQuotedString(std::basic_string<T> &out, bool decode = false)
+        {
+            StringToken<T> str = viewQuotedString();
+            if(decode)
+            {
+                unescape(str, out);
+            }
+            else
+            {
+                out.assign(str.data(), str.length());
+            }
+        }
+
+        /**
+         * Gets the string contained in single or double quotes without copying it.
+         * @return The string, with its escape sequences as they appear in the text.
+         * @note The index must be pointing to the initial quote.
+         */
+        StringToken<T> viewQuotedString()
         {
             T quote = peekChar();
             if(quote != '\"' && quote != '\'')
             {
-                return "";
+                return StringToken<T>();
             }
             index++;
-            int start = index;
-            int sz = 0;
+            mark = index;
+            long sz = 0;
             T c;
-            while((c = getChar()) != quote && index < length)
+            while(true)
             {
+                // The last character ends the loop whatever it is so it is never skipped.
+                long run = scan(string + index, length - index - 1, true, quote, '\\', quote, quote);
+                index += run;
+                sz += run;
+                if((c = getChar()) == quote || isEnd())
+                {
+                    break;
+                }
                 sz++;
                 // Check for escape character.
                 if(c == '\\')
@@ -457,11 +799,9 @@ namespace KayLib
                     index++;
                 }
             }
-            if(sz == 0)
-            {
-                return "";
-            }
-            return string.substr(start, sz);
+            StringToken<T> str(string + mark, sz);
+            mark = -1;
+            return str;
         }
 
         /**
@@ -470,18 +810,36 @@ namespace KayLib
          */
         std::basic_string<T> getToEOL()
         {
-            int start = index;
-            int sz = 0;
-            while(!isNewline())
+            return viewToEOL().str();
+        }
+
+        /**
+         * Get all characters till the next newline
+         * @param out Set to the characters, reusing its memory.
+         */
+        void getToEOL(std::basic_string<T> &out)
+        {
+            StringToken<T> line = viewToEOL();
+            out.assign(line.data(), line.length());
+        }
+
+        /**
+         * Get all characters till the next newline without copying them.
+         * @return The characters.
+         */
+        StringToken<T> viewToEOL()
+        {
+            mark = index;
+            while(true)
             {
+                index += scan(string + index, length - index, true, '\r', '\n', '\r', '\n');
+                if(isNewline() || index >= length)
+                {
+                    break;
+                }
                 index++;
-                sz++;
             }
-            if(sz == 0)
-            {
-                return "";
-            }
-            return string.substr(start, sz);
+            return takeMarked();
         }
 
         /**
@@ -489,14 +847,116 @@ namespace KayLib
          * @param start The first character.
          * @param size The number of characters.
          * @return The string.
+         * @note When reading from a source only the characters in the window are available.
+         */
+        std::basic_string<T> getRange(long start, long size)
+        {
+            return viewRange(start, size).str();
+        }
+
+        /**
+         * Get the 'size' characters starting at 'start'.
+         * @param out Set to the characters, reusing its memory.
+         * @param start The first character.
+         * @param size The number of characters.
+         */
+        void getRange(std::basic_string<T> &out, long start, long size)
+        {
+            StringToken<T> range = viewRange(start, size);
+            out.assign(range.data(), range.length());
+        }
+
+        /**
+         * Get the 'size' characters starting at 'start' without copying them.
+         * @param start The first character.
+         * @param size The number of characters.
+         * @return The characters.
          */
-        std::basic_string<T> getRange(int start, int size)
+        StringToken<T> viewRange(long start, long size)
         {
+            start -= base;
             if(start < 0 || start >= length || size < 1 || start + size > length)
             {
-                return "";
+                return StringToken<T>();
+            }
+            return StringToken<T>(string + start, size);
+        }
+
+        /**
+         * Decode the escape sequences of a string the same way KString::unescape does.
+         * @param str The string, such as one returned by viewQuotedString.
+         * @param out Set to the decoded string, reusing its memory.
+         */
+        static void unescape(const StringToken<T> &str, std::basic_string<T> &out)
+        {
+            static const char hex[] = "0123456789ABCDEF";
+            out.clear();
+            const T *s = str.data();
+            size_t len = str.length();
+            for(size_t i = 0; i < len; i++)
+            {
+                T c = s[i];
+                if(c != '\\')
+                {
+                    out.push_back(c);
+                    continue;
+                }
+                if(++i >= len)
+                {
+                    // An escape character at the end is kept.
+                    out.push_back(c);
+                    break;
+                }
+                c = s[i];
+                switch(c)
+                {
+                    case 'a':
+                        out.push_back('\a');
+                        break;
+                    case 'b':
+                        out.push_back('\b');
+                        break;
+                    case 't':
+                        out.push_back('\t');
+                        break;
+                    case 'n':
+                        out.push_back('\n');
+                        break;
+                    case 'v':
+                        out.push_back('\v');
+                        break;
+                    case 'f':
+                        out.push_back('\f');
+                        break;
+                    case 'r':
+                        out.push_back('\r');
+                        break;
+                    case '\"':
+                    case '\'':
+                    case '\\':
+                        out.push_back(c);
+                        break;
+                    default:
+                        // Unknown escape sequences are kept as they are.
+                        out.push_back('\\');
+                        if(c <= 0x0F)
+                        {
+                            // Matching KString::unescape.
+                            unsigned char v = (unsigned char) c;
+                            out.push_back('\\');
+                            out.push_back('u');
+                            out.push_back('0');
+                            out.push_back('0');
+                            out.push_back(hex[v >> 4]);
+                            out.push_back(hex[v & 0x0F]);
+                        }
+                        else
+                        {
+                            out.push_back(c);
+                        }
+                        break;
+                }
             }
-            return string.substr(start, size);
         }
 
         /**
@@ -511,13 +971,14 @@ namespace KayLib
             {
                 return true;
             }
-            int len = next.length();
-            for(int i = 0; i < len; i++)
+            long len = next.length();
+            if(!available(len))
             {
-                if(string[index + i] != next[i])
-                {
-                    return false;
-                }
+                return false;
+            }
+            if(std::char_traits<T>::compare(string + index, next.data(), len) != 0)
+            {
+                return false;
             }
             if(advance)
             {
@@ -532,23 +993,24 @@ namespace KayLib
          */
         char32_t peekCharUTF()
         {
-            if(index >= length)
+            if(!available(1))
             {
                 return -1;
             }
-            int i = index;
-            int res;
-            while((res = code.addChar(string[i])) != 0 && i < length)
+            T b = string[index];
+            if(sizeof (T) == 1 && (b & ~0x7F) == 0)
             {
-                i++;
+                code.addChar((char32_t) b);
+                return b;
             }
-            if(res != 0)
+            char32_t c;
+            long len;
+            if(!decodeUTF8(c, len))
             {
-                // There was an error.
-                code.reset();
-                return -1;
+                return parseCharUTF(false);
             }
-            return code.getCode();
+            code.addChar(c);
+            return c;
         }
 
         /**
@@ -557,23 +1019,26 @@ namespace KayLib
          */
         char32_t getCharUTF()
         {
-            if(index >= length)
+            if(!available(1))
             {
                 return -1;
             }
-            int res;
-            do
+            T b = string[index];
+            if(sizeof (T) == 1 && (b & ~0x7F) == 0)
             {
-                res = code.addChar(string[index++]);
+                index++;
+                code.addChar((char32_t) b);
+                return b;
             }
-            while(res != 0 && index < length);
-            if(res != 0)
+            char32_t c;
+            long len;
+            if(!decodeUTF8(c, len))
             {
-                // There was an error.
-                code.reset();
-                return -1;
+                return parseCharUTF(true);
             }
-            return code.getCode();
+            index += len;
+            code.addChar(c);
+            return c;
         }
 
         /**
@@ -585,6 +1050,31 @@ namespace KayLib
             std::basic_string<T> out;
             char32_t c;
             char32_t n = -1;
+            long len;
+            // Well formed characters that are not overlong are the same once
+            // converted back, so they are copied as they are.
+            mark = index;
+            while(sizeof (T) == 1 && available(1))
+            {
+                T b = string[index];
+                if((b & ~0x7F) == 0)
+                {
+                    if(b == ' ' || b == '\t')
+                    {
+                        break;
+                    }
+                    index++;
+                    index += scan(string + index, length - index, true, ' ', '\t', ' ', ' ', true);
+                    continue;
+                }
+                if(!decodeUTF8(c, len) || c < (len == 2 ? 0x80 : len == 3 ? 0x800 : 0x10000))
+                {
+                    break;
+                }
+                index += len;
+            }
+            out.append(string + mark, index - mark);
+            mark = -1;
             while((c = getCharUTF()) != ' ')
             {
                 if(c == n || c == '\t')
@@ -597,12 +1087,390 @@ namespace KayLib
             return out;
         }
 
+        /**
+         * Get the line an index is on.  The lines are found the first time they are
+         * needed, and only up to the index asked for, so parsers that never ask pay nothing.
+         * @param i The index.
+         * @return The line number, the first line is 1.
+         * @note When reading from a source only indexes in the window can be found.
+         */
+        long getLine(long i)
+        {
+            return linesBefore + findLine(i) + 1;
+        }
+
+        /**
+         * Get the column of an index on its line.
+         * @param i The index.
+         * @return The column, the first column is 1.  Columns count characters, not UTF characters.
+         */
+        long getColumn(long i)
+        {
+            return clampIndex(i) - lineStart(findLine(i)) + 1;
+        }
+
+        /**
+         * Get the text of the line around an index, for showing where an error is.
+         * @param i The index.
+         * @param width The most characters to return.
+         * @return The part of the line, centered on the index where possible.
+         */
+        std::basic_string<T> getExcerpt(long i, long width = 60)
+        {
+            i = clampIndex(i) - base;
+            long start = lineStart(findLine(i + base)) - base;
+            if(start < 0)
+            {
+                start = 0;
+            }
+            if(i - start > width / 2)
+            {
+                start = i - width / 2;
+            }
+            long end = start;
+            while(end < length && end - start < width && string[end] != '\n' && string[end] != '\r')
+            {
+                end++;
+            }
+            return std::basic_string<T>(string + start, end - start);
+        }
+
     protected:
         KUTF::UTFCodeParser code;
-        const std::basic_string<T> string;
-        int index;
-        int length;
+        // Only used when the parser has its own copy of the string.
+        const std::basic_string<T> owned;
+        const T *string;
+        long index;
+        long length;
         bool tabAsWhitespace;
+        // Only used when reading from a source.
+        StringSource<T> *source;
+        std::vector<T> window;
+        // The index of the start of the window in the input.
+        long base;
+        // The start of the text being read, it is kept when the window is refilled.
+        long mark;
+        bool ended;
+        // The indexes of the newlines found so far, once the window moves past them they are only counted.
+        std::vector<long> newlines;
+        long linesBefore;
+        long lastNewlineBefore;
+        // Newlines have been found up to this index.
+        long indexed;
+
+        void init(const T *str, size_t len)
+        {
+            string = str;
+            index = 0;
+            length = (long) len;
+            tabAsWhitespace = true;
+            source = nullptr;
+            base = 0;
+            mark = -1;
+            ended = false;
+            linesBefore = 0;
+            lastNewlineBefore = -1;
+            indexed = 0;
+        }
+
+        /**
+         * Make sure characters following the index are in memory.
+         * @param num The number of characters needed.
+         * @return True if they are available, false if the input ends first.
+         */
+        bool available(long num)
+        {
+            return index + num <= length || refill(index + num);
+        }
+
+        /**
+         * Read more of the input into the window.
+         * @param need The end of the characters needed, relative to the window.
+         * @return True if the window reaches the end needed.
+         */
+        bool refill(long need)
+        {
+            if(source == nullptr || ended)
+            {
+                return false;
+            }
+            // Drop what has been parsed, keeping the text being read and one character to go back to.
+            long keep = (mark >= 0 && mark < index ? mark : index) - 1;
+            if(keep > length)
+            {
+                keep = length;
+            }
+            if(keep > 0)
+            {
+                // Count the lines of the text being dropped.
+                indexLines(base + keep);
+                auto dropped = std::lower_bound(newlines.begin(), newlines.end(), base + keep);
+                if(dropped != newlines.begin())
+                {
+                    linesBefore += dropped - newlines.begin();
+                    lastNewlineBefore = *(dropped - 1);
+                    newlines.erase(newlines.begin(), dropped);
+                }
+                std::char_traits<T>::move(window.data(), window.data() + keep, length - keep);
+                base += keep;
+                index -= keep;
+                length -= keep;
+                need -= keep;
+                if(mark >= 0)
+                {
+                    mark -= keep;
+                }
+            }
+            while(length < need)
+            {
+                if(length == (long) window.size())
+                {
+                    // The text being read is larger than the window.
+                    window.resize(window.size() * 2);
+                }
+                size_t got = source->read(window.data() + length, window.size() - length);
+                if(got == 0)
+                {
+                    ended = true;
+                    break;
+                }
+                length += got;
+            }
+            string = window.data();
+            return length >= need;
+        }
+
+        /**
+         * Parse the UTF encoded character at the index one character at a time.
+         * @param advance True to move the index past the character.
+         * @return The UTF character or -1 on failure.
+         */
+        char32_t parseCharUTF(bool advance)
+        {
+            // Offsets from the index, the window may move while looking ahead.
+            long i = 0;
+            int res;
+            do
+            {
+                res = code.addChar(string[index + i++]);
+            }
+            while(res != 0 && available(i + 1));
+            if(advance)
+            {
+                index += i;
+            }
+            if(res != 0)
+            {
+                // There was an error.
+                code.reset();
+                return -1;
+            }
+            return code.getCode();
+        }
+
+        /**
+         * Decode a whole UTF8 character at the index without the byte by byte parser.
+         * @param c Set to the character.
+         * @param len Set to the number of characters it was encoded with.
+         * @return False if the character must be decoded by the parser because it
+         * is not well formed, is at the end of the input or the parser is not UTF8.
+         */
+        bool decodeUTF8(char32_t &c, long &len)
+        {
+            // The encoded length of each lead byte, by its top 5 bits, 0 for the parser.
+            static const unsigned char lengths[32] = {
+                1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+                0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 3, 3, 4, 0
+            };
+            if(sizeof (T) != 1)
+            {
+                return false;
+            }
+            unsigned char lead = (unsigned char) string[index];
+            len = lengths[lead >> 3];
+            if(len == 0 || !available(len))
+            {
+                return false;
+            }
+            static const unsigned char masks[5] = {0, 0x7F, 0x1F, 0x0F, 0x07};
+            const unsigned char *s = reinterpret_cast<const unsigned char *> (string + index);
+            // Continuations are 10xxxxxx, so any other character sets a high bit here.
+            unsigned char bad = 0;
+            c = lead & masks[len];
+            for(long i = 1; i < len; i++)
+            {
+                c = (c << 6) | (s[i] & 0x3F);
+                bad |= s[i] ^ 0x80;
+            }
+            return bad < 0x40;
+        }
+
+        long clampIndex(long i) const
+        {
+            if(i < base)
+            {
+                return base;
+            }
+            if(i > base + length)
+            {
+                return base + length;
+            }
+            return i;
+        }
+
+        /**
+         * Find the newlines up to an index.
+         * @param end The index to stop at.
+         */
+        void indexLines(long end)
+        {
+            long stop = end - base;
+            for(long p = indexed - base; p < stop; p++)
+            {
+                p += scan(string + p, stop - p, true, '\n', '\n', '\n', '\n');
+                while(p < stop && string[p] != '\n')
+                {
+                    p++;
+                }
+                if(p < stop)
+                {
+                    newlines.push_back(base + p);
+                }
+            }
+            if(end > indexed)
+            {
+                indexed = end;
+            }
+        }
+
+        /**
+         * Find the line of an index in the window.
+         * @param i The index.
+         * @return The number of newlines in the window before the index.
+         */
+        long findLine(long i)
+        {
+            i = clampIndex(i);
+            if(i > indexed)
+            {
+                indexLines(i);
+            }
+            return std::lower_bound(newlines.begin(), newlines.end(), i) - newlines.begin();
+        }
+
+        /**
+         * Get the index of the start of a line.
+         * @param line The number of newlines in the window before the line.
+         * @return The index.
+         */
+        long lineStart(long line) const
+        {
+            return (line > 0 ? newlines[line - 1] : lastNewlineBefore) + 1;
+        }
+
+        /**
+         * Get the text from the mark to the index and clear the mark.
+         * @return The text.
+         */
+        StringToken<T> takeMarked()
+        {
+            StringToken<T> str(string + mark, index - mark);
+            mark = -1;
+            return str;
+        }
+
+        /**
+         * Scan whole blocks of characters for the first one that is, or is not,
+         * one of four characters.  Only single byte characters are scanned, and only
+         * when vector instructions are available, the callers finish the scan.
+         * @param str The characters to scan.
+         * @param len The number of characters that may be scanned.
+         * @param in True to find a character in the set, false to find one that is not.
+         * @param high True to also find characters above 0x7F.
+         * @return The offset of the character found or of the first unscanned block.
+         */
+        static long scan(const T *str, long len, bool in, T a, T b, T c, T d, bool high = false)
+        {
+#ifdef KAYLIB_SIMD_X86
+            if(sizeof (T) != 1 || len < 16)
+            {
+                return 0;
+            }
+            const char *s = reinterpret_cast<const char *> (str);
+            KSimd::Level level = KSimd::level();
+            if(level == KSimd::Level::AVX2)
+            {
+                return scanAVX2(s, len, in, (char) a, (char) b, (char) c, (char) d, high);
+            }
+            if(level == KSimd::Level::SSE2)
+            {
+                return scanSSE2(s, len, in, (char) a, (char) b, (char) c, (char) d, high);
+            }
+#endif
+            return 0;
+        }
+
+#ifdef KAYLIB_SIMD_X86
+
+        static long scanSSE2(const char *str, long len, bool in, char a, char b, char c, char d, bool high)
+        {
+            const __m128i va = _mm_set1_epi8(a);
+            const __m128i vb = _mm_set1_epi8(b);
+            const __m128i vc = _mm_set1_epi8(c);
+            const __m128i vd = _mm_set1_epi8(d);
+            const int flip = in ? 0 : 0xFFFF;
+            long pos = 0;
+            for(; pos + 16 <= len; pos += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *> (str + pos));
+                __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+                                           _mm_or_si128(_mm_cmpeq_epi8(v, vc), _mm_cmpeq_epi8(v, vd)));
+                int mask = _mm_movemask_epi8(hit) ^ flip;
+                if(high)
+                {
+                    // The sign bits are the characters above 0x7F.
+                    mask |= _mm_movemask_epi8(v);
+                }
+                if(mask != 0)
+                {
+                    return pos + KSimd::trailingZeros((uint64_t) mask);
+                }
+            }
+            return pos;
+        }
+
+        __attribute__((target("avx2")))
+        static long scanAVX2(const char *str, long len, bool in, char a, char b, char c, char d, bool high)
+        {
+            const __m256i va = _mm256_set1_epi8(a);
+            const __m256i vb = _mm256_set1_epi8(b);
+            const __m256i vc = _mm256_set1_epi8(c);
+            const __m256i vd = _mm256_set1_epi8(d);
+            const uint32_t flip = in ? 0 : 0xFFFFFFFF;
+            long pos = 0;
+            for(; pos + 32 <= len; pos += 32)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *> (str + pos));
+                __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+                                              _mm256_or_si256(_mm256_cmpeq_epi8(v, vc), _mm256_cmpeq_epi8(v, vd)));
+                uint32_t mask = (uint32_t) _mm256_movemask_epi8(hit) ^ flip;
+                if(high)
+                {
+                    mask |= (uint32_t) _mm256_movemask_epi8(v);
+                }
+                if(mask != 0)
+                {
+                    return pos + KSimd::trailingZeros(mask);
+                }
+            }
+            // Finish with a 16 character block.
+            if(pos + 16 <= len)
+            {
+                pos += scanSSE2(str + pos, len - pos, in, a, b, c, d, high);
+            }
+            return pos;
+        }
+#endif
 
     };
 
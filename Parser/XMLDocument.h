@@ -23,36 +23,12 @@
 #include <memory>
 
 #include "../IO/Exceptions.h"
-#include "StringParser.h"
+#include "XMLReader.h"
+#include "XMLSymbols.h"
 
 namespace KayLib
 {
 
-    enum class XMLError
-    {
-        NONE, UnexpectedEndOfDocument, InvalidSyntax, DoubleDashInComment
-    };
-
-    std::string XMLErrorString(XMLError err)
-    {
-        switch(err)
-        {
-            case XMLError::NONE:
-                return "No error";
-                break;
-            case XMLError::UnexpectedEndOfDocument:
-                return "Parser reached the end of string without finishing the document";
-                break;
-            case XMLError::InvalidSyntax:
-                return "Invalid syntax";
-                break;
-            case XMLError::DoubleDashInComment:
-                return "Double dash '--' in comment";
-                break;
-        }
-        return "Unknown error";
-    }
-
     class XMLElement
     {
     public:
@@ -179,6 +155,10 @@ namespace KayLib
             std::unique_lock<std::mutex> uLock = getLock();
             // Add the element to the child list.
             children.push_back(element);
+            if(tagIndex)
+            {
+                indexChild(children.size() - 1);
+            }
         }
 
         /**
@@ -194,56 +174,99 @@ namespace KayLib
         /**
          * Does this node have a child with the specified tag name.
          * @param tag The tag to find.
+         * @param length The length of the tag.
          * @return True if the node has the tag.
          */
-        bool hasChild(std::string tag) const
+        bool hasChild(const char *tag, size_t length) const
         {
-            std::unique_lock<std::mutex> uLock = getLock();
-            for(auto child : children)
-            {
-                if(child->name == tag)
-                {
-                    return true;
-                }
-            }
-            return false;
+            return getFirstChild(tag, length) != nullptr;
+        }
+
+        bool hasChild(const std::string &tag) const
+        {
+            return hasChild(tag.data(), tag.length());
+        }
+
+        bool hasChild(const StringToken<char> &tag) const
+        {
+            return hasChild(tag.data(), tag.length());
         }
 
         /**
          * Get a list of child elements with the specified tag name.
          * @param tag The tag to find.
+         * @param length The length of the tag.
          * @return The list of elements.
          */
-        std::vector<std::shared_ptr<XMLElement>> getChildren(std::string tag) const
+        std::vector<std::shared_ptr<XMLElement>> getChildren(const char *tag, size_t length) const
         {
             std::unique_lock<std::mutex> uLock = getLock();
             std::vector<std::shared_ptr < XMLElement>> childs;
-            for(auto child : children)
+            if(children.size() <= INDEX_THRESHOLD)
+            {
+                for(auto &child : children)
+                {
+                    if(isNamed(*child, tag, length))
+                    {
+                        childs.push_back(child);
+                    }
+                }
+                return childs;
+            }
+            const std::vector<uint32_t> *found = findTag(tag, length);
+            if(found != nullptr)
             {
-                if(child->name == tag)
+                childs.reserve(found->size());
+                for(uint32_t pos : *found)
                 {
-                    childs.push_back(child);
+                    childs.push_back(children[pos]);
                 }
             }
             return childs;
         }
 
+        std::vector<std::shared_ptr<XMLElement>> getChildren(const std::string &tag) const
+        {
+            return getChildren(tag.data(), tag.length());
+        }
+
+        std::vector<std::shared_ptr<XMLElement>> getChildren(const StringToken<char> &tag) const
+        {
+            return getChildren(tag.data(), tag.length());
+        }
+
         /**
          * Get the first child element with the specified tag name.
          * @param tag The tag to find.
+         * @param length The length of the tag.
          * @return The element found.
          */
-        std::shared_ptr<XMLElement> getFirstChild(std::string tag) const
+        std::shared_ptr<XMLElement> getFirstChild(const char *tag, size_t length) const
         {
             std::unique_lock<std::mutex> uLock = getLock();
-            for(auto child : children)
+            if(children.size() <= INDEX_THRESHOLD)
             {
-                if(child->name == tag)
+                for(auto &child : children)
                 {
-                    return child;
+                    if(isNamed(*child, tag, length))
+                    {
+                        return child;
+                    }
                 }
+                return nullptr;
             }
-            return nullptr;
+            const std::vector<uint32_t> *found = findTag(tag, length);
+            return found != nullptr ? children[found->front()] : nullptr;
+        }
+
+        std::shared_ptr<XMLElement> getFirstChild(const std::string &tag) const
+        {
+            return getFirstChild(tag.data(), tag.length());
+        }
+
+        std::shared_ptr<XMLElement> getFirstChild(const StringToken<char> &tag) const
+        {
+            return getFirstChild(tag.data(), tag.length());
         }
 
         /**
@@ -322,11 +345,60 @@ namespace KayLib
         }
 
     private:
+
+        /**
+         * The children of an element grouped by tag name.
+         */
+        struct TagIndex
+        {
+            XMLSymbols tags;
+            // The positions of the children with each tag.
+            std::vector<std::vector<uint32_t>> children;
+        };
+
+        // Elements with up to this many children are searched without an index.
+        static const size_t INDEX_THRESHOLD = 8;
+
         mutable std::mutex lockPtr;
         std::string name;
         std::string value;
         std::map<std::string, std::string> attributes;
         std::vector<std::shared_ptr<XMLElement>> children;
+        // Built by the first search of an element with many children.
+        mutable std::unique_ptr<TagIndex> tagIndex;
+
+        static bool isNamed(const XMLElement &element, const char *tag, size_t length)
+        {
+            return element.name.length() == length && element.name.compare(0, length, tag, length) == 0;
+        }
+
+        /**
+         * Find the children with a tag, building the index if needed.  The lock must be held.
+         * @return The positions of the children or nullptr if there are none.
+         */
+        const std::vector<uint32_t> *findTag(const char *tag, size_t length) const
+        {
+            if(!tagIndex)
+            {
+                tagIndex.reset(new TagIndex());
+                for(size_t pos = 0; pos < children.size(); pos++)
+                {
+                    indexChild(pos);
+                }
+            }
+            uint32_t symbol = tagIndex->tags.find(tag, length);
+            return symbol != XMLSymbols::NONE ? &tagIndex->children[symbol] : nullptr;
+        }
+
+        void indexChild(size_t pos) const
+        {
+            uint32_t symbol = tagIndex->tags.intern(children[pos]->name);
+            if(symbol == tagIndex->children.size())
+            {
+                tagIndex->children.emplace_back();
+            }
+            tagIndex->children[symbol].push_back((uint32_t) pos);
+        }
 
         inline std::unique_lock<std::mutex> getLock() const
         {
@@ -346,8 +418,30 @@ namespace KayLib
 
         XMLDocument(const std::string &doc)
         {
-            resetError();
-            parse(doc);
+            XMLReader reader(doc.data(), doc.length());
+            parse(reader);
+        }
+
+        /**
+         * Create a document from characters owned by the caller, such as a
+         * KMappedFile, without copying them.
+         * @param doc The characters containing the document to parse.
+         * @param length The number of characters.
+         */
+        XMLDocument(const char *doc, size_t length)
+        {
+            XMLReader reader(doc, length);
+            parse(reader);
+        }
+
+        /**
+         * Create a document from a source, such as a stream, read a window at a time.
+         * @param source The source.
+         */
+        XMLDocument(StringSource<char> &source)
+        {
+            XMLReader reader(source);
+            parse(reader);
         }
 
         XMLDocument(const XMLDocument& orig)
@@ -413,11 +507,38 @@ namespace KayLib
          * Get the parser index of the last error.
          * @return The index of the error.
          */
-        int getErrorIndex()
+        long getErrorIndex()
         {
             return errorIndex;
         }
 
+        /**
+         * Get the line of the last parse error.
+         * @return The line, starting at 1, or -1.
+         */
+        long getErrorLine()
+        {
+            return errorLine;
+        }
+
+        /**
+         * Get the column of the last parse error.
+         * @return The column, starting at 1, or -1.
+         */
+        long getErrorColumn()
+        {
+            return errorColumn;
+        }
+
+        /**
+         * Get the text around the last parse error.
+         * @return The part of the line the error is on.
+         */
+        std::string getErrorExcerpt()
+        {
+            return errorExcerpt;
+        }
+
         /**
          * Reset the error code.
          */
@@ -425,262 +546,71 @@ namespace KayLib
         {
             lastError = XMLError::NONE;
             errorIndex = -1;
+            errorLine = -1;
+            errorColumn = -1;
+            errorExcerpt.clear();
         }
 
     private:
         std::shared_ptr<XMLElement> root;
         XMLError lastError;
-        int errorIndex;
+        long errorIndex;
+        long errorLine;
+        long errorColumn;
+        std::string errorExcerpt;
 
-        bool parse(const std::string &doc)
+        /**
+         * Build the elements from the events of a reader.
+         * @param reader The reader.
+         * @return False if the document is not valid.
+         */
+        bool parse(XMLReader &reader)
         {
             resetError();
             root = std::make_shared<XMLElement>("", "");
-            StringParser<char> parser(doc);
-            while(!parser.isEnd())
-            {
-                parser.skipWhitespace(true);
-                if(parser.isEnd())
-                {
-                    // Apparently there is no root element.
-                    break;
-                }
-                if(parser.peekChar() != '<')
-                {
-                    // Invalid XML
-                    lastError = XMLError::InvalidSyntax;
-                    errorIndex = parser.getIndex();
-                    return false;
-                }
-                std::shared_ptr<XMLElement> element = parseElement<char>(parser);
-                if(!element)
-                {
-                    // Error!
-                    return false;
-                }
-                root->addChild(element);
-                std::string tag = element->getName();
-                if(tag.length() == 0)
-                {
-                    // Invalid XML.
-                    lastError = XMLError::InvalidSyntax;
-                    errorIndex = parser.getIndex();
-                    return false;
-                }
-                if(tag == "!--")
-                {
-                    // We have a comment.
-                    continue;
-                }
-                if(tag == "?xml")
-                {
-                    // We have a declaration.
-                    continue;
-                }
-                if(tag == "xs:schema")
-                {
-                    // We have a schema.
-                    continue;
-                }
-                if(tag[0] == '!')
-                {
-                    // We have a dtd header.
-                    continue;
-                }
-            }
-
-            return true;
-        }
-
-        template<typename T>
-        std::shared_ptr<XMLElement> parseElement(StringParser<T> &parser)
-        {
-            // Make sure we are at the next tag.
-            parser.skipWhitespace(true);
+            // The open elements and the text of each.
+            std::vector<std::shared_ptr<XMLElement>> open = {root};
+            std::vector<std::string> values(1);
             std::shared_ptr<XMLElement> element;
-            if(parser.nextIs("<?xml", true))
-            {
-                // Found declaration.
-                element = parseDeclaration(parser);
-            }
-            else if(parser.nextIs("<!--", true))
-            {
-                // Found comment.
-                element = parseComment(parser);
-            }
-            else if(parser.nextIs("<", true))
-            {
-                element = parseGeneric(parser);
-            }
-            return element;
-        }
-
-        template<typename T>
-        std::shared_ptr<XMLElement> parseComment(StringParser<T> &parser)
-        {
-            std::shared_ptr<XMLElement> element;
-            int start = parser.getIndex();
-            int end = start;
-            while(!parser.nextIs("--", true))
-            {
-                T c;
-                while((c = parser.peekChar()) != '-' && !parser.isEnd())
-                {
-                    parser.getChar();
-                }
-                if(parser.isEnd())
-                {
-                    lastError = XMLError::UnexpectedEndOfDocument;
-                    errorIndex = parser.getIndex();
-                    return element;
-                }
-                //parser.back();
-            }
-            if(parser.isEnd())
-            {
-                lastError = XMLError::UnexpectedEndOfDocument;
-                errorIndex = parser.getIndex();
-                return element;
-            }
-            if(parser.peekChar() != '>')
-            {
-                lastError = XMLError::DoubleDashInComment;
-                errorIndex = parser.getIndex();
-                return element;
-            }
-            parser.skip(1);
-            end = parser.getIndex() - 3;
-            std::string comment = parser.getRange(start, (end - start));
-            element = std::make_shared<XMLElement>("!--", comment);
-            return element;
-        }
-
-        template<typename T>
-        std::shared_ptr<XMLElement> parseDeclaration(StringParser<T> &parser)
-        {
-            std::shared_ptr<XMLElement> element = std::make_shared<XMLElement>("?xml", "");
-            while(!parser.nextIs("?", true) && !parser.isEnd())
-            {
-                if(!parseAttribute(parser, element))
-                {
-                    lastError = XMLError::InvalidSyntax;
-                    errorIndex = parser.getIndex();
-                    element.reset();
-                    return element;
-                }
-                parser.skipWhitespace(true);
-            }
-            if(parser.isEnd())
-            {
-                lastError = XMLError::UnexpectedEndOfDocument;
-                errorIndex = parser.getIndex();
-                element.reset();
-                return element;
-            }
-            if(parser.peekChar() != '>')
-            {
-                lastError = XMLError::InvalidSyntax;
-                errorIndex = parser.getIndex();
-                element.reset();
-                return element;
-            }
-            parser.skip(1);
-            return element;
-        }
-
-        template<typename T>
-        std::basic_string<T> getName(StringParser<T> &parser)
-        {
-            std::basic_string<T> name;
-            while(!parser.isWhitespace(true) && parser.peekChar() != '>' && parser.peekChar() != '=' && !parser.isEnd())
-            {
-                name += parser.getChar();
-            }
-            return name;
-        }
-        
-        template<typename T>
-        std::shared_ptr<XMLElement> parseGeneric(StringParser<T> &parser)
-        {
-            std::basic_string<T> tag = getName(parser);
-            std::shared_ptr<XMLElement> element = std::make_shared<XMLElement>(tag, "");
-            T c = parser.peekChar();
-            while((c != '>' && c != '/') && !parser.isEnd())
+            XMLEvent event;
+            while((event = reader.next()) != XMLEvent::EndDocument)
             {
-                if(!parseAttribute(parser, element))
+                switch(event)
                 {
-                    lastError = XMLError::InvalidSyntax;
-                    errorIndex = parser.getIndex();
-                    element.reset();
-                    return element;
+                    case XMLEvent::StartElement:
+                        element = std::make_shared<XMLElement>(reader.getName(), "");
+                        open.back()->addChild(element);
+                        open.push_back(element);
+                        values.emplace_back();
+                        break;
+                    case XMLEvent::Declaration:
+                        element = std::make_shared<XMLElement>(reader.getName(), "");
+                        open.back()->addChild(element);
+                        break;
+                    case XMLEvent::Attribute:
+                        element->addAttribute(reader.getName(), reader.getValue());
+                        break;
+                    case XMLEvent::Text:
+                        values.back().append(reader.getValueView().data(), reader.getValueView().length());
+                        break;
+                    case XMLEvent::Comment:
+                        open.back()->addChild(std::make_shared<XMLElement>("!--", reader.getValue()));
+                        break;
+                    case XMLEvent::EndElement:
+                        open.back()->setValue(std::move(values.back()));
+                        open.pop_back();
+                        values.pop_back();
+                        break;
+                    default:
+                        lastError = reader.getError();
+                        errorIndex = reader.getErrorIndex();
+                        errorLine = reader.getErrorLine();
+                        errorColumn = reader.getErrorColumn();
+                        errorExcerpt = reader.getErrorExcerpt();
+                        root.reset();
+                        return false;
                 }
-                parser.skipWhitespace(true);
-                c = parser.peekChar();
-            }
-            if(parser.isEnd())
-            {
-                lastError = XMLError::UnexpectedEndOfDocument;
-                errorIndex = parser.getIndex();
-                element.reset();
-                return element;
-            }
-            if(parser.nextIs("/>", true))
-            {
-                // A complete tag.
-                return element;
-            }
-            if(parser.peekChar() != '>')
-            {
-                lastError = XMLError::InvalidSyntax;
-                errorIndex = parser.getIndex();
-                element.reset();
-                return element;
-            }
-            parser.skip(1);
-            // An incomplete element.
-            parser.skipWhitespace(true);
-            std::basic_string<T> endTag = "</" + tag + ">";
-            std::basic_string<T> value;
-            while(!parser.nextIs(endTag, true))
-            {
-                if(parser.peekChar() == '<')
-                {
-                    std::shared_ptr<XMLElement> child = parseElement(parser);
-                    element->addChild(child);
-                    parser.skipWhitespace(true);
-                }
-                else
-                {
-                    value += parser.getTo('<');
-                }
-            }
-            element->setValue(value);
-            return element;
-        }
-
-        template<typename T>
-        bool parseAttribute(StringParser<T> &parser, std::shared_ptr<XMLElement> element)
-        {
-            parser.skipWhitespace(true);
-            std::basic_string<T> attrName = getName(parser);
-            if(attrName.length() == 0)
-            {
-                return false;
-            }
-            if(parser.peekChar() != '=')
-            {
-                return false;
-            }
-            parser.skip(1);
-            parser.skipWhitespace(true);
-            T c = parser.peekChar();
-            if(c != '\'' && c != '"')
-            {
-                return false;
             }
-            std::basic_string<T> attrValue = parser.getQuotedString();
-            element->addAttribute(attrName, attrValue);
-            parser.skipWhitespace(true);
             return true;
         }
     };
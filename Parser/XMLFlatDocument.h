@@ -0,0 +1,545 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef XMLFLATDOCUMENT_H
+#define XMLFLATDOCUMENT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../IO/Exceptions.h"
+#include "../Utility/KArena.h"
+#include "XMLReader.h"
+#include "XMLSymbols.h"
+
+namespace KayLib
+{
+
+    enum class XMLNodeType : uint8_t
+    {
+        // None is the type of a node that does not exist.
+        Document, Element, Text, Comment, Declaration, None
+    };
+
+    /**
+     * A read only XML document stored as flat arrays of nodes and attributes that
+     * refer to each other by position, instead of a tree of separately allocated
+     * elements.  Tag and attribute names are interned in a symbol table, so each
+     * name is stored once and compared as a number.  Text, comments and attribute
+     * values are views into the document text, which must exist as long as the
+     * document when it is owned by the caller.  Text read from a StringSource is
+     * copied into an arena owned by the document.
+     * The text of an element that comes before any child is kept in the element
+     * itself.  Only text that follows a child or comment is a Text node.
+     * @note Text and attribute values are not unescaped, as in XMLDocument.
+     */
+    class XMLFlatDocument
+    {
+    private:
+
+        struct NodeData
+        {
+            StringToken<char> value;
+            uint32_t name;
+            uint32_t parent;
+            uint32_t firstChild;
+            uint32_t nextSibling;
+            uint32_t firstAttribute;
+            uint32_t attributeCount;
+            XMLNodeType type;
+        };
+
+        struct AttributeData
+        {
+            StringToken<char> value;
+            uint32_t name;
+        };
+
+    public:
+
+        // The position of a node that does not exist.
+        static const uint32_t NONE = 0xFFFFFFFF;
+
+        /**
+         * A node of the document.  Nodes are small handles that are passed by
+         * value and are valid as long as the document exists.  A node that does
+         * not exist has no name, value, children or attributes.
+         */
+        class Node
+        {
+        public:
+
+            Node() : doc(nullptr), pos(NONE) { }
+
+            Node(const XMLFlatDocument *document, uint32_t position) : doc(document), pos(position) { }
+
+            /**
+             * Check if the node exists.
+             * @return True if the node exists.
+             */
+            explicit operator bool() const
+            {
+                return doc != nullptr && pos != NONE;
+            }
+
+            bool operator==(const Node &other) const
+            {
+                return doc == other.doc && pos == other.pos;
+            }
+
+            bool operator!=(const Node &other) const
+            {
+                return !(*this == other);
+            }
+
+            /**
+             * Get the position of the node in the document.
+             * @return The position, nodes are numbered in document order.
+             */
+            uint32_t getPosition() const
+            {
+                return pos;
+            }
+
+            XMLNodeType getType() const
+            {
+                return data().type;
+            }
+
+            /**
+             * Get the name of an element or declaration.
+             * @return The name, empty for other nodes.
+             */
+            StringToken<char> getName() const
+            {
+                return *this ? doc->symbols.getName(data().name) : StringToken<char>();
+            }
+
+            /**
+             * Get the interned name of an element or declaration.
+             * @return The symbol or XMLSymbols::NONE.
+             */
+            uint32_t getSymbol() const
+            {
+                return data().name;
+            }
+
+            /**
+             * Get the text of a text or comment node, or the text of an element before its first child.
+             * @return The text.
+             */
+            StringToken<char> getValue() const
+            {
+                return data().value;
+            }
+
+            Node getParent() const
+            {
+                return Node(doc, data().parent);
+            }
+
+            /**
+             * Get the first child of any type.
+             * @return The child or a node that does not exist.
+             */
+            Node getFirstChild() const
+            {
+                return Node(doc, data().firstChild);
+            }
+
+            /**
+             * Get the next node with the same parent.
+             * @return The node or a node that does not exist.
+             */
+            Node getNextSibling() const
+            {
+                return Node(doc, data().nextSibling);
+            }
+
+            /**
+             * Get the first child element with the specified tag name.
+             * @param tag The tag to find.
+             * @param length The length of the tag.
+             * @return The element or a node that does not exist.
+             */
+            Node getFirstChild(const char *tag, size_t length) const
+            {
+                if(!*this)
+                {
+                    return Node();
+                }
+                return findElement(data().firstChild, doc->symbols.find(tag, length));
+            }
+
+            Node getFirstChild(const std::string &tag) const
+            {
+                return getFirstChild(tag.data(), tag.length());
+            }
+
+            /**
+             * Get the next element with the same parent and the same tag name.
+             * @return The element or a node that does not exist.
+             */
+            Node getNextNamedSibling() const
+            {
+                return findElement(data().nextSibling, data().name);
+            }
+
+            /**
+             * Get all child elements with the specified tag name.
+             * @param tag The tag to find.
+             * @return The list of elements.
+             */
+            std::vector<Node> getChildren(const std::string &tag) const
+            {
+                std::vector<Node> children;
+                for(Node child = getFirstChild(tag); child; child = child.getNextNamedSibling())
+                {
+                    children.push_back(child);
+                }
+                return children;
+            }
+
+            size_t getAttributeCount() const
+            {
+                return data().attributeCount;
+            }
+
+            /**
+             * Get the name of an attribute.
+             * @param i The attribute, from 0 to getAttributeCount() - 1.
+             * @return The name.
+             */
+            StringToken<char> getAttributeName(size_t i) const
+            {
+                return doc->symbols.getName(doc->attributes[data().firstAttribute + i].name);
+            }
+
+            /**
+             * Get the value of an attribute.
+             * @param i The attribute, from 0 to getAttributeCount() - 1.
+             * @return The value.
+             */
+            StringToken<char> getAttributeValue(size_t i) const
+            {
+                return doc->attributes[data().firstAttribute + i].value;
+            }
+
+            /**
+             * Check if the node has the named attribute.
+             * @param attr The attribute to check for.
+             * @return True if the attribute exists.
+             */
+            bool hasAttribute(const std::string &attr) const
+            {
+                return findAttribute(attr) != nullptr;
+            }
+
+            /**
+             * Get the value of the attribute.
+             * @param attr The attribute to get.
+             * @return The value of the attribute.
+             * @throws AttributeNotFoundException
+             */
+            StringToken<char> getAttribute(const std::string &attr) const
+            {
+                const AttributeData *found = findAttribute(attr);
+                if(found == nullptr)
+                {
+                    throw AttributeNotFoundException(attr);
+                }
+                return found->value;
+            }
+
+        private:
+            const XMLFlatDocument *doc;
+            uint32_t pos;
+
+            const NodeData &data() const
+            {
+                static const NodeData none = {StringToken<char>(), XMLSymbols::NONE, NONE, NONE, NONE, 0, 0, XMLNodeType::None};
+                return *this ? doc->nodes[pos] : none;
+            }
+
+            Node findElement(uint32_t from, uint32_t name) const
+            {
+                if(name == XMLSymbols::NONE)
+                {
+                    return Node();
+                }
+                for(uint32_t node = from; node != NONE; node = doc->nodes[node].nextSibling)
+                {
+                    if(doc->nodes[node].name == name && doc->nodes[node].type == XMLNodeType::Element)
+                    {
+                        return Node(doc, node);
+                    }
+                }
+                return Node();
+            }
+
+            const AttributeData *findAttribute(const std::string &attr) const
+            {
+                if(!*this)
+                {
+                    return nullptr;
+                }
+                uint32_t name = doc->symbols.find(attr);
+                const NodeData &node = data();
+                for(uint32_t i = 0; i < node.attributeCount && name != XMLSymbols::NONE; i++)
+                {
+                    if(doc->attributes[node.firstAttribute + i].name == name)
+                    {
+                        return &doc->attributes[node.firstAttribute + i];
+                    }
+                }
+                return nullptr;
+            }
+        };
+
+        /**
+         * Create a document from a string.
+         * @param doc The document, the document keeps its own copy.
+         */
+        XMLFlatDocument(const std::string &doc) : owned(doc)
+        {
+            XMLReader reader(owned.data(), owned.length());
+            parse(reader, false);
+        }
+
+        /**
+         * Create a document from characters owned by the caller, such as a
+         * KMappedFile, without copying them.
+         * @param doc The characters.  They must exist, unchanged, as long as the document.
+         * @param length The number of characters.
+         */
+        XMLFlatDocument(const char *doc, size_t length)
+        {
+            XMLReader reader(doc, length);
+            parse(reader, false);
+        }
+
+        /**
+         * Create a document from a source, such as a stream, read a window at a time.
+         * @param source The source.
+         */
+        XMLFlatDocument(StringSource<char> &source)
+        {
+            XMLReader reader(source);
+            parse(reader, true);
+        }
+
+        XMLFlatDocument(const XMLFlatDocument &orig) = delete;
+
+        XMLFlatDocument &operator=(const XMLFlatDocument &orig) = delete;
+
+        virtual ~XMLFlatDocument() { }
+
+        /**
+         * Get the document node, the parent of the top level elements.
+         * @return The node, it does not exist if the document is not valid.
+         */
+        Node getRoot() const
+        {
+            return Node(this, nodes.empty() ? NONE : 0);
+        }
+
+        /**
+         * Get a node by position.
+         * @param position The position, from 0 to getNodeCount() - 1.
+         * @return The node.
+         */
+        Node getNode(uint32_t position) const
+        {
+            return Node(this, position);
+        }
+
+        size_t getNodeCount() const
+        {
+            return nodes.size();
+        }
+
+        /**
+         * Get the table of tag and attribute names.
+         * @return The table.
+         */
+        const XMLSymbols &getSymbols() const
+        {
+            return symbols;
+        }
+
+        /**
+         * Get the memory used by the document, not counting the document text when it is owned by the caller.
+         * @return The number of bytes.
+         */
+        size_t getBytesUsed() const
+        {
+            return nodes.capacity() * sizeof (NodeData) + attributes.capacity() * sizeof (AttributeData)
+                    + symbols.getBytesUsed() + arena.getBytesReserved() + owned.capacity();
+        }
+
+        XMLError getError() const
+        {
+            return lastError;
+        }
+
+        long getErrorIndex() const
+        {
+            return errorIndex;
+        }
+
+        long getErrorLine() const
+        {
+            return errorLine;
+        }
+
+        long getErrorColumn() const
+        {
+            return errorColumn;
+        }
+
+        const std::string &getErrorExcerpt() const
+        {
+            return errorExcerpt;
+        }
+
+    private:
+        std::string owned;
+        // Text copied from a StringSource.
+        KArena arena;
+        XMLSymbols symbols;
+        std::vector<NodeData> nodes;
+        std::vector<AttributeData> attributes;
+        XMLError lastError;
+        long errorIndex;
+        long errorLine;
+        long errorColumn;
+        std::string errorExcerpt;
+
+        /**
+         * Build the nodes from the events of a reader.
+         * @param reader The reader.
+         * @param copy True if text must be copied into the arena.
+         * @return False if the document is not valid.
+         */
+        bool parse(XMLReader &reader, bool copy)
+        {
+            lastError = XMLError::NONE;
+            errorIndex = -1;
+            errorLine = -1;
+            errorColumn = -1;
+            addNode(XMLNodeType::Document, XMLSymbols::NONE, StringToken<char>(), NONE);
+            // The open nodes and the last child added to each.
+            std::vector<uint32_t> open = {0};
+            std::vector<uint32_t> last = {NONE};
+            uint32_t current = 0;
+            XMLEvent event;
+            while((event = reader.next()) != XMLEvent::EndDocument)
+            {
+                switch(event)
+                {
+                    case XMLEvent::StartElement:
+                    case XMLEvent::Declaration:
+                        current = addNode(event == XMLEvent::StartElement ? XMLNodeType::Element : XMLNodeType::Declaration,
+                                          intern(reader.getNameView()), StringToken<char>(), open.back(), last.back());
+                        last.back() = current;
+                        if(event == XMLEvent::StartElement)
+                        {
+                            // It has no children yet.
+                            open.push_back(current);
+                            last.push_back(nodes[current].firstChild);
+                        }
+                        break;
+                    case XMLEvent::Attribute:
+                        if(nodes[current].attributeCount == 0)
+                        {
+                            nodes[current].firstAttribute = (uint32_t) attributes.size();
+                        }
+                        nodes[current].attributeCount++;
+                        attributes.push_back(AttributeData{text(reader.getValueView(), copy), intern(reader.getNameView())});
+                        break;
+                    case XMLEvent::Text:
+                        if(last.back() == NONE)
+                        {
+                            // Text before any child is kept in the element.
+                            nodes[open.back()].value = text(reader.getValueView(), copy);
+                        }
+                        else
+                        {
+                            last.back() = addNode(XMLNodeType::Text, XMLSymbols::NONE, text(reader.getValueView(), copy), open.back(), last.back());
+                        }
+                        break;
+                    case XMLEvent::Comment:
+                        last.back() = addNode(XMLNodeType::Comment, XMLSymbols::NONE, text(reader.getValueView(), copy), open.back(), last.back());
+                        break;
+                    case XMLEvent::EndElement:
+                        open.pop_back();
+                        last.pop_back();
+                        break;
+                    default:
+                        lastError = reader.getError();
+                        errorIndex = reader.getErrorIndex();
+                        errorLine = reader.getErrorLine();
+                        errorColumn = reader.getErrorColumn();
+                        errorExcerpt = reader.getErrorExcerpt();
+                        nodes.clear();
+                        attributes.clear();
+                        return false;
+                }
+            }
+            nodes.shrink_to_fit();
+            attributes.shrink_to_fit();
+            return true;
+        }
+
+        /**
+         * Add a node as the last child of its parent.
+         * @param previous The current last child of the parent or NONE.
+         * @return The position of the node.
+         */
+        uint32_t addNode(XMLNodeType type, uint32_t name, StringToken<char> value, uint32_t parent, uint32_t previous = NONE)
+        {
+            uint32_t pos = (uint32_t) nodes.size();
+            nodes.push_back(NodeData{value, name, parent, NONE, NONE, 0, 0, type});
+            if(previous != NONE)
+            {
+                nodes[previous].nextSibling = pos;
+            }
+            else if(parent != NONE)
+            {
+                nodes[parent].firstChild = pos;
+            }
+            return pos;
+        }
+
+        uint32_t intern(StringToken<char> name)
+        {
+            return symbols.intern(name.data(), name.length());
+        }
+
+        StringToken<char> text(StringToken<char> value, bool copy)
+        {
+            if(!copy)
+            {
+                return value;
+            }
+            return StringToken<char>(arena.copyString(value.data(), value.length()), value.length());
+        }
+    };
+
+}
+
+#endif /* XMLFLATDOCUMENT_H */
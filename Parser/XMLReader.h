@@ -0,0 +1,539 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef XMLREADER_H
+#define XMLREADER_H
+
+#include <string>
+#include <vector>
+
+#include "StringParser.h"
+
+namespace KayLib
+{
+
+    enum class XMLError
+    {
+        NONE, UnexpectedEndOfDocument, InvalidSyntax, DoubleDashInComment
+    };
+
+    std::string XMLErrorString(XMLError err)
+    {
+        switch(err)
+        {
+            case XMLError::NONE:
+                return "No error";
+                break;
+            case XMLError::UnexpectedEndOfDocument:
+                return "Parser reached the end of string without finishing the document";
+                break;
+            case XMLError::InvalidSyntax:
+                return "Invalid syntax";
+                break;
+            case XMLError::DoubleDashInComment:
+                return "Double dash '--' in comment";
+                break;
+        }
+        return "Unknown error";
+    }
+
+    /**
+     * The events returned by XMLReader::next.
+     */
+    enum class XMLEvent
+    {
+        // An element was opened, getName is its name.
+        StartElement,
+        // An attribute of the last element or declaration, getName and getValue are its name and value.
+        Attribute,
+        // Text inside an element, getValue is the text as it appears in the document.
+        Text,
+        // An element was closed, getName is its name.  Also returned for empty elements such as <a/>.
+        EndElement,
+        // A comment, getValue is its text.
+        Comment,
+        // The <?xml ?> declaration, followed by its attributes.
+        Declaration,
+        // The end of the document.
+        EndDocument,
+        // The document is not valid, see getError.
+        Error
+    };
+
+    /**
+     * A pull XML reader that returns the parts of a document one at a time,
+     * without building a tree.  It can read from memory, a KMappedFile or a
+     * StringSource read in chunks, and its memory use only depends on the longest
+     * name, text or comment and the deepest nesting, not on the size of the document.
+     * Names and values can be read as views, which point into the document when it
+     * is read from memory, so nothing is copied unless getName or getValue is used.
+     * @note Text and attribute values are not unescaped.  The leading whitespace of
+     * text is skipped, as XMLDocument does.
+     */
+    class XMLReader
+    {
+    public:
+
+        /**
+         * Read a document from a string.
+         * @param doc The document, the reader keeps its own copy.
+         */
+        XMLReader(const std::string &doc) : parser(doc)
+        {
+            reset();
+        }
+
+        /**
+         * Read a document from characters owned by the caller, such as a KMappedFile.
+         * @param doc The characters.  They must not change or be released while the reader is used.
+         * @param length The number of characters.
+         */
+        XMLReader(const char *doc, size_t length) : parser(doc, length)
+        {
+            reset();
+        }
+
+        /**
+         * Read a document from a source, a window of it at a time.
+         * @param source The source.  It must exist while the reader is used.
+         * @param windowSize The number of characters to read at a time.
+         */
+        XMLReader(StringSource<char> &source, size_t windowSize = 64 * 1024) : parser(source, windowSize)
+        {
+            reset();
+        }
+
+        XMLReader(const XMLReader &orig) = delete;
+
+        XMLReader &operator=(const XMLReader &orig) = delete;
+
+        virtual ~XMLReader() { }
+
+        /**
+         * Read the next part of the document.
+         * @return The event.  Once EndDocument or Error is returned it is returned for every later call.
+         */
+        XMLEvent next()
+        {
+            if(closed)
+            {
+                // Remove the element that was ended by the last event.
+                open.resize(starts.back());
+                starts.pop_back();
+                closed = false;
+            }
+            switch(state)
+            {
+                case State::CONTENT:
+                    return nextInContent();
+                case State::TAG:
+                    return nextInTag();
+                case State::DECLARATION:
+                    return nextInDeclaration();
+                case State::DONE:
+                    return XMLEvent::EndDocument;
+                case State::ERROR:
+                    break;
+            }
+            return XMLEvent::Error;
+        }
+
+        /**
+         * Skip the rest of the element that was just started, including its children.
+         * @return False if the document is not valid.
+         */
+        bool skipElement()
+        {
+            size_t depth = getDepth();
+            if(depth == 0)
+            {
+                return true;
+            }
+            XMLEvent event;
+            while((event = next()) != XMLEvent::Error)
+            {
+                if(event == XMLEvent::EndElement && getDepth() < depth)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Get the name of the current element, attribute or declaration.
+         * @return The name.
+         */
+        const std::string &getName() const
+        {
+            if(!nameCopied)
+            {
+                name.assign(nameView.data(), nameView.length());
+                nameCopied = true;
+            }
+            return name;
+        }
+
+        /**
+         * Get the name of the current element, attribute or declaration without copying it.
+         * @return The name.  It is only valid until the next call to next().
+         */
+        StringToken<char> getNameView() const
+        {
+            return nameView;
+        }
+
+        /**
+         * Get the value of the current attribute, text or comment.
+         * @return The value.
+         */
+        const std::string &getValue() const
+        {
+            if(!valueCopied)
+            {
+                value.assign(valueView.data(), valueView.length());
+                valueCopied = true;
+            }
+            return value;
+        }
+
+        /**
+         * Get the value of the current attribute, text or comment without copying it.
+         * @return The value.  When the document is read from memory it points into the
+         * document, otherwise it is only valid until the next call to next().
+         */
+        StringToken<char> getValueView() const
+        {
+            return valueView;
+        }
+
+        /**
+         * Get the number of elements that are open.
+         * @return The depth, 0 at the top of the document.
+         */
+        size_t getDepth() const
+        {
+            return starts.size() - (closed ? 1 : 0);
+        }
+
+        /**
+         * Get the index of the reader in the document.
+         * @return The index, just past the current event.
+         */
+        long getIndex() const
+        {
+            return parser.getIndex();
+        }
+
+        /**
+         * Get the error that stopped the reader.
+         * @return The error code.
+         */
+        XMLError getError() const
+        {
+            return lastError;
+        }
+
+        /**
+         * Get the index of the error in the document.
+         * @return The index or -1.
+         */
+        long getErrorIndex() const
+        {
+            return errorIndex;
+        }
+
+        /**
+         * Get the line of the error.
+         * @return The line, starting at 1, or -1.
+         */
+        long getErrorLine() const
+        {
+            return errorLine;
+        }
+
+        /**
+         * Get the column of the error.
+         * @return The column, starting at 1, or -1.
+         */
+        long getErrorColumn() const
+        {
+            return errorColumn;
+        }
+
+        /**
+         * Get the text around the error.
+         * @return The part of the line the error is on.
+         */
+        const std::string &getErrorExcerpt() const
+        {
+            return errorExcerpt;
+        }
+
+    private:
+
+        enum class State
+        {
+            // Between tags.
+            CONTENT,
+            // Reading the attributes of an element.
+            TAG,
+            // Reading the attributes of a declaration.
+            DECLARATION,
+            DONE,
+            ERROR
+        };
+
+        StringParser<char> parser;
+        State state;
+        StringToken<char> nameView;
+        StringToken<char> valueView;
+        // Copies of the views, made when they are asked for.
+        mutable std::string name;
+        mutable std::string value;
+        mutable bool nameCopied;
+        mutable bool valueCopied;
+        std::string attributeName;
+        // The names of the open elements, one after another, and where each starts.
+        std::string open;
+        std::vector<size_t> starts;
+        // True if the last element in 'open' was ended by the last event.
+        bool closed;
+        XMLError lastError;
+        long errorIndex;
+        long errorLine;
+        long errorColumn;
+        std::string errorExcerpt;
+
+        void reset()
+        {
+            state = State::CONTENT;
+            nameCopied = true;
+            valueCopied = true;
+            closed = false;
+            lastError = XMLError::NONE;
+            errorIndex = -1;
+            errorLine = -1;
+            errorColumn = -1;
+        }
+
+        XMLEvent setError(XMLError error)
+        {
+            return setError(error, parser.getIndex());
+        }
+
+        XMLEvent setError(XMLError error, long index)
+        {
+            state = State::ERROR;
+            lastError = error;
+            errorIndex = index;
+            errorLine = parser.getLine(errorIndex);
+            errorColumn = parser.getColumn(errorIndex);
+            errorExcerpt = parser.getExcerpt(errorIndex);
+            return XMLEvent::Error;
+        }
+
+        void setName(StringToken<char> view)
+        {
+            nameView = view;
+            nameCopied = false;
+        }
+
+        void setValue(StringToken<char> view)
+        {
+            valueView = view;
+            valueCopied = false;
+        }
+
+        XMLEvent nextInContent()
+        {
+            // Text starts after the whitespace following a tag or comment.
+            parser.skipWhitespace(true);
+            if(parser.isEnd())
+            {
+                if(!starts.empty())
+                {
+                    return setError(XMLError::UnexpectedEndOfDocument);
+                }
+                state = State::DONE;
+                return XMLEvent::EndDocument;
+            }
+            if(parser.peekChar() != '<')
+            {
+                if(starts.empty())
+                {
+                    return setError(XMLError::InvalidSyntax);
+                }
+                setValue(parser.viewTo('<'));
+                return XMLEvent::Text;
+            }
+            if(parser.nextIs("<?xml", true))
+            {
+                setName(StringToken<char>("?xml", 4));
+                state = State::DECLARATION;
+                return XMLEvent::Declaration;
+            }
+            if(parser.nextIs("<!--", true))
+            {
+                return readComment();
+            }
+            if(parser.nextIs("</", true))
+            {
+                return readEndTag();
+            }
+            parser.skip(1);
+            if(!readName())
+            {
+                return setError(XMLError::InvalidSyntax);
+            }
+            starts.push_back(open.length());
+            open.append(nameView.data(), nameView.length());
+            state = State::TAG;
+            return XMLEvent::StartElement;
+        }
+
+        XMLEvent nextInTag()
+        {
+            parser.skipWhitespace(true);
+            if(parser.isEnd())
+            {
+                return setError(XMLError::UnexpectedEndOfDocument);
+            }
+            if(parser.nextIs("/>", true))
+            {
+                // An empty element.
+                return endElement();
+            }
+            if(parser.peekChar() == '>')
+            {
+                parser.skip(1);
+                state = State::CONTENT;
+                return nextInContent();
+            }
+            if(parser.peekChar() == '/')
+            {
+                return setError(XMLError::InvalidSyntax);
+            }
+            return readAttribute();
+        }
+
+        XMLEvent nextInDeclaration()
+        {
+            parser.skipWhitespace(true);
+            if(parser.isEnd())
+            {
+                return setError(XMLError::UnexpectedEndOfDocument);
+            }
+            if(!parser.nextIs("?", true))
+            {
+                return readAttribute();
+            }
+            if(parser.peekChar() != '>')
+            {
+                return setError(parser.isEnd() ? XMLError::UnexpectedEndOfDocument : XMLError::InvalidSyntax);
+            }
+            parser.skip(1);
+            state = State::CONTENT;
+            return nextInContent();
+        }
+
+        XMLEvent readAttribute()
+        {
+            if(!readName() || parser.peekChar() != '=')
+            {
+                return setError(XMLError::InvalidSyntax);
+            }
+            // Reading the value may move the window, so the name is kept.
+            attributeName.assign(nameView.data(), nameView.length());
+            setName(StringToken<char>(attributeName.data(), attributeName.length()));
+            parser.skip(1);
+            parser.skipWhitespace(true);
+            char c = parser.peekChar();
+            if(c != '\'' && c != '"')
+            {
+                return setError(XMLError::InvalidSyntax);
+            }
+            setValue(parser.viewQuotedString());
+            return XMLEvent::Attribute;
+        }
+
+        XMLEvent readComment()
+        {
+            long start = parser.getIndex();
+            StringToken<char> comment = parser.viewToString("-->");
+            if(!parser.nextIs("-->", true))
+            {
+                return setError(XMLError::UnexpectedEndOfDocument);
+            }
+            // "--" can not be in a comment, or just before its end.
+            const char *text = comment.data();
+            size_t length = comment.length();
+            for(size_t i = 0; i < length; i++)
+            {
+                if(text[i] == '-' && (i + 1 == length || text[i + 1] == '-'))
+                {
+                    return setError(XMLError::DoubleDashInComment, start + i + 2);
+                }
+            }
+            setValue(comment);
+            return XMLEvent::Comment;
+        }
+
+        XMLEvent readEndTag()
+        {
+            if(starts.empty())
+            {
+                return setError(XMLError::InvalidSyntax);
+            }
+            readName();
+            if(nameView.length() != open.length() - starts.back() || open.compare(starts.back(), std::string::npos, nameView.data(), nameView.length()) != 0)
+            {
+                // Not the element that is open.
+                return setError(XMLError::InvalidSyntax);
+            }
+            parser.skipWhitespace(true);
+            if(parser.peekChar() != '>')
+            {
+                return setError(parser.isEnd() ? XMLError::UnexpectedEndOfDocument : XMLError::InvalidSyntax);
+            }
+            parser.skip(1);
+            return endElement();
+        }
+
+        XMLEvent endElement()
+        {
+            // The element is removed by the next call, so the name stays valid until then.
+            setName(StringToken<char>(open.data() + starts.back(), open.length() - starts.back()));
+            closed = true;
+            state = State::CONTENT;
+            return XMLEvent::EndElement;
+        }
+
+        /**
+         * Read a name, ending at whitespace, '>', '/', '=' or the end of the document.
+         * @return False if the name is empty.
+         */
+        bool readName()
+        {
+            static const std::string separators = ">/=";
+            setName(parser.viewToAny(separators));
+            return !nameView.empty();
+        }
+    };
+
+}
+
+#endif /* XMLREADER_H */
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef XMLSYMBOLS_H
+#define XMLSYMBOLS_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../Utility/KArena.h"
+#include "StringParser.h"
+
+namespace KayLib
+{
+
+    /**
+     * A table of interned names.  Every distinct name is stored once and is
+     * known by a small number, so tag and attribute names can be compared and
+     * stored as numbers.  Names are found through an open addressing hash table.
+     * @note The table is not thread safe while names are added.
+     */
+    class XMLSymbols
+    {
+    public:
+
+        // The symbol of a name that is not in the table.
+        static const uint32_t NONE = 0xFFFFFFFF;
+
+        XMLSymbols() : arena(4096) { }
+
+        XMLSymbols(const XMLSymbols &orig) = delete;
+
+        XMLSymbols &operator=(const XMLSymbols &orig) = delete;
+
+        virtual ~XMLSymbols() { }
+
+        /**
+         * Get the symbol of a name, adding the name if it is new.
+         * @param name The name.
+         * @param length The length of the name.
+         * @return The symbol.
+         */
+        uint32_t intern(const char *name, size_t length)
+        {
+            uint64_t h = hash(name, length);
+            uint32_t symbol = find(name, length, h);
+            if(symbol != NONE)
+            {
+                return symbol;
+            }
+            symbol = (uint32_t) symbols.size();
+            symbols.push_back(Symbol{arena.copyString(name, length), (uint32_t) length, h});
+            if(symbols.size() * 2 > slots.size())
+            {
+                rebuild();
+            }
+            else
+            {
+                place(symbol);
+            }
+            return symbol;
+        }
+
+        uint32_t intern(const std::string &name)
+        {
+            return intern(name.data(), name.length());
+        }
+
+        /**
+         * Find the symbol of a name without adding it.
+         * @param name The name.
+         * @param length The length of the name.
+         * @return The symbol or NONE if the name is not in the table.
+         */
+        uint32_t find(const char *name, size_t length) const
+        {
+            return find(name, length, hash(name, length));
+        }
+
+        uint32_t find(const std::string &name) const
+        {
+            return find(name.data(), name.length());
+        }
+
+        /**
+         * Get the name of a symbol.
+         * @param symbol The symbol.
+         * @return The name, it exists as long as the table does.  Empty for NONE.
+         */
+        StringToken<char> getName(uint32_t symbol) const
+        {
+            if(symbol >= symbols.size())
+            {
+                return StringToken<char>();
+            }
+            return StringToken<char>(symbols[symbol].name, symbols[symbol].length);
+        }
+
+        /**
+         * Get the number of names in the table.
+         * @return The number of names.
+         */
+        size_t size() const
+        {
+            return symbols.size();
+        }
+
+        /**
+         * Get the memory used by the table.
+         * @return The number of bytes.
+         */
+        size_t getBytesUsed() const
+        {
+            return arena.getBytesReserved() + symbols.capacity() * sizeof (Symbol) + slots.capacity() * sizeof (uint32_t);
+        }
+
+    private:
+
+        struct Symbol
+        {
+            const char *name;
+            uint32_t length;
+            uint64_t hash;
+        };
+
+        KArena arena;
+        std::vector<Symbol> symbols;
+        // Symbols plus one, zero marks an empty slot.
+        std::vector<uint32_t> slots;
+
+        static uint64_t hash(const char *name, size_t length)
+        {
+            // FNV-1a
+            uint64_t h = 14695981039346656037ULL;
+            for(size_t i = 0; i < length; i++)
+            {
+                h ^= (unsigned char) name[i];
+                h *= 1099511628211ULL;
+            }
+            return h;
+        }
+
+        uint32_t find(const char *name, size_t length, uint64_t h) const
+        {
+            if(slots.empty())
+            {
+                return NONE;
+            }
+            size_t mask = slots.size() - 1;
+            for(size_t slot = h & mask;; slot = (slot + 1) & mask)
+            {
+                uint32_t pos = slots[slot];
+                if(pos == 0)
+                {
+                    return NONE;
+                }
+                const Symbol &symbol = symbols[pos - 1];
+                if(symbol.hash == h && symbol.length == length && (length == 0 || std::memcmp(symbol.name, name, length) == 0))
+                {
+                    return pos - 1;
+                }
+            }
+        }
+
+        void place(uint32_t symbol)
+        {
+            size_t mask = slots.size() - 1;
+            size_t slot = symbols[symbol].hash & mask;
+            while(slots[slot] != 0)
+            {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot] = symbol + 1;
+        }
+
+        void rebuild()
+        {
+            size_t capacity = 16;
+            while(capacity < symbols.size() * 2)
+            {
+                capacity *= 2;
+            }
+            slots.assign(capacity, 0);
+            for(uint32_t symbol = 0; symbol < symbols.size(); symbol++)
+            {
+                place(symbol);
+            }
+        }
+    };
+
+}
+
+#endif /* XMLSYMBOLS_H */
@@ -162,6 +162,302 @@ bool testXML()
     return true;
 }
 
+#include <sstream>
+#include "../Parser/XMLReader.h"
+
+/**
+ * Read every event of a document into one line of text.
+ * @param reader The reader.
+ * @return The events, or the error code at the end.
+ */
+std::string readXMLEvents(XMLReader &reader)
+{
+    std::string out;
+    XMLEvent event;
+    while((event = reader.next()) != XMLEvent::EndDocument)
+    {
+        switch(event)
+        {
+            case XMLEvent::StartElement:
+                out += "<" + reader.getName() + std::to_string(reader.getDepth());
+                break;
+            case XMLEvent::Attribute:
+                out += " " + reader.getName() + "=" + reader.getValue();
+                break;
+            case XMLEvent::Text:
+                out += "[" + reader.getValue() + "]";
+                break;
+            case XMLEvent::EndElement:
+                out += "/" + reader.getName() + std::to_string(reader.getDepth());
+                break;
+            case XMLEvent::Comment:
+                out += "!" + reader.getValue();
+                break;
+            case XMLEvent::Declaration:
+                out += "?";
+                break;
+            default:
+                return out + "#" + std::to_string((int) reader.getError()) + "@" + std::to_string(reader.getErrorIndex());
+        }
+    }
+    return out;
+}
+
+bool testXMLReader()
+{
+    std::cout << "XML reader test started..." << std::endl;
+    std::string doc = "<?xml version=\"1.0\"?>\n<a x=\"1\" y='2'>\n  <!-- note - here -->\n  <b>text</b>\n  <c/>\n  <d>\n    <e>skipped</e>\n  </d>\n  tail\n</a>\n";
+    std::string expect = "? version=1.0<a1 x=1 y=2! note - here <b2[text]/b1<c2/c1<d2<e3[skipped]/e2/d1[tail\n]/a0";
+    XMLReader reader(doc);
+    std::string events = readXMLEvents(reader);
+    if(events != expect)
+    {
+        std::cout << "Wrong events: " << events << std::endl;
+        return false;
+    }
+    // Read in small windows, the events must be the same.
+    for(size_t window :{16, 33, 4096})
+    {
+        std::istringstream in(doc);
+        StringStreamSource<char> source(in);
+        XMLReader streamed(source, window);
+        events = readXMLEvents(streamed);
+        if(events != expect)
+        {
+            std::cout << "Wrong events with a window of " << window << ": " << events << std::endl;
+            return false;
+        }
+    }
+    // Skip an element and its children.
+    XMLReader skipping(doc);
+    std::string names;
+    XMLEvent event;
+    while((event = skipping.next()) != XMLEvent::EndDocument && event != XMLEvent::Error)
+    {
+        if(event == XMLEvent::StartElement)
+        {
+            names += skipping.getName();
+            if(skipping.getName() == "d" && !skipping.skipElement())
+            {
+                std::cout << "Failed to skip an element." << std::endl;
+                return false;
+            }
+        }
+    }
+    if(names != "abcd")
+    {
+        std::cout << "Wrong elements after skipping: " << names << std::endl;
+        return false;
+    }
+    // Errors have the same codes as XMLDocument.
+    std::vector<std::pair<std::string, std::string>> errors = {
+        {"<a><b></a>", "<a1<b2#2@9"},
+        {"<a><!-- x -- y --></a>", "<a1#3@12"},
+        {"<a><b>text", "<a1<b2[text]#1@10"},
+        {"<a b=1></a>", "<a1#2@5"},
+        {"text", "#2@0"}
+    };
+    for(auto &error : errors)
+    {
+        XMLReader bad(error.first);
+        events = readXMLEvents(bad);
+        if(events != error.second)
+        {
+            std::cout << "Wrong result for " << error.first << ": " << events << std::endl;
+            return false;
+        }
+        XMLDocument badDoc(error.first);
+        if(badDoc.getError() != bad.getError() || badDoc.getErrorIndex() != bad.getErrorIndex())
+        {
+            std::cout << "XMLDocument reports a different error for " << error.first << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "XML reader test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+#include "../Parser/XMLFlatDocument.h"
+
+/**
+ * Check that a flat document node holds the same as an XMLDocument element.
+ * @return True if they match.
+ */
+bool sameXML(XMLFlatDocument::Node node, const std::shared_ptr<XMLElement> &element)
+{
+    std::string name = node.getName().str();
+    if(node.getType() == XMLNodeType::Comment)
+    {
+        name = "!--";
+    }
+    if(name != element->getName() || node.getValue() != element->getValue())
+    {
+        std::cout << "Node " << name << " does not match element " << element->getName() << std::endl;
+        return false;
+    }
+    for(size_t i = 0; i < node.getAttributeCount(); i++)
+    {
+        if(node.getAttributeValue(i) != element->getAttribute(node.getAttributeName(i).str()))
+        {
+            std::cout << "Attribute " << node.getAttributeName(i).str() << " does not match." << std::endl;
+            return false;
+        }
+    }
+    std::vector<std::shared_ptr<XMLElement>> children = element->getChildren();
+    size_t i = 0;
+    for(XMLFlatDocument::Node child = node.getFirstChild(); child; child = child.getNextSibling())
+    {
+        if(child.getType() == XMLNodeType::Text)
+        {
+            continue;
+        }
+        if(child.getParent() != node || i >= children.size() || !sameXML(child, children[i++]))
+        {
+            return false;
+        }
+    }
+    return i == children.size();
+}
+
+bool testXMLFlat()
+{
+    std::cout << "XML flat document test started..." << std::endl;
+    XMLFlatDocument doc(xmlString);
+    XMLDocument tree(xmlString);
+    if(doc.getError() != XMLError::NONE || !doc.getRoot())
+    {
+        std::cout << "XML error: " << XMLErrorString(doc.getError()) << " at location " << doc.getErrorIndex() << std::endl;
+        return false;
+    }
+    if(!sameXML(doc.getRoot(), tree.getRoot()))
+    {
+        return false;
+    }
+    // Text is not copied.
+    XMLFlatDocument::Node inv = doc.getRoot().getFirstChild("Inventory");
+    XMLFlatDocument::Node date = inv.getFirstChild("Date");
+    std::string source = "<a><b>text</b></a>";
+    XMLFlatDocument borrowed(source.data(), source.length());
+    if(date.getValue() != "1999-12-31" || borrowed.getRoot().getFirstChild("a").getFirstChild("b").getValue().data() != source.data() + 6)
+    {
+        std::cout << "Wrong text." << std::endl;
+        return false;
+    }
+    // Only text after a child is a node of its own.
+    XMLFlatDocument mixed("<a>x<b/>y<!--c-->z</a>");
+    XMLFlatDocument::Node b = mixed.getRoot().getFirstChild().getFirstChild();
+    if(mixed.getRoot().getFirstChild().getValue() != "x" || b.getName() != "b" || b.getNextSibling().getValue() != "y"
+       || b.getNextSibling().getNextSibling().getType() != XMLNodeType::Comment || mixed.getNodeCount() != 6)
+    {
+        std::cout << "Wrong mixed content." << std::endl;
+        return false;
+    }
+    // Names are interned.
+    std::vector<XMLFlatDocument::Node> items = inv.getChildren("Item");
+    uint32_t itemSymbol = doc.getSymbols().find("Item");
+    if(items.size() != 3 || itemSymbol == XMLSymbols::NONE || items[2].getSymbol() != itemSymbol || inv.getFirstChild("Missing"))
+    {
+        std::cout << "Failed to find the items." << std::endl;
+        return false;
+    }
+    if(items[0].getAttribute("InHouse") != "true" || items[1].hasAttribute("InHouse") || items[0].getFirstChild("Qty").getValue() != "12")
+    {
+        std::cout << "Wrong item values." << std::endl;
+        return false;
+    }
+    // Nodes that do not exist are empty.
+    XMLFlatDocument::Node missing = inv.getFirstChild("Missing");
+    XMLFlatDocument::Node unset;
+    if(missing.getType() != XMLNodeType::None || !missing.getName().empty() || !missing.getValue().empty() || missing.getFirstChild()
+       || missing.getParent() || missing.getAttributeCount() != 0 || missing.hasAttribute("InHouse") || unset.getFirstChild("Item")
+       || unset.getNextNamedSibling() || !unset.getChildren("Item").empty() || !unset.getName().empty())
+    {
+        std::cout << "Missing node is not empty." << std::endl;
+        return false;
+    }
+    bool thrown = false;
+    try
+    {
+        items[1].getAttribute("InHouse");
+    }
+    catch(AttributeNotFoundException &)
+    {
+        thrown = true;
+    }
+    if(!thrown)
+    {
+        std::cout << "Missing attribute did not throw." << std::endl;
+        return false;
+    }
+    // Text read from a stream is copied into the document.
+    std::istringstream in(xmlString);
+    StringStreamSource<char> streamSource(in);
+    XMLFlatDocument streamed(streamSource);
+    if(streamed.getNodeCount() != doc.getNodeCount() || !sameXML(streamed.getRoot(), tree.getRoot()))
+    {
+        std::cout << "Streamed document does not match." << std::endl;
+        return false;
+    }
+    XMLFlatDocument bad("<a><b></a>");
+    if(bad.getError() != XMLError::InvalidSyntax || bad.getErrorIndex() != 9 || bad.getRoot())
+    {
+        std::cout << "Wrong error for an invalid document." << std::endl;
+        return false;
+    }
+    std::cout << doc.getNodeCount() << " nodes in " << doc.getBytesUsed() << " bytes." << std::endl;
+
+    std::cout << "XML flat document test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+bool testXMLIndex()
+{
+    std::cout << "XML tag index test started..." << std::endl;
+    // Below and above the size where children are indexed.
+    for(int count :{5, 1000})
+    {
+        XMLElement parent("parent", "");
+        for(int i = 0; i < count; i++)
+        {
+            parent.addChild(std::make_shared<XMLElement>("tag" + std::to_string(i % 3), std::to_string(i)));
+        }
+        std::string tag = "tag1";
+        StringToken<char> view(tag.data(), tag.length());
+        std::vector<std::shared_ptr<XMLElement>> tagged = parent.getChildren(view);
+        if(tagged.size() != (size_t) (count + 1) / 3 || tagged[1]->getValue() != "4" || parent.getFirstChild("tag2")->getValue() != "2")
+        {
+            std::cout << "Wrong children for " << count << " children." << std::endl;
+            return false;
+        }
+        if(parent.hasChild("tag") || parent.hasChild("tag10") || parent.getFirstChild("tag3") || !parent.getChildren("tag3").empty())
+        {
+            std::cout << "Found a missing tag for " << count << " children." << std::endl;
+            return false;
+        }
+        // Children added after a search are found as well.
+        parent.addChild(std::make_shared<XMLElement>("tag3", "new"));
+        parent.addChild(std::make_shared<XMLElement>("tag1", "last"));
+        if(parent.getFirstChild("tag3")->getValue() != "new" || parent.getChildren("tag1").back()->getValue() != "last")
+        {
+            std::cout << "Failed to find new children for " << count << " children." << std::endl;
+            return false;
+        }
+        XMLElement copy(parent);
+        if(copy.getChildren(tag).size() != tagged.size() + 1 || !copy.hasChild(tag.data(), tag.length()))
+        {
+            std::cout << "Wrong children in the copy." << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "XML tag index test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
 //-------------------------------------------------------------------------
 // JSON tests
 
@@ -286,5 +582,1307 @@ bool testJSON()
     return true;
 }
 
+bool testJSONArena()
+{
+    std::cout << "JSON arena test started..." << std::endl;
+    std::shared_ptr<JSONValue> root;
+    {
+        JSONDocument jDoc(jsonString, JSONParseOptions::ARENA);
+        if(jDoc.getError() != JSONError::NONE)
+        {
+            std::cout << "JSON error: " << JSONErrorString(jDoc.getError()) << " at location " << jDoc.getErrorIndex() << std::endl;
+            return false;
+        }
+        // The root keeps the arena alive after the document is gone.
+        root = jDoc.getRoot();
+    }
+    if(!root || !root->isObject())
+    {
+        std::cout << "Failed to get root element." << std::endl;
+        return false;
+    }
+    std::shared_ptr<JSONObject> inv = std::dynamic_pointer_cast<JSONObject>(root)->getValueAsObject("Inventory");
+    if(!inv)
+    {
+        std::cout << "Failed to find inventory." << std::endl;
+        return false;
+    }
+    std::shared_ptr<JSONArray> array = inv->getValueAsArray("Item");
+    // Values keep the arena alive on their own.
+    root.reset();
+    inv.reset();
+    if(!array || array->getArray().size() != 3)
+    {
+        std::cout << "Failed to find inventory items." << std::endl;
+        return false;
+    }
+    std::shared_ptr<JSONObject> item = std::dynamic_pointer_cast<JSONObject>(array->getArray()[1]);
+    if(!item || item->getString("Name") != "Self \\\"removing\\\" underwear" || item->getInt("Qty") != 327)
+    {
+        std::cout << "Arena values are incorrect." << std::endl;
+        return false;
+    }
+    // Heap values can be mixed with arena values.
+    item->setValue("Added", std::make_shared<JSONBool>(true));
+    if(item->getBool("Added") != 1)
+    {
+        std::cout << "Failed to add a value to an arena object." << std::endl;
+        return false;
+    }
+    std::cout << "JSON arena test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+bool testJSONViews()
+{
+    std::cout << "JSON string view test started..." << std::endl;
+    JSONDocument jDoc(jsonString);
+    JSONDocument vDoc(jsonString, JSONParseOptions::STRING_VIEWS);
+    JSONDocument avDoc(jsonString, JSONParseOptions::STRING_VIEWS | JSONParseOptions::ARENA);
+    if(vDoc.getError() != JSONError::NONE || avDoc.getError() != JSONError::NONE)
+    {
+        std::cout << "JSON error: " << JSONErrorString(vDoc.getError()) << " at location " << vDoc.getErrorIndex() << std::endl;
+        return false;
+    }
+    // Views must produce the same document as copies.
+    if(vDoc.format("  ") != jDoc.format("  ") || avDoc.format("  ") != jDoc.format("  "))
+    {
+        std::cout << "String views changed the document." << std::endl;
+        return false;
+    }
+    // A copy of the document no longer depends on the source string.
+    std::string source = "{\"Key\" : \"Value\", \"Escaped\" : \"It\\\"s\"}";
+    JSONDocument *sDoc = new JSONDocument(source, JSONParseOptions::STRING_VIEWS);
+    JSONDocument copy(*sDoc);
+    JSONDocument assigned;
+    assigned = *sDoc;
+    delete sDoc;
+    source.assign(source.length(), ' ');
+    std::shared_ptr<JSONObject> obj = std::dynamic_pointer_cast<JSONObject>(copy.getRoot());
+    std::shared_ptr<JSONObject> assignedObj = std::dynamic_pointer_cast<JSONObject>(assigned.getRoot());
+    if(!obj || obj->getString("Key") != "Value" || obj->getString("Escaped") != "It\\\"s"
+            || !assignedObj || assignedObj->getString("Key") != "Value" || assignedObj->getString("Escaped") != "It\\\"s")
+    {
+        std::cout << "Copied string views are incorrect." << std::endl;
+        return false;
+    }
+    std::cout << "JSON string view test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+bool testJSONIndexed()
+{
+    std::cout << "JSON structural index test started..." << std::endl;
+    std::vector<std::string> docs = {
+        jsonString,
+        "[]",
+        "{}",
+        " [ 1, -2, 3.5, true, false, null, \"\", {\"a\" : [[], {}]} ] ",
+        "{\"esc\\\\\" : \"back\\\\slash \\\" quote\", \"it's\" : \"it's\"}"
+    };
+    for(int level = (int) KSimd::Level::SCALAR; level <= (int) KSimd::Level::AVX2; level++)
+    {
+        KSimd::setMaxLevel((KSimd::Level) level);
+        for(auto &doc : docs)
+        {
+            JSONDocument jDoc(doc);
+            JSONDocument iDoc(doc, JSONParseOptions::STRUCTURAL_INDEX);
+            if(iDoc.getError() != JSONError::NONE)
+            {
+                std::cout << "JSON error: " << JSONErrorString(iDoc.getError()) << " at location " << iDoc.getErrorIndex() << std::endl;
+                return false;
+            }
+            if(iDoc.format("  ") != jDoc.format("  "))
+            {
+                std::cout << "Indexed document does not match: " << doc << std::endl;
+                return false;
+            }
+        }
+        // Invalid documents fail the same way, and content after the value is ignored by both.
+        std::vector<std::string> bad = {"{\"a\" 1}", "[1 2]", "{\"a\" : \"open", "[tru]", "{1 : 2}", "[1,", "{", "[1]]",
+            "{\"a\":1,}", "[1e]", "[truex]", "[1 \"x", "1\\3226", "452.64\"9", "\"", "-", "  "};
+        for(auto &doc : bad)
+        {
+            JSONDocument jDoc(doc);
+            JSONDocument iDoc(doc, JSONParseOptions::STRUCTURAL_INDEX);
+            if(iDoc.getError() != jDoc.getError() || iDoc.getErrorIndex() != jDoc.getErrorIndex()
+                    || iDoc.format("  ") != jDoc.format("  "))
+            {
+                std::cout << "Indexed error " << JSONErrorString(iDoc.getError()) << " at " << iDoc.getErrorIndex()
+                        << " does not match " << JSONErrorString(jDoc.getError()) << " at " << jDoc.getErrorIndex()
+                        << ": " << doc << std::endl;
+                return false;
+            }
+        }
+    }
+    KSimd::setMaxLevel(KSimd::Level::AVX2);
+    std::cout << "JSON structural index test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+bool testJSONMembers()
+{
+    std::cout << "JSON object member test started..." << std::endl;
+    // Build an object large enough to be hash indexed, with names in reverse order.
+    std::string doc = "{";
+    for(int i = 199; i >= 0; i--)
+    {
+        doc += "\"field" + std::to_string(i) + "\" : " + std::to_string(i) + ", ";
+    }
+    doc += "\"field7\" : \"replaced\"}";
+    JSONDocument jDoc(doc);
+    std::shared_ptr<JSONObject> obj = std::dynamic_pointer_cast<JSONObject>(jDoc.getRoot());
+    std::vector<std::string> names = obj->getValueNames();
+    if(names.size() != 200 || names.front() != "field199" || names.back() != "field0")
+    {
+        std::cout << "Members are not in their original order." << std::endl;
+        return false;
+    }
+    for(int i = 0; i < 200; i++)
+    {
+        std::string name = "field" + std::to_string(i);
+        if(i != 7 && obj->getInt(name) != i)
+        {
+            std::cout << "Member " << name << " is incorrect." << std::endl;
+            return false;
+        }
+    }
+    // A repeated name replaces the value but keeps the original position.
+    if(obj->getString("field7") != "replaced" || names[192] != "field7" || obj->hasValue("field200"))
+    {
+        std::cout << "Repeated member is incorrect." << std::endl;
+        return false;
+    }
+    std::cout << "JSON object member test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+bool testJSONMove()
+{
+    std::cout << "JSON move test started..." << std::endl;
+    JSONObject built;
+    std::string name = "moved";
+    built.setValue(std::move(name), new JSONString(std::string("text")));
+    built.emplace<JSONNumber>("number", 5L);
+    std::shared_ptr<JSONArray> list = built.emplace<JSONArray>("list");
+    list->emplace<JSONString>("tab\there");
+    list->emplace<JSONBool>(true);
+    if(built.size() != 3 || list->size() != 2 || list->at(2) != nullptr ||
+            built.getString("moved") != "text" || built.getInt("number") != 5)
+    {
+        std::cout << "Emplaced values are incorrect." << std::endl;
+        return false;
+    }
+    // Iteration visits the members in order without copying them.
+    std::string order;
+    for(auto &member : built)
+    {
+        order += member.name.str() + ";";
+    }
+    int strings = 0;
+    for(auto &value : *list)
+    {
+        strings += value->type() == JSONType::STRING ? 1 : 0;
+    }
+    if(order != "moved;number;list;" || strings != 1)
+    {
+        std::cout << "Iteration is incorrect." << std::endl;
+        return false;
+    }
+    // Moving an arena object must keep the parsed values alive.
+    std::shared_ptr<JSONObject> moved;
+    {
+        JSONDocument jDoc("{\"a\" : [1, 2, 3], \"b\" : \"two\"}", JSONParseOptions::ARENA);
+        JSONObject *root = dynamic_cast<JSONObject*>(jDoc.getRoot().get());
+        moved = std::make_shared<JSONObject>(std::move(*root));
+        if(root->size() != 0)
+        {
+            std::cout << "Moved from object is not empty." << std::endl;
+            return false;
+        }
+    }
+    std::shared_ptr<JSONArray> a = std::dynamic_pointer_cast<JSONArray>(moved->getValue("a"));
+    JSONArray copied(std::move(*a));
+    if(moved->getString("b") != "two" || copied.size() != 3 || a->size() != 0 ||
+            std::dynamic_pointer_cast<JSONNumber>(copied.at(2))->getInt() != 3)
+    {
+        std::cout << "Moved arena values are incorrect." << std::endl;
+        return false;
+    }
+    std::cout << "JSON move test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+bool testJSONWriter()
+{
+    std::cout << "JSON writer test started..." << std::endl;
+    std::string doc = jsonString.substr(0, jsonString.length() - 1) + ", \"Empty\" : {}, \"None\" : [], \"Pi\" : 0.1}";
+    JSONDocument jDoc(doc);
+    // Pretty output matches the stream output.
+    std::stringstream stream;
+    stream << jDoc;
+    if(jDoc.format("  ") != stream.str())
+    {
+        std::cout << "Pretty output does not match:" << std::endl << jDoc.format("  ") << std::endl;
+        return false;
+    }
+    // Compact output reads back to the same document.
+    std::string buffer;
+    jDoc.write(buffer);
+    if(buffer.find('\n') != std::string::npos || buffer.find("\" : ") != std::string::npos)
+    {
+        std::cout << "Compact output is not compact: " << buffer << std::endl;
+        return false;
+    }
+    JSONDocument cDoc(buffer);
+    if(cDoc.getError() != JSONError::NONE || cDoc.format("  ") != jDoc.format("  "))
+    {
+        std::cout << "Compact output does not read back: " << buffer << std::endl;
+        return false;
+    }
+    // Reusing the buffer keeps its memory.
+    size_t capacity = buffer.capacity();
+    buffer.clear();
+    JSONWriter writer(buffer);
+    writer.startObject();
+    writer.key("text");
+    writer.string("A long string with \"quotes\", a back\\slash,\ta tab and \x01 a control character.");
+    writer.key("list");
+    writer.startArray();
+    writer.number(1);
+    writer.number(2.5);
+    writer.boolean(false);
+    writer.null();
+    writer.startObject();
+    writer.endObject();
+    writer.endArray();
+    writer.endObject();
+    std::string expected = "{\"text\":\"A long string with \\\"quotes\\\", a back\\\\slash,\\ta tab and \\u0001 a control character.\","
+            "\"list\":[1,2.5,false,null,{}]}";
+    if(buffer != expected || buffer.capacity() != capacity)
+    {
+        std::cout << "Writer output is incorrect: " << buffer << std::endl;
+        return false;
+    }
+    // Subnormal numbers and negative zero read back exactly.
+    std::vector<double> small = {5e-324, 1e-310, 2.2250738585072011e-308, -0.0};
+    std::shared_ptr<JSONArray> numbers = std::make_shared<JSONArray>();
+    for(double value : small)
+    {
+        numbers->add(std::make_shared<JSONNumber>(value));
+    }
+    buffer.clear();
+    JSONDocument(numbers).write(buffer);
+    JSONDocument nDoc(buffer);
+    std::vector<std::shared_ptr<JSONValue>> read = std::dynamic_pointer_cast<JSONArray>(nDoc.getRoot())->getArray();
+    for(size_t i = 0; i < small.size(); i++)
+    {
+        double value = std::dynamic_pointer_cast<JSONNumber>(read[i])->getDouble();
+        if(value != small[i] || std::signbit(value) != std::signbit(small[i]))
+        {
+            std::cout << "Number did not read back: " << buffer << std::endl;
+            return false;
+        }
+    }
+    std::cout << "JSON writer test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+#include "../Parser/JSONPointer.h"
+
+bool testJSONPointer()
+{
+    std::cout << "JSON pointer test started..." << std::endl;
+    JSONDocument jDoc(jsonString, JSONParseOptions::ARENA | JSONParseOptions::FROZEN);
+    std::shared_ptr<JSONValue> date = JSONPointer("/Inventory/Date").get(jDoc);
+    const JSONValue *qty = JSONPointer("/Inventory/Item/1/Qty").find(*jDoc.getRoot());
+    if(!date || date->type() != JSONType::STRING || std::static_pointer_cast<JSONString>(date)->getValue() != "1999-12-31"
+            || qty == nullptr || static_cast<const JSONNumber *> (qty)->getInt() != 327)
+    {
+        std::cout << "JSON pointer found the wrong value." << std::endl;
+        return false;
+    }
+    if(JSONPointer("").get(jDoc) != jDoc.getRoot() || JSONPointer("Inventory").isValid() || JSONPointer("/a~2").isValid()
+            || JSONPointer("/Inventory/Item/01").get(jDoc) || JSONPointer("/Inventory/Item/-").get(jDoc)
+            || JSONPointer("/Inventory/Missing").get(jDoc) || JSONPointer("Inventory").get(jDoc)
+            || JSONPointer("/Inventory/~2").get(jDoc) || JSONPointer("/Inventory/~2").find(*jDoc.getRoot()))
+    {
+        std::cout << "Invalid JSON pointer was accepted." << std::endl;
+        return false;
+    }
+    // Escaped names.
+    JSONDocument eDoc("{\"a/b\" : 1, \"m~n\" : 2, \"\" : {\"*\" : 3}}");
+    if(JSONPointer("/a~1b").find(*eDoc.getRoot()) == nullptr || JSONPointer("/m~0n").find(*eDoc.getRoot()) == nullptr
+            || JSONPointer("//*").find(*eDoc.getRoot()) == nullptr)
+    {
+        std::cout << "Escaped JSON pointer did not match." << std::endl;
+        return false;
+    }
+    // Names that are escaped in the document.
+    JSONDocument qDoc("{\"a\\\"b\" : 1, \"c\\\\d\" : 2, \"caf\\u00e9\" : 3, \"x\\u0022y\" : 4}");
+    const JSONValue *quoted = JSONPointer("/a\"b").find(*qDoc.getRoot());
+    const JSONValue *unicode = JSONPointer("/caf\xc3\xa9").find(*qDoc.getRoot());
+    if(quoted == nullptr || static_cast<const JSONNumber *> (quoted)->getInt() != 1 || !JSONPointer("/c\\d").get(qDoc)
+            || unicode == nullptr || static_cast<const JSONNumber *> (unicode)->getInt() != 3 || !JSONPointer("/x\"y").get(qDoc)
+            || JSONPointer("/cafe").get(qDoc))
+    {
+        std::cout << "JSON pointer did not match an escaped name." << std::endl;
+        return false;
+    }
+    // The callback can use the values on the way to the match.
+    JSONDocument lDoc(jsonString);
+    std::shared_ptr<JSONObject> inventory = std::dynamic_pointer_cast<JSONObject>(lDoc.getRoot())->getValueAsObject("Inventory");
+    int visited = 0;
+    JSONPointer("/Inventory/Item/*/Qty", true).forEach(*lDoc.getRoot(), [&](const JSONValue &)
+    {
+        visited += inventory->hasValue("Item") && inventory->getValueAsArray("Item")->size() == 3 ? 1 : 0;
+        return true;
+    });
+    if(visited != 3)
+    {
+        std::cout << "JSON pointer callback could not read the document." << std::endl;
+        return false;
+    }
+    // A compiled wildcard path applied to many documents.
+    JSONPointer names("/Inventory/Item/*/Name", true);
+    std::vector<const JSONValue *> found;
+    for(int i = 0; i < 3; i++)
+    {
+        JSONDocument doc(jsonString);
+        found.clear();
+        names.findAll(*doc.getRoot(), found);
+        if(!names.hasWildcards() || found.size() != 3 || static_cast<const JSONString *> (found[2])->getValue() != "Gossip")
+        {
+            std::cout << "Wildcard JSON pointer found the wrong values." << std::endl;
+            return false;
+        }
+    }
+    std::cout << "JSON pointer test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+#include "../Parser/JSONLazy.h"
+
+bool testJSONLazy()
+{
+    std::cout << "JSON lazy document test started..." << std::endl;
+    JSONDocument jDoc(jsonString);
+    JSONLazyDocument lDoc(jsonString);
+    std::shared_ptr<JSONObject> inv = std::dynamic_pointer_cast<JSONObject>(jDoc.getRoot())->getValueAsObject("Inventory");
+    JSONLazyValue lInv = lDoc.getRoot().getValue("Inventory");
+    if(lInv.type() != JSONType::OBJECT || lInv.getString("Date") != inv->getString("Date")
+            || lInv.getDouble("doubleTest") != inv->getDouble("doubleTest") || lInv.getDouble("exponentTest") != inv->getDouble("exponentTest")
+            || lInv.getString("doubleTest") != inv->getString("doubleTest") || lInv.getBool("Missing") != -1)
+    {
+        std::cout << "Lazy object values do not match." << std::endl;
+        return false;
+    }
+    JSONLazyValue items = lInv.getValue("Item");
+    std::vector<std::shared_ptr<JSONValue>> jItems = inv->getValueAsArray("Item")->getArray();
+    if(items.size() != jItems.size() || items.at(3).isValid())
+    {
+        std::cout << "Lazy array size is incorrect." << std::endl;
+        return false;
+    }
+    for(size_t i = 0; i < items.size(); i++)
+    {
+        std::shared_ptr<JSONObject> jItem = std::dynamic_pointer_cast<JSONObject>(jItems[i]);
+        JSONLazyValue item = items.at(i);
+        if(item.getString("Name") != jItem->getString("Name") || item.getInt("Qty") != jItem->getInt("Qty")
+                || item.getBool("InHouse") != jItem->getBool("InHouse") || item.getValueNames() != jItem->getValueNames())
+        {
+            std::cout << "Lazy item " << i << " does not match." << std::endl;
+            return false;
+        }
+    }
+    std::ostringstream parsed, expected;
+    parsed << *items.at(2).parse();
+    expected << *jItems[2];
+    if(parsed.str() != expected.str())
+    {
+        std::cout << "Lazy value did not parse." << std::endl;
+        return false;
+    }
+    // Errors in parts that are never used are not found.
+    JSONLazyDocument bad("{\"good\" : [1, \"]}\", {}], \"skipped\" : {\"a\" : [1 2 x]}, \"bad\" : tru}");
+    JSONLazyDocument empty(" \n ");
+    if(bad.getRoot().getValue("good").size() != 3 || bad.getError() != JSONError::NONE || bad.getErrorIndex() != -1
+            || bad.getBool("bad") != -1 || bad.getError() != JSONError::InvalidSyntax
+            || empty.getError() != JSONError::UnexpectedEndOfDocument || empty.getErrorIndex() != 0 || empty.getRoot().isValid())
+    {
+        std::cout << "Lazy document errors are incorrect." << std::endl;
+        return false;
+    }
+    std::cout << "JSON lazy document test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+bool testJSONCBOR()
+{
+    std::cout << "JSON CBOR test started..." << std::endl;
+    // RFC 8949 appendix A.
+    JSONDocument small("{\"a\" : 1, \"b\" : [2, -3]}");
+    std::string cbor;
+    small.writeCBOR(cbor);
+    if(cbor != std::string("\xA2\x61\x61\x01\x61\x62\x82\x02\x22", 9))
+    {
+        std::cout << "CBOR encoding is incorrect." << std::endl;
+        return false;
+    }
+    // Round trip, with strings referring to the CBOR data.
+    JSONDocument jDoc(jsonString);
+    cbor.clear();
+    jDoc.writeCBOR(cbor);
+    JSONDocument cDoc;
+    cDoc.readCBOR(cbor, JSONParseOptions::ARENA | JSONParseOptions::STRING_VIEWS);
+    if(cDoc.getError() != JSONError::NONE || cDoc.format("  ") != jDoc.format("  "))
+    {
+        std::cout << "CBOR round trip does not match." << std::endl;
+        return false;
+    }
+    std::shared_ptr<JSONObject> inv = std::dynamic_pointer_cast<JSONObject>(cDoc.getRoot())->getValueAsObject("Inventory");
+    std::shared_ptr<JSONObject> item = std::dynamic_pointer_cast<JSONObject>(inv->getValueAsArray("Item")->getArray()[2]);
+    std::shared_ptr<JSONNumber> qty = std::dynamic_pointer_cast<JSONNumber>(item->getValue("Qty"));
+    if(inv->getDouble("exponentTest") != 2.123456789e+019 || !inv->getValue("doubleTest")->isNumber() || qty->isDouble())
+    {
+        std::cout << "CBOR numbers are incorrect." << std::endl;
+        return false;
+    }
+    // Escapes are removed in CBOR and restored when read.
+    JSONArray escaped;
+    escaped.add(std::make_shared<JSONString>("tab\there \"quoted\""));
+    escaped.add(std::make_shared<JSONString>(JSONText(std::string("\\u00e9\\ud83d\\ude00"))));
+    cbor.clear();
+    JSONDocument::writeCBOR(&escaped, cbor);
+    JSONDocument eDoc;
+    eDoc.readCBOR(cbor);
+    std::vector<std::shared_ptr<JSONValue>> strings = std::dynamic_pointer_cast<JSONArray>(eDoc.getRoot())->getArray();
+    if(cbor.find("tab\there \"quoted\"") == std::string::npos || cbor.find("\xC3\xA9\xF0\x9F\x98\x80") == std::string::npos
+            || std::dynamic_pointer_cast<JSONString>(strings[0])->getValue() != "tab\\there \\\"quoted\\\"")
+    {
+        std::cout << "CBOR strings are incorrect." << std::endl;
+        return false;
+    }
+    // Indefinite lengths, half floats and tags.
+    eDoc.readCBOR(std::string("\xBF\x61\x61\x9F\xF9\x3C\x00\xC1\x1A\x00\x01\x00\x00\xFF\x7F\x61\x78\x61\x79\xFF\xF5\xFF", 22));
+    cbor.clear();
+    eDoc.write(cbor);
+    if(eDoc.getError() != JSONError::NONE || cbor != "{\"a\":[1.0,65536],\"xy\":true}")
+    {
+        std::cout << "CBOR decoding is incorrect: " << cbor << std::endl;
+        return false;
+    }
+    // Truncated data, byte strings and keys that are not text.
+    eDoc.readCBOR(std::string("\x82\x01", 2));
+    JSONError truncated = eDoc.getError();
+    eDoc.readCBOR(std::string("\x41\x00", 2));
+    JSONError bytes = eDoc.getError();
+    eDoc.readCBOR(std::string("\xA1\x01\x02", 3));
+    if(truncated != JSONError::UnexpectedEndOfDocument || bytes != JSONError::InvalidSyntax
+            || eDoc.getError() != JSONError::InvalidObjectName || eDoc.getRoot())
+    {
+        std::cout << "Invalid CBOR was accepted." << std::endl;
+        return false;
+    }
+    std::cout << "JSON CBOR test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+#include "../Parser/JSONBind.h"
+
+// Item is shared with the XML test so its fields are declared outside of it.
+namespace KayLib
+{
+
+    template<>
+    struct JSONFields<Item>
+    {
+
+        static void declare(JSONBind<Item> &fields)
+        {
+            fields.field("Name", &Item::Name);
+            fields.field("Location", &Item::Location);
+            fields.field("Qty", &Item::Qty);
+            fields.field("InHouse", &Item::InHouse);
+        }
+    };
+}
+
+struct Inventory
+{
+    std::string Date;
+    std::vector<Item> Items;
+    double doubleTest = 0;
+    double exponentTest = 0;
+
+    static void jsonFields(JSONBind<Inventory> &fields)
+    {
+        fields.field("Date", &Inventory::Date);
+        fields.field("Item", &Inventory::Items);
+        fields.field("doubleTest", &Inventory::doubleTest);
+        fields.field("exponentTest", &Inventory::exponentTest);
+    }
+};
+
+struct InventoryDocument
+{
+    Inventory inventory;
+
+    static void jsonFields(JSONBind<InventoryDocument> &fields)
+    {
+        fields.field("Inventory", &InventoryDocument::inventory);
+    }
+};
+
+struct BoundLimits
+{
+    short small = 0;
+    unsigned int count = 0;
+    long big = 0;
+    unsigned long long huge = 0;
+
+    static void jsonFields(JSONBind<BoundLimits> &fields)
+    {
+        fields.field("small", &BoundLimits::small);
+        fields.field("count", &BoundLimits::count);
+        fields.field("big", &BoundLimits::big);
+        fields.field("huge", &BoundLimits::huge);
+    }
+};
+
+bool testJSONBind()
+{
+    std::cout << "JSON binding test started..." << std::endl;
+    InventoryDocument bound;
+    if(JSONBind<InventoryDocument>::read(jsonString, bound) != JSONError::NONE)
+    {
+        std::cout << "JSON binding failed to read the document." << std::endl;
+        return false;
+    }
+    JSONDocument jDoc(jsonString);
+    std::shared_ptr<JSONObject> inv = std::dynamic_pointer_cast<JSONObject>(jDoc.getRoot())->getValueAsObject("Inventory");
+    std::vector<std::shared_ptr<JSONValue>> items = inv->getValueAsArray("Item")->getArray();
+    if(bound.inventory.Date != inv->getString("Date") || bound.inventory.Items.size() != items.size()
+            || bound.inventory.exponentTest != inv->getDouble("exponentTest"))
+    {
+        std::cout << "Bound inventory does not match." << std::endl;
+        return false;
+    }
+    for(size_t i = 0; i < items.size(); i++)
+    {
+        std::shared_ptr<JSONObject> object = std::dynamic_pointer_cast<JSONObject>(items[i]);
+        Item &item = bound.inventory.Items[i];
+        // Bound strings have their escapes removed.
+        if(item.Name != KString::unescape(object->getString("Name")) || item.Qty != object->getInt("Qty")
+                || item.InHouse != (object->getBool("InHouse") == 1))
+        {
+            std::cout << "Bound item " << i << " does not match." << std::endl;
+            return false;
+        }
+    }
+    // Writing and reading again gives the same values.
+    std::string text;
+    JSONBind<InventoryDocument>::write(bound, text);
+    InventoryDocument again;
+    JSONDocument written(text);
+    if(JSONBind<InventoryDocument>::read(text, again) != JSONError::NONE || written.getError() != JSONError::NONE
+            || again.inventory.Items[1].Name != "Self \"removing\" underwear" || again.inventory.doubleTest != 123.456)
+    {
+        std::cout << "Bound inventory did not survive writing." << std::endl;
+        return false;
+    }
+    // Unknown members are skipped, errors are reported.
+    Item item;
+    long errorIndex;
+    std::string bad = "{\"Extra\" : {\"a\" : [1, \"}\"]}, \"Qty\" : 5, \"Name\" : 7}";
+    if(JSONBind<Item>::read(bad.data(), bad.length(), item, errorIndex) != JSONError::InvalidSyntax || item.Qty != 5
+            || errorIndex != (long) bad.find('7'))
+    {
+        std::cout << "JSON binding errors are incorrect." << std::endl;
+        return false;
+    }
+    // Integers must fit their fields.
+    BoundLimits limits;
+    if(JSONBind<BoundLimits>::read("{\"small\" : -32768, \"count\" : 4294967295, \"big\" : 1e3}", limits) != JSONError::NONE
+            || limits.small != -32768 || limits.count != 4294967295u || limits.big != 1000)
+    {
+        std::cout << "Bound limits are incorrect." << std::endl;
+        return false;
+    }
+    std::vector<std::string> outOfRange = {"{\"small\" : 32768}", "{\"count\" : -1}", "{\"count\" : 4294967296}",
+        "{\"small\" : 2.5}", "{\"big\" : 1e19}", "{\"big\" : -1e300}", "{\"huge\" : 18446744073709551616}"};
+    for(auto &text : outOfRange)
+    {
+        if(JSONBind<BoundLimits>::read(text.data(), text.length(), limits, errorIndex) != JSONError::InvalidNumber
+                || errorIndex != (long) text.find(": ") + 2)
+        {
+            std::cout << "Number out of range was not reported: " << text << std::endl;
+            return false;
+        }
+    }
+    // Unsigned values above LONG_MAX are written exactly.
+    for(unsigned long long huge : {18446744073709551615ull, 9223372036854775809ull})
+    {
+        BoundLimits written;
+        written.huge = huge;
+        std::string hugeText;
+        JSONBind<BoundLimits>::write(written, hugeText);
+        BoundLimits hugeRead;
+        if(hugeText.find(std::to_string(huge)) == std::string::npos
+                || JSONBind<BoundLimits>::read(hugeText, hugeRead) != JSONError::NONE || hugeRead.huge != huge)
+        {
+            std::cout << "Large unsigned value did not read back: " << hugeText << std::endl;
+            return false;
+        }
+    }
+    std::cout << "JSON binding test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+#include "../Parser/NDJSONReader.h"
+
+class NDJSONTestHandler : public NDJSONHandler
+{
+public:
+    std::vector<long> ids;
+    std::vector<size_t> offsets;
+    int errors = 0;
+    size_t stopAfter = 0;
+
+    virtual bool record(JSONDocument &doc, size_t offset) override
+    {
+        offsets.push_back(offset);
+        if(doc.getError() != JSONError::NONE)
+        {
+            errors++;
+            return true;
+        }
+        ids.push_back(std::dynamic_pointer_cast<JSONObject>(doc.getRoot())->getInt("id"));
+        return stopAfter == 0 || ids.size() < stopAfter;
+    }
+};
+
+bool testNDJSON()
+{
+    std::cout << "NDJSON reader test started..." << std::endl;
+    std::string input;
+    size_t badOffset = 0;
+    for(int i = 0; i < 10000; i++)
+    {
+        if(i == 5000)
+        {
+            badOffset = input.length();
+            input += "{\"id\" : }\n\n";
+        }
+        input += "{\"id\" : " + std::to_string(i) + ", \"name\" : \"record " + std::to_string(i) + "\"}\r\n";
+    }
+    // Small batches, read from memory and from a stream.
+    NDJSONTestHandler memory;
+    NDJSONReader reader(memory, 4);
+    reader.setLimits(1000, 8, 1024);
+    bool read = reader.read(input);
+    NDJSONTestHandler stream;
+    NDJSONReader streamReader(stream, 4);
+    streamReader.setLimits(777, 8, 1024);
+    std::istringstream in(input);
+    bool readStream = streamReader.read(in);
+    if(!read || !readStream || memory.ids.size() != 10000 || memory.errors != 1 || stream.ids != memory.ids
+            || stream.offsets != memory.offsets || memory.offsets[5000] != badOffset)
+    {
+        std::cout << "NDJSON records are incorrect." << std::endl;
+        return false;
+    }
+    for(long i = 0; i < 10000; i++)
+    {
+        if(memory.ids[i] != i)
+        {
+            std::cout << "NDJSON records are out of order." << std::endl;
+            return false;
+        }
+    }
+    // Unordered reading gets every record.
+    NDJSONTestHandler unordered;
+    NDJSONReader unorderedReader(unordered);
+    unorderedReader.setOrdered(false);
+    unorderedReader.setLimits(1000, 8, 1024);
+    unorderedReader.read(input);
+    std::sort(unordered.ids.begin(), unordered.ids.end());
+    if(unordered.ids != memory.ids)
+    {
+        std::cout << "Unordered NDJSON records are incorrect." << std::endl;
+        return false;
+    }
+    // Stopping, and records that are too long.
+    NDJSONTestHandler stopped;
+    stopped.stopAfter = 10;
+    NDJSONReader stopReader(stopped);
+    stopReader.setLimits(1000, 8, 1024);
+    NDJSONReader longReader(stopped);
+    longReader.setLimits(16, 8, 32);
+    std::istringstream longIn(std::string(100, ' ') + "{}\n");
+    if(stopReader.read(input) || !stopReader.isStopped() || stopped.ids.size() != 10
+            || longReader.read(longIn) || longReader.getError() != JSONError::LimitExceeded)
+    {
+        std::cout << "NDJSON reader did not stop." << std::endl;
+        return false;
+    }
+    std::cout << "NDJSON reader test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+#include "../Parser/JSONSchema.h"
+
+bool testJSONSchema()
+{
+    std::cout << "JSON schema test started..." << std::endl;
+    JSONSchema schema(std::string("{\"type\" : \"object\", \"required\" : [\"id\", \"tags\"], \"properties\" : {"
+            "\"id\" : {\"type\" : \"integer\", \"minimum\" : 1},"
+            "\"name\" : {\"type\" : \"string\", \"minLength\" : 2, \"pattern\" : \"^[a-z]+$\"},"
+            "\"kind\" : {\"enum\" : [\"a\", \"b\", {\"x\" : 1, \"y\" : [true]}]},"
+            "\"tags\" : {\"type\" : \"array\", \"maxItems\" : 2, \"items\" : {\"type\" : \"string\"}}},"
+            "\"additionalProperties\" : false}"));
+    if(!schema.isValid() || JSONSchema(std::string("{\"type\" : \"text\"}")).isValid())
+    {
+        std::cout << "Schema did not compile correctly." << std::endl;
+        return false;
+    }
+    std::string good = "{\"id\" : 3, \"name\" : \"abc\", \"kind\" : {\"y\" : [true], \"x\" : 1.0}, \"tags\" : [\"t\"]}";
+    std::string bad = "{\"id\" : 0.5, \"name\" : \"A\", \"kind\" : \"c\", \"tags\" : [1, \"t\", \"u\"], \"extra\" : null}";
+    std::vector<JSONSchemaError> errors;
+    if(!schema.validate(JSONDocument(good), &errors) || !errors.empty() || schema.validate(JSONDocument(bad)))
+    {
+        std::cout << "Document validation is incorrect." << std::endl;
+        return false;
+    }
+    schema.validate(JSONDocument(bad), &errors);
+    // The same failures must be found while reading the document as a stream.
+    JSONSchemaValidator validator(schema);
+    JSONReader reader(validator);
+    reader.feed(good.data(), good.length());
+    reader.finish();
+    bool streamGood = validator.isValid();
+    validator.reset();
+    reader.reset();
+    reader.feed(bad.data(), bad.length());
+    reader.finish();
+    // Arrays are checked at their end when streaming, so the order can differ.
+    std::vector<std::string> expected = {"/extra false", "/id type", "/kind enum", "/name minLength",
+        "/name pattern", "/tags maxItems", "/tags/0 type"};
+    std::vector<std::string> found;
+    for(auto &error : errors)
+    {
+        found.push_back(error.path + " " + error.keyword);
+    }
+    std::vector<std::string> streamed;
+    for(auto &error : validator.getErrors())
+    {
+        streamed.push_back(error.path + " " + error.keyword);
+    }
+    std::sort(found.begin(), found.end());
+    std::sort(streamed.begin(), streamed.end());
+    if(!streamGood || found != expected || streamed != expected)
+    {
+        std::cout << "Validation errors are incorrect." << std::endl;
+        return false;
+    }
+    errors.clear();
+    if(schema.validate(JSONDocument("{\"tags\" : []}"), &errors) || errors.size() != 1 || errors[0].keyword != "required")
+    {
+        std::cout << "Missing property was not found." << std::endl;
+        return false;
+    }
+    std::cout << "JSON schema test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+#include "../Parser/JSONPatch.h"
+
+bool testJSONPatch()
+{
+    std::cout << "JSON patch test started..." << std::endl;
+    std::shared_ptr<JSONValue> original;
+    {
+        // The versions outlive the document.
+        JSONDocument jDoc("{\"a\" : {\"b\" : [1, 2, 3], \"c\" : \"x\"}, \"big\" : {\"d\" : [true, false]}}", JSONParseOptions::ARENA);
+        original = jDoc.getRoot();
+    }
+    JSONPatch patch(std::string("[{\"op\" : \"test\", \"path\" : \"/a/c\", \"value\" : \"x\"},"
+            "{\"op\" : \"add\", \"path\" : \"/a/b/1\", \"value\" : 9},"
+            "{\"op\" : \"remove\", \"path\" : \"/a/b/0\"},"
+            "{\"op\" : \"replace\", \"path\" : \"/a/c\", \"value\" : {\"e\" : null}},"
+            "{\"op\" : \"copy\", \"from\" : \"/a/b\", \"path\" : \"/a/f\"},"
+            "{\"op\" : \"move\", \"from\" : \"/a/f\", \"path\" : \"/g\"}]"));
+    std::string failure;
+    std::shared_ptr<JSONValue> version = patch.apply(original, &failure);
+    if(!patch.isValid() || !version || !version->isFrozen())
+    {
+        std::cout << "Patch did not apply: " << failure << std::endl;
+        return false;
+    }
+    std::string oldText;
+    std::string newText;
+    JSONDocument(original).write(oldText);
+    JSONDocument(version).write(newText);
+    std::shared_ptr<JSONObject> oldRoot = std::dynamic_pointer_cast<JSONObject>(original);
+    std::shared_ptr<JSONObject> newRoot = std::dynamic_pointer_cast<JSONObject>(version);
+    if(oldText != "{\"a\":{\"b\":[1,2,3],\"c\":\"x\"},\"big\":{\"d\":[true,false]}}" ||
+            newText != "{\"a\":{\"b\":[9,2,3],\"c\":{\"e\":null}},\"big\":{\"d\":[true,false]},\"g\":[9,2,3]}")
+    {
+        std::cout << "Patched version is incorrect." << std::endl;
+        return false;
+    }
+    // Untouched values are shared, not copied.
+    if(oldRoot->getValue("big") != newRoot->getValue("big") || oldRoot->getValue("a") == newRoot->getValue("a"))
+    {
+        std::cout << "Values are not shared between versions." << std::endl;
+        return false;
+    }
+    // A copy of a value the patch changed is not changed with it.
+    JSONDocument cDoc("{\"x\" : {\"k\" : 0}}");
+    std::shared_ptr<JSONValue> copiedVersion = JSONPatch(std::string("[{\"op\" : \"add\", \"path\" : \"/x/y\", \"value\" : 1},"
+            "{\"op\" : \"copy\", \"from\" : \"/x\", \"path\" : \"/z\"},"
+            "{\"op\" : \"add\", \"path\" : \"/z/w\", \"value\" : 2}]")).apply(cDoc.getRoot());
+    std::string copiedText;
+    if(copiedVersion)
+    {
+        JSONDocument(copiedVersion).write(copiedText);
+    }
+    if(copiedText != "{\"x\":{\"k\":0,\"y\":1},\"z\":{\"k\":0,\"y\":1,\"w\":2}}")
+    {
+        std::cout << "Patch changed both copies: " << copiedText << std::endl;
+        return false;
+    }
+    // Members are found by their unescaped name.
+    JSONDocument eDoc("{\"caf\\u00e9\" : 1, \"a\\\"b\" : 2}");
+    std::shared_ptr<JSONValue> escaped = JSONPatch(std::string("[{\"op\" : \"replace\", \"path\" : \"/caf\\u00e9\", \"value\" : 3},"
+            "{\"op\" : \"remove\", \"path\" : \"/a\\\"b\"}]")).apply(eDoc.getRoot());
+    std::string escapedText;
+    if(escaped)
+    {
+        JSONDocument(escaped).write(escapedText);
+    }
+    if(escapedText != "{\"caf\\u00e9\":3}")
+    {
+        std::cout << "Patch of escaped names is incorrect: " << escapedText << std::endl;
+        return false;
+    }
+    // A failed operation leaves no new version.
+    JSONPatch failing(std::string("[{\"op\" : \"remove\", \"path\" : \"/big/d/0\"}, {\"op\" : \"test\", \"path\" : \"/g/0\", \"value\" : 1}]"));
+    if(failing.apply(version) || JSONPatch(std::string("[{\"op\" : \"jump\", \"path\" : \"\"}]")).isValid())
+    {
+        std::cout << "Failing patch was applied." << std::endl;
+        return false;
+    }
+    JSONDocument mergePatch("{\"a\" : {\"c\" : null, \"h\" : {\"i\" : 1, \"j\" : null}}, \"big\" : 5}");
+    std::shared_ptr<JSONValue> merged = JSONPatch::merge(version, *mergePatch.getRoot());
+    std::string mergedText;
+    JSONDocument(merged).write(mergedText);
+    newText.clear();
+    JSONDocument(version).write(newText);
+    if(mergedText != "{\"a\":{\"b\":[9,2,3],\"h\":{\"i\":1}},\"big\":5,\"g\":[9,2,3]}" ||
+            newText != "{\"a\":{\"b\":[9,2,3],\"c\":{\"e\":null}},\"big\":{\"d\":[true,false]},\"g\":[9,2,3]}")
+    {
+        std::cout << "Merge patch is incorrect." << std::endl;
+        return false;
+    }
+    std::cout << "JSON patch test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+#include <fstream>
+#include "../IO/KMappedFile.h"
+
+bool testMappedInput()
+{
+    std::cout << "Mapped input test started..." << std::endl;
+    // Views are not terminated, so parsing must stop at their exact end.
+    std::unique_ptr<char[] > exact(new char[4]);
+    std::memcpy(exact.get(), "true", 4);
+    JSONDocument view(exact.get(), 4);
+    if(view.getError() != JSONError::NONE || view.getRoot()->type() != JSONType::BOOL)
+    {
+        std::cout << "Parsing a view failed." << std::endl;
+        return false;
+    }
+    std::string fileName = "mapped_input_test.json";
+    {
+        std::ofstream out(fileName);
+        out << "{\"name\" : \"mapped\", \"list\" : [1, 2, 3]}";
+    }
+    KMappedFile file(fileName);
+    if(!file.isOpen())
+    {
+        std::cout << "Could not map the file." << std::endl;
+        return false;
+    }
+    JSONDocument jDoc(file.data(), file.size(), JSONParseOptions::STRING_VIEWS);
+    std::shared_ptr<JSONObject> obj = std::dynamic_pointer_cast<JSONObject>(jDoc.getRoot());
+    const char xml[] = "<a><b>mapped</b></a>";
+    XMLDocument xDoc(xml, sizeof (xml) - 1);
+    bool copied = obj && obj->getString("name") == "mapped";
+    file.close();
+    std::remove(fileName.c_str());
+    if(!copied || file.isOpen() || file.size() != 0 || xDoc.getError() != XMLError::NONE || KMappedFile("no such file").isOpen())
+    {
+        std::cout << "Mapped document is incorrect." << std::endl;
+        return false;
+    }
+    std::cout << "Mapped input test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+bool testErrorPosition()
+{
+    std::cout << "Error position test started..." << std::endl;
+    std::string json = "{\n  \"a\" : 1,\n  \"b\" : tru,\n  \"c\" : 2\n}";
+    for(JSONParseOptions options : {JSONParseOptions::NONE, JSONParseOptions::STRUCTURAL_INDEX})
+    {
+        JSONDocument jDoc(json, options);
+        if(jDoc.getError() == JSONError::NONE || jDoc.getErrorLine() != 3 || jDoc.getErrorExcerpt() != "  \"b\" : tru,")
+        {
+            std::cout << "Wrong JSON error line " << jDoc.getErrorLine() << ": " << jDoc.getErrorExcerpt() << std::endl;
+            return false;
+        }
+        if(jDoc.getErrorColumn() != jDoc.getErrorIndex() - (long) json.find("  \"b\"") + 1)
+        {
+            std::cout << "Wrong JSON error column " << jDoc.getErrorColumn() << std::endl;
+            return false;
+        }
+    }
+    JSONDocument good(json.substr(0, json.find("\"b\"")) + "\"b\" : true}");
+    if(good.getError() != JSONError::NONE || good.getErrorLine() != -1)
+    {
+        std::cout << "Valid JSON has an error position." << std::endl;
+        return false;
+    }
+    std::string xml = "<a>\n  <b>text</b>\n  <c d=\"1\" e>\n</a>";
+    XMLDocument xDoc(xml);
+    if(xDoc.getError() == XMLError::NONE || xDoc.getErrorLine() != 3 || xDoc.getErrorExcerpt() != "  <c d=\"1\" e>")
+    {
+        std::cout << "Wrong XML error line " << xDoc.getErrorLine() << ": " << xDoc.getErrorExcerpt() << std::endl;
+        return false;
+    }
+    std::cout << "Error position test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+
+/**
+ * Read a document from several threads at once.
+ * @return True if every thread read the same values as a single thread.
+ */
+bool readJSONThreaded(const JSONDocument &doc, unsigned int threadCount, int reads)
+{
+    std::shared_ptr<JSONObject> root = std::dynamic_pointer_cast<JSONObject>(doc.getRoot());
+    std::shared_ptr<JSONObject> expected = root->getValueAsObject("Inventory");
+    std::string date = expected->getString("Date");
+    double number = expected->getDouble("doubleTest");
+    size_t items = expected->getValueAsArray("Item")->size();
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for(unsigned int t = 0; t < threadCount; t++)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            for(int i = 0; i < reads; i++)
+            {
+                std::shared_ptr<JSONObject> inv = root->getValueAsObject("Inventory");
+                if(inv->getString("Date") != date || inv->getDouble("doubleTest") != number
+                        || inv->getValueAsArray("Item")->size() != items)
+                {
+                    failures++;
+                }
+            }
+        }));
+    }
+    for(auto &thread : threads)
+    {
+        thread.join();
+    }
+    return failures == 0;
+}
+
+bool testJSONFrozen()
+{
+    std::cout << "JSON frozen document test started..." << std::endl;
+    // Assigning would share the lock of another value.
+    static_assert(!std::is_copy_assignable<JSONNumber>::value && !std::is_copy_assignable<JSONString>::value,
+                  "JSON values must be copied with copy().");
+    JSONDocument jDoc(jsonString);
+    JSONDocument fDoc(jsonString, JSONParseOptions::FROZEN | JSONParseOptions::ARENA);
+    if(fDoc.getError() != JSONError::NONE)
+    {
+        std::cout << "JSON error: " << JSONErrorString(fDoc.getError()) << " at location " << fDoc.getErrorIndex() << std::endl;
+        return false;
+    }
+    if(fDoc.format("  ") != jDoc.format("  "))
+    {
+        std::cout << "Frozen document does not match." << std::endl;
+        return false;
+    }
+    std::shared_ptr<JSONObject> root = std::dynamic_pointer_cast<JSONObject>(fDoc.getRoot());
+    std::shared_ptr<JSONObject> inv = root->getValueAsObject("Inventory");
+    if(!root->isFrozen() || inv->getString("Date") != "1999-12-31" || inv->getDouble("exponentTest") != 2.123456789e+019)
+    {
+        std::cout << "Frozen values are incorrect." << std::endl;
+        return false;
+    }
+    // Frozen values must refuse changes.
+    try
+    {
+        inv->setValue("Date", new JSONString("2000-01-01"));
+        std::cout << "Frozen object was changed." << std::endl;
+        return false;
+    }
+    catch(ImmutableValueException &e)
+    {
+    }
+    // Copies can be changed.
+    std::shared_ptr<JSONObject> copy(static_cast<JSONObject *> (inv->copy()));
+    copy->setValue("Date", new JSONString("2000-01-01"));
+    if(copy->isFrozen() || copy->getString("Date") != "2000-01-01" || inv->getString("Date") != "1999-12-31")
+    {
+        std::cout << "Copy of frozen object is incorrect." << std::endl;
+        return false;
+    }
+    // Both locked and frozen documents can be read from several threads.
+    if(!readJSONThreaded(jDoc, 4, 1000) || !readJSONThreaded(fDoc, 4, 1000))
+    {
+        std::cout << "Threaded reads are incorrect." << std::endl;
+        return false;
+    }
+    std::cout << "JSON frozen document test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+/**
+ * Time reads of a document from several threads at once.
+ * @return The time taken in milliseconds.
+ */
+long timeJSONThreaded(const JSONDocument &doc, unsigned int threadCount, int reads)
+{
+    std::shared_ptr<JSONObject> root = std::dynamic_pointer_cast<JSONObject>(doc.getRoot());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(unsigned int t = 0; t < threadCount; t++)
+    {
+        threads.push_back(std::thread([root, reads]()
+        {
+            std::shared_ptr<JSONObject> inv = root->getValueAsObject("Inventory");
+            long total = 0;
+            for(int i = 0; i < reads; i++)
+            {
+                total += inv->getInt("doubleTest") + (long) inv->getDouble("doubleTest");
+                total += inv->getString("Date").length() + (inv->hasValue("Item") ? 1 : 0);
+            }
+            if(total == 0)
+            {
+                std::cout << "Threaded read failed." << std::endl;
+            }
+        }));
+    }
+    for(auto &thread : threads)
+    {
+        thread.join();
+    }
+    return (long) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Compare concurrent reads of a locked document with a frozen one on every hardware thread.
+ * Prints the times, it is not part of the tests.
+ */
+void benchmarkJSONFrozen()
+{
+    std::cout << "JSON frozen document benchmark started..." << std::endl;
+    JSONDocument jDoc(jsonString);
+    JSONDocument fDoc(jsonString, JSONParseOptions::FROZEN | JSONParseOptions::ARENA);
+    unsigned int threads = std::thread::hardware_concurrency();
+    if(threads == 0)
+    {
+        threads = 4;
+    }
+    long locked = timeJSONThreaded(jDoc, threads, 100000);
+    long frozen = timeJSONThreaded(fDoc, threads, 100000);
+    std::cout << threads << " threads: locked " << locked << "ms, frozen " << frozen << "ms" << std::endl;
+    std::cout << "JSON frozen document benchmark complete!" << std::endl;
+    std::cout << std::endl;
+}
+
+#include "../Parser/JSONReader.h"
+
+/**
+ * Records reader events as text.
+ */
+class JSONLogHandler : public JSONHandler
+{
+public:
+    std::string log;
+
+    bool startObject() override
+    {
+        log += "{";
+        return true;
+    }
+
+    bool endObject() override
+    {
+        log += "}";
+        return true;
+    }
+
+    bool startArray() override
+    {
+        log += "[";
+        return true;
+    }
+
+    bool endArray() override
+    {
+        log += "]";
+        return true;
+    }
+
+    bool key(const char *str, size_t length) override
+    {
+        log += "k:" + std::string(str, length) + ";";
+        return true;
+    }
+
+    bool string(const char *str, size_t length) override
+    {
+        log += "s:" + std::string(str, length) + ";";
+        return true;
+    }
+
+    bool number(long value) override
+    {
+        log += "l:" + std::to_string(value) + ";";
+        return true;
+    }
+
+    bool number(double value) override
+    {
+        log += "d:" + std::to_string(value) + ";";
+        return true;
+    }
+
+    bool boolean(bool value) override
+    {
+        log += value ? "true;" : "false;";
+        return true;
+    }
+
+    bool null() override
+    {
+        log += "null;";
+        return true;
+    }
+
+    bool endDocument() override
+    {
+        log += "|";
+        return true;
+    }
+};
+
+bool testJSONReader()
+{
+    std::cout << "JSON reader test started..." << std::endl;
+    JSONLogHandler whole;
+    JSONReader reader(whole);
+    if(!reader.feed(jsonString.data(), jsonString.length()) || !reader.finish())
+    {
+        std::cout << "JSON error: " << JSONErrorString(reader.getError()) << " at location " << reader.getErrorIndex() << std::endl;
+        return false;
+    }
+    // Any chunk size must produce the same events.
+    for(size_t chunk = 1; chunk < 8; chunk++)
+    {
+        JSONLogHandler parts;
+        JSONReader chunked(parts);
+        for(size_t i = 0; i < jsonString.length(); i += chunk)
+        {
+            chunked.feed(jsonString.data() + i, std::min(chunk, jsonString.length() - i));
+        }
+        if(!chunked.finish() || parts.log != whole.log)
+        {
+            std::cout << "Chunked reading produced different events." << std::endl;
+            return false;
+        }
+    }
+    // Newline delimited documents.
+    std::stringstream lines("{\"a\" : 1}\n[true, null]\n\"text\"\n");
+    JSONLogHandler ndjson;
+    JSONReader lineReader(ndjson);
+    lineReader.setMultipleDocuments(true);
+    if(!lineReader.read(lines, 3) || ndjson.log != "{k:a;l:1;}|[true;null;]|s:text;|")
+    {
+        std::cout << "Newline delimited reading failed: " << ndjson.log << std::endl;
+        return false;
+    }
+    // Errors report the offset of the problem.
+    JSONLogHandler bad;
+    JSONReader badReader(bad);
+    std::string badDoc = "{\"a\" : [1, 2}";
+    if(badReader.feed(badDoc.data(), badDoc.length()) || badReader.getError() != JSONError::InvalidSyntax || badReader.getErrorIndex() != 13)
+    {
+        std::cout << "Invalid document was not reported correctly." << std::endl;
+        return false;
+    }
+    // Errors match the document parser.
+    const char *badDocs[] = {"{\"a\":1,}", "[1, 2", "[1 2]", "{\"a\" 1}", "{1:2}", "{\"a\":}", "[,1]", "[1,]", "]", "{", "[",
+        "tru", "{\"a\":1 \"b\":2}", "{\"a\"", "{\"a\":", "[\"x\" \"y\"]", "[true false]", "[1\n, @]", "{\"a\":[1,{\"b\":x}]}",
+        "[.5]", "[-]", "[--1]", "[1e+]", "[truex]", "  ", "", "{,}", "{\"a\":1,,}", "[[[]]", "[\"a\\\"]", "{\"a\" \"b", "[1:2]", "{]"};
+    for(const char *text : badDocs)
+    {
+        std::string badText(text);
+        JSONDocument expected(badText);
+        JSONReader tableReader(bad);
+        if((tableReader.feed(badText.data(), badText.length()) && tableReader.finish())
+                || tableReader.getError() != expected.getError() || tableReader.getErrorIndex() != expected.getErrorIndex())
+        {
+            std::cout << "Invalid document " << badText << " was reported as " << JSONErrorString(tableReader.getError())
+                    << " at " << tableReader.getErrorIndex() << " not " << JSONErrorString(expected.getError())
+                    << " at " << expected.getErrorIndex() << std::endl;
+            return false;
+        }
+    }
+    // Unlike the document, content after the value and unterminated strings are errors.
+    const char *trailingDocs[] = {"[1]]", "[1] 2", "1.2.3", "\"abc"};
+    for(const char *text : trailingDocs)
+    {
+        std::string badText(text);
+        JSONReader tableReader(bad);
+        if(tableReader.feed(badText.data(), badText.length()) && tableReader.finish())
+        {
+            std::cout << "Content after the document was accepted: " << badText << std::endl;
+            return false;
+        }
+    }
+    std::cout << "JSON reader test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
 
 #endif /* PARSERTEST_H */
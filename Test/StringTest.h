@@ -19,6 +19,9 @@
 
 #include <iostream>
 #include <vector>
+#include <sstream>
+#include <thread>
+#include <algorithm>
 
 //-------------------------------------------------------------------------
 // String parser tests
@@ -108,6 +111,429 @@ bool testStringParser()
     return true;
 }
 
+/**
+ * Run every scanning function from every position of a string.
+ * @return A description of the results.
+ */
+std::string scanResults(const std::string &str, bool tab)
+{
+    std::ostringstream out;
+    StringParser<char> p(str.data(), str.length());
+    p.setTabAsWhitespace(tab);
+    for(long i = 0; i <= (long) str.length(); i++)
+    {
+        p.setIndex(i);
+        p.skipWhitespace(true);
+        out << p.getIndex() << ',';
+        p.setIndex(i);
+        p.skipWhitespace(false);
+        out << p.getIndex() << ',';
+        p.setIndex(i);
+        out << p.getTo('x') << ',' << p.getIndex() << ',';
+        p.setIndex(i);
+        out << p.getTo('x', false) << ',' << p.getIndex() << ',';
+        p.setIndex(i);
+        out << p.getQuotedString() << ',' << p.getIndex() << ',';
+        p.setIndex(i);
+        out << p.getWord() << ',' << p.getToEOL() << ',' << p.getIndex() << ',';
+        p.setIndex(i);
+        out << p.nextIs(" \t\r\n", true) << p.getIndex() << ';';
+    }
+    return out.str();
+}
+
+bool testStringParserScan()
+{
+    std::cout << "String parser scanning test started..." << std::endl;
+    const char chars[] = " \t\r\naxy\"'\\";
+    unsigned int seed = 12345;
+    for(int test = 0; test < 200; test++)
+    {
+        std::string str;
+        // Mostly long runs of one character so the vector blocks are used.
+        int runs = 1 + test % 8;
+        for(int r = 0; r < runs; r++)
+        {
+            seed = seed * 1103515245 + 12345;
+            char c = chars[(seed >> 16) % (sizeof (chars) - 1)];
+            seed = seed * 1103515245 + 12345;
+            str.append((seed >> 16) % 40, c);
+        }
+        bool tab = (test & 1) == 0;
+        KSimd::setMaxLevel(KSimd::Level::SCALAR);
+        std::string expected = scanResults(str, tab);
+        for(int level = (int) KSimd::Level::SSE2; level <= (int) KSimd::Level::AVX2; level++)
+        {
+            KSimd::setMaxLevel((KSimd::Level) level);
+            if(scanResults(str, tab) != expected)
+            {
+                KSimd::setMaxLevel(KSimd::Level::AVX2);
+                std::cout << "Vector scan does not match for: " << KString::escape(str, true) << std::endl;
+                return false;
+            }
+        }
+    }
+    KSimd::setMaxLevel(KSimd::Level::AVX2);
+    std::cout << "String parser scanning test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+/**
+ * Read every token of a parser.
+ * @return A description of the tokens.
+ */
+std::string readTokens(StringParser<char> &p)
+{
+    std::ostringstream out;
+    while(!p.isEnd())
+    {
+        p.skipWhitespace(true);
+        char c = p.peekChar();
+        if(c == '"' || c == '\'')
+        {
+            out << p.getQuotedString();
+            p.skip(1);
+        }
+        else if(c == '-' || p.isDigit())
+        {
+            if(p.isDecimal())
+            {
+                out << p.getDouble();
+            }
+            else
+            {
+                out << p.getLong();
+            }
+        }
+        else if(c == '#')
+        {
+            out << p.getToEOL();
+        }
+        else if(c == '<')
+        {
+            out << p.getTo('>', false);
+            p.skip(1);
+        }
+        else if(p.nextIs("0x", true))
+        {
+            out << p.getHex();
+        }
+        else if((c & 0x80) != 0)
+        {
+            out << (long) p.getCharUTF();
+        }
+        else
+        {
+            out << p.getWord();
+        }
+        out << '@' << p.getIndex() << ';';
+    }
+    return out.str();
+}
+
+bool testStringParserSource()
+{
+    std::cout << "String parser source test started..." << std::endl;
+    std::string text;
+    for(int i = 0; i < 50; i++)
+    {
+        text += "\"a quoted string longer than the window \\\" \" -12.5e2 ";
+        text += std::to_string(i * 7919) + " 'it\\'s' 0x1F word\tother  <tag>\r\n";
+        text += u8"z水\U0001d10b # a comment to the end of the line\n";
+    }
+    StringParser<char> memory(text);
+    std::string expected = readTokens(memory);
+    for(size_t window : {16, 17, 100, 4096})
+    {
+        std::istringstream in(text);
+        StringStreamSource<char> source(in);
+        StringParser<char> p(source, window);
+        if(readTokens(p) != expected)
+        {
+            std::cout << "Stream tokens do not match with a window of " << window << std::endl;
+            return false;
+        }
+    }
+    int fds[2];
+    if(pipe(fds) != 0)
+    {
+        std::cout << "Could not create a pipe." << std::endl;
+        return false;
+    }
+    std::thread writer([&]() {
+        size_t done = 0;
+        while(done < text.length())
+        {
+            // Write in small pieces so reads return part of the text.
+            ssize_t put = write(fds[1], text.data() + done, std::min((size_t) 37, text.length() - done));
+            if(put <= 0)
+            {
+                break;
+            }
+            done += put;
+        }
+        close(fds[1]);
+    });
+    StringFileSource source(fds[0]);
+    StringParser<char> p(source, 64);
+    std::string piped = readTokens(p);
+    writer.join();
+    close(fds[0]);
+    if(piped != expected || source.getError() != 0)
+    {
+        std::cout << "Pipe tokens do not match." << std::endl;
+        return false;
+    }
+    std::cout << "String parser source test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+bool testStringParserViews()
+{
+    std::cout << "String parser views test started..." << std::endl;
+    std::string text = "key1 = \"a \\\"quoted\\\" \\\\ value\\n\"\r\nkey2\t= 'it\\'s \\q \\\x01 \xC3\xA9\\\xC3\xA9'\nlast line";
+    StringParser<char> p(text.data(), text.length());
+    StringParser<char> copy(text);
+    std::string buffer;
+    std::string decoded;
+    while(!p.isEnd())
+    {
+        long start = p.getIndex();
+        StringToken<char> key = p.viewWord();
+        if(key != copy.getWord() || key.data() < text.data() || key.data() + key.length() > text.data() + text.length())
+        {
+            std::cout << "Word view does not match." << std::endl;
+            return false;
+        }
+        p.skipWhitespace(false);
+        copy.skipWhitespace(false);
+        p.getTo(buffer, '=', false);
+        if(buffer != copy.getTo('=', false))
+        {
+            std::cout << "Buffered string does not match." << std::endl;
+            return false;
+        }
+        p.skip(1);
+        copy.skip(1);
+        p.skipWhitespace(false);
+        copy.skipWhitespace(false);
+        if(p.peekChar() == '"' || p.peekChar() == '\'')
+        {
+            long quote = p.getIndex();
+            StringToken<char> value = p.viewQuotedString();
+            if(value != copy.getQuotedString())
+            {
+                std::cout << "Quoted string view does not match." << std::endl;
+                return false;
+            }
+            StringParser<char>::unescape(value, decoded);
+            if(decoded != KString::unescape(value.str()))
+            {
+                std::cout << "Decoded string does not match: " << decoded << std::endl;
+                return false;
+            }
+            p.setIndex(quote);
+            p.getQuotedString(buffer, true);
+            if(buffer != decoded)
+            {
+                std::cout << "Buffered decoded string does not match." << std::endl;
+                return false;
+            }
+            p.skip(1);
+            copy.skip(1);
+        }
+        if(p.viewToEOL() != copy.getToEOL() || p.viewRange(start, 4) != copy.getRange(start, 4))
+        {
+            std::cout << "Line view does not match." << std::endl;
+            return false;
+        }
+        p.skipWhitespace(true);
+        copy.skipWhitespace(true);
+    }
+    std::cout << "String parser views test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+/**
+ * Decode a string one byte at a time with KUTF::UTFCodeParser, the way
+ * StringParser reads characters, as a reference for its fast decoding.
+ * @return A description of the characters and words read.
+ */
+std::string referenceUTF(const std::string &str, bool words)
+{
+    std::ostringstream out;
+    KUTF::UTFCodeParser code;
+    long index = 0;
+    long length = str.length();
+    while(index < length)
+    {
+        std::string word;
+        char32_t c;
+        do
+        {
+            int res;
+            c = -1;
+            if(index < length)
+            {
+                do
+                {
+                    res = code.addChar(str[index++]);
+                }
+                while(res != 0 && index < length);
+                c = res == 0 ? code.getCode() : -1;
+                if(res != 0)
+                {
+                    code.reset();
+                }
+            }
+            if(words && c != (char32_t) -1 && c != ' ' && c != '\t')
+            {
+                word += code.getUTF<char>();
+            }
+        }
+        while(words && c != (char32_t) -1 && c != ' ' && c != '\t');
+        if(words)
+        {
+            out << KString::escape(word) << '@' << index << ';';
+        }
+        else
+        {
+            out << (long) c << '@' << index << ';';
+        }
+    }
+    return out.str();
+}
+
+/**
+ * Decode a string with a parser.
+ * @return A description of the characters and words read.
+ */
+std::string parserUTF(StringParser<char> &p, bool words)
+{
+    std::ostringstream out;
+    while(!p.isEnd())
+    {
+        if(words)
+        {
+            out << KString::escape(p.getWordUTF()) << '@' << p.getIndex() << ';';
+        }
+        else
+        {
+            char32_t peek = p.peekCharUTF();
+            char32_t c = p.getCharUTF();
+            if(peek != c)
+            {
+                return "peek does not match";
+            }
+            out << (long) c << '@' << p.getIndex() << ';';
+        }
+    }
+    return out.str();
+}
+
+bool testStringParserUTF()
+{
+    std::cout << "String parser UTF test started..." << std::endl;
+    // Well formed, overlong, truncated and invalid sequences.
+    const unsigned char bytes[] = {'a', 'Z', ' ', '\t', 0x80, 0xBF, 0xA9, 0x9D, 0x84, 0x8B, 0xC0, 0xC3, 0xE6, 0xF0, 0xF8, 0xFF};
+    unsigned int seed = 4321;
+    for(int test = 0; test < 500; test++)
+    {
+        std::string str;
+        int size = test % 60;
+        for(int i = 0; i < size; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            // Mostly well formed text.
+            if(((seed >> 16) & 3) != 0)
+            {
+                str += ((seed >> 20) & 1) != 0 ? u8"é水𝄋 " : "ascii";
+            }
+            else
+            {
+                str += (char) bytes[(seed >> 20) % sizeof (bytes)];
+            }
+        }
+        for(int words = 0; words < 2; words++)
+        {
+            std::string expected = referenceUTF(str, words != 0);
+            StringParser<char> memory(str);
+            std::istringstream in(str);
+            StringStreamSource<char> source(in);
+            StringParser<char> stream(source, 16);
+            if(parserUTF(memory, words != 0) != expected || parserUTF(stream, words != 0) != expected)
+            {
+                std::cout << "UTF decoding does not match for: " << KString::escape(str) << std::endl;
+                return false;
+            }
+        }
+    }
+    std::cout << "String parser UTF test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
+bool testStringParserLines()
+{
+    std::cout << "String parser lines test started..." << std::endl;
+    std::string text;
+    for(int i = 0; i < 300; i++)
+    {
+        text += std::string(i % 70, 'x') + (i % 3 == 0 ? "\r\n" : "\n");
+    }
+    text += "last";
+    StringParser<char> memory(text);
+    std::istringstream in(text);
+    StringStreamSource<char> source(in);
+    StringParser<char> stream(source, 64);
+    long line = 1;
+    long column = 1;
+    for(long i = 0; i <= (long) text.length(); i++)
+    {
+        // Out of order lookups in memory, in order while streaming.
+        long j = (i * 7919) % (text.length() + 1);
+        long jLine = std::count(text.begin(), text.begin() + j, '\n') + 1;
+        long jColumn = j - (long) text.rfind('\n', j - 1);
+        if(j == 0 || text.rfind('\n', j - 1) == std::string::npos)
+        {
+            jColumn = j + 1;
+        }
+        if(memory.getLine(j) != jLine || memory.getColumn(j) != jColumn)
+        {
+            std::cout << "Wrong position for index " << j << std::endl;
+            return false;
+        }
+        stream.setIndex(i);
+        if(stream.getLine(i) != line || stream.getColumn(i) != column)
+        {
+            std::cout << "Wrong streamed position for index " << i << std::endl;
+            return false;
+        }
+        if(i < (long) text.length() && text[i] == '\n')
+        {
+            line++;
+            column = 1;
+        }
+        else
+        {
+            column++;
+        }
+    }
+    // Excerpts stop at the end of the line and are centered on long lines.
+    long longLine = text.find(std::string(69, 'x'));
+    if(memory.getExcerpt(text.length() - 2) != "last" || memory.getExcerpt(8) != "xxx" || memory.getExcerpt(longLine + 30, 10) != std::string(10, 'x'))
+    {
+        std::cout << "Wrong excerpt." << std::endl;
+        return false;
+    }
+    std::cout << "String parser lines test complete!" << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
 //-------------------------------------------------------------------------
 // UTF tests
 
@@ -156,5 +582,86 @@ bool testEscape()
     return true;
 }
 
+//-------------------------------------------------------------------------
+// Number conversion tests
+
+#include <random>
+#include "String/KNumber.h"
+
+bool testKNumber()
+{
+    std::cout << "Starting number conversion tests." << std::endl;
+    // Text that needs the exact slow path as well as the fast one.
+    std::vector<std::string> texts = {
+        "0.1", "-0.3", "123.456", "2.123456789e+019", "1e23", "9007199254740993", "1.7976931348623157e308",
+        "2.2250738585072014e-308", "4.9e-324", "123456789012345678901234567890", "0.000000000000000000001234",
+        "3.141592653589793238462643383279", "1e-400", "1e400"
+    };
+    for(auto &text : texts)
+    {
+        double value;
+        const char *end = KNumber::parseDouble(text.data(), text.data() + text.length(), value);
+        if(end != text.data() + text.length() || value != std::strtod(text.c_str(), nullptr))
+        {
+            std::cout << "Number parsed incorrectly: " << text << std::endl;
+            return false;
+        }
+    }
+    // Integers stay integers unless they are too large.
+    long lValue;
+    double dValue;
+    bool isDouble;
+    std::string text = "-9223372036854775808";
+    KNumber::parse(text.data(), text.data() + text.length(), lValue, dValue, isDouble);
+    if(isDouble || lValue != LONG_MIN)
+    {
+        std::cout << "Integer parsed incorrectly: " << text << std::endl;
+        return false;
+    }
+    text = "9223372036854775808";
+    KNumber::parse(text.data(), text.data() + text.length(), lValue, dValue, isDouble);
+    if(!isDouble || dValue != 9223372036854775808.0)
+    {
+        std::cout << "Large integer parsed incorrectly: " << text << std::endl;
+        return false;
+    }
+    // Formatted doubles are short and read back exactly.
+    if(KNumber::toString(0.1) != "0.1" || KNumber::toString(100.0) != "100.0" || KNumber::toString(1e300) != "1e+300")
+    {
+        std::cout << "Number formatted incorrectly: " << KNumber::toString(0.1) << std::endl;
+        return false;
+    }
+    // Negative zero keeps its sign.
+    double zero;
+    KNumber::parseDouble("-0.0", "-0.0" + 4, zero);
+    if(KNumber::toString(-0.0) != "-0.0" || !std::signbit(zero))
+    {
+        std::cout << "Negative zero formatted incorrectly: " << KNumber::toString(-0.0) << std::endl;
+        return false;
+    }
+    std::mt19937_64 random(42);
+    for(int i = 0; i < 100000; i++)
+    {
+        uint64_t bits = random();
+        double value;
+        std::memcpy(&value, &bits, sizeof (value));
+        if(!std::isfinite(value))
+        {
+            continue;
+        }
+        std::string formatted = KNumber::toString(value);
+        double parsed;
+        KNumber::parseDouble(formatted.data(), formatted.data() + formatted.length(), parsed);
+        if(parsed != value || std::signbit(parsed) != std::signbit(value))
+        {
+            std::cout << "Number did not survive a round trip: " << formatted << std::endl;
+            return false;
+        }
+    }
+    std::cout << "Number conversion tests complete." << std::endl;
+    std::cout << std::endl;
+    return true;
+}
+
 #endif /* STRINGTEST_H */
 
@@ -0,0 +1,224 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KARENA_H
+#define KARENA_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace KayLib
+{
+
+    /**
+     * A bump allocator.  Memory is handed out from large blocks and is only
+     * released when the arena is cleared or destroyed.
+     * Objects created with create() have their destructors run, in reverse order
+     * of creation, when the arena is cleared.
+     * @note The arena is not thread safe.
+     */
+    class KArena : public std::enable_shared_from_this<KArena>
+    {
+    public:
+
+        /**
+         * Create a new arena.
+         * @param nBlockSize The size of the blocks to allocate memory from.
+         */
+        KArena(size_t nBlockSize = 64 * 1024)
+        {
+            blockSize = nBlockSize < 1024 ? 1024 : nBlockSize;
+            blocks = nullptr;
+            finalizers = nullptr;
+            bytesUsed = 0;
+            bytesReserved = 0;
+        }
+
+        KArena(const KArena& orig) = delete;
+        KArena &operator=(const KArena& orig) = delete;
+
+        virtual ~KArena()
+        {
+            clear();
+        }
+
+        /**
+         * Allocate raw memory from the arena.
+         * @param size The number of bytes to allocate.
+         * @param align The alignment of the memory.  Must be a power of two.
+         * @return The memory.  Never nullptr.
+         * @throws std::bad_alloc
+         */
+        void *allocate(size_t size, size_t align = alignof(std::max_align_t))
+        {
+            if(blocks != nullptr)
+            {
+                size_t offset = (blocks->used + align - 1) & ~(align - 1);
+                if(offset + size <= blocks->size)
+                {
+                    blocks->used = offset + size;
+                    bytesUsed += size;
+                    return blocks->data() + offset;
+                }
+            }
+            // Not enough room in the current block, start a new one.
+            size_t need = size + align;
+            newBlock(need > blockSize ? need : blockSize);
+            size_t offset = (blocks->used + align - 1) & ~(align - 1);
+            blocks->used = offset + size;
+            bytesUsed += size;
+            return blocks->data() + offset;
+        }
+
+        /**
+         * Construct an object in the arena.
+         * @param args The arguments to pass to the constructor.
+         * @return The new object.  It is destroyed when the arena is cleared.
+         */
+        template<typename T, typename... Args>
+        T *create(Args&&... args)
+        {
+            void *mem = allocate(sizeof (T), alignof(T));
+            T *object = new(mem) T(std::forward<Args>(args)...);
+            if(!std::is_trivially_destructible<T>::value)
+            {
+                Finalizer *fin = static_cast<Finalizer *>(allocate(sizeof (Finalizer), alignof(Finalizer)));
+                fin->object = object;
+                fin->destroy = &destroy<T>;
+                fin->next = finalizers;
+                finalizers = fin;
+            }
+            return object;
+        }
+
+        /**
+         * Copy a string into the arena.
+         * @param str The characters to copy.
+         * @param length The number of characters to copy.
+         * @return The null terminated copy.
+         */
+        char *copyString(const char *str, size_t length)
+        {
+            char *out = static_cast<char *>(allocate(length + 1, 1));
+            if(length > 0)
+            {
+                std::memcpy(out, str, length);
+            }
+            out[length] = 0;
+            return out;
+        }
+
+        /**
+         * Destroy all objects and release all memory held by the arena.
+         */
+        void clear()
+        {
+            while(finalizers != nullptr)
+            {
+                Finalizer *fin = finalizers;
+                finalizers = fin->next;
+                fin->destroy(fin->object);
+            }
+            while(blocks != nullptr)
+            {
+                Block *block = blocks;
+                blocks = block->next;
+                std::free(block);
+            }
+            bytesUsed = 0;
+            bytesReserved = 0;
+        }
+
+        /**
+         * Get the number of bytes handed out by the arena.
+         * @return The number of bytes.
+         */
+        size_t getBytesUsed() const
+        {
+            return bytesUsed;
+        }
+
+        /**
+         * Get the number of bytes the arena has reserved from the system.
+         * @return The number of bytes.
+         */
+        size_t getBytesReserved() const
+        {
+            return bytesReserved;
+        }
+
+    private:
+
+        struct Block
+        {
+            Block *next;
+            size_t size;
+            size_t used;
+
+            char *data()
+            {
+                return reinterpret_cast<char *>(this) + headerSize();
+            }
+
+            static size_t headerSize()
+            {
+                return (sizeof (Block) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+            }
+        };
+
+        struct Finalizer
+        {
+            Finalizer *next;
+            void (*destroy)(void *);
+            void *object;
+        };
+
+        size_t blockSize;
+        Block *blocks;
+        Finalizer *finalizers;
+        size_t bytesUsed;
+        size_t bytesReserved;
+
+        void newBlock(size_t size)
+        {
+            Block *block = static_cast<Block *>(std::malloc(Block::headerSize() + size));
+            if(block == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            block->next = blocks;
+            block->size = size;
+            block->used = 0;
+            blocks = block;
+            bytesReserved += size;
+        }
+
+        template<typename T>
+        static void destroy(void *object)
+        {
+            static_cast<T *>(object)->~T();
+        }
+
+    };
+
+}
+
+#endif /* KARENA_H */
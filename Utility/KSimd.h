@@ -0,0 +1,131 @@
+/*
+ * Copyright 2017 Robert Reinhart.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Runtime detection of the vector instruction sets available to the library.
+ * Define KAYLIB_NO_SIMD to build without any vector code.
+ */
+
+#ifndef KSIMD_H
+#define KSIMD_H
+
+#include <cstdint>
+
+#if !defined(KAYLIB_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define KAYLIB_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace KayLib
+{
+
+    class KSimd
+    {
+    public:
+
+        enum class Level
+        {
+            SCALAR, SSE2, AVX2
+        };
+
+        /**
+         * Get the best instruction set that may be used.
+         * @return The instruction set level.
+         */
+        static Level level()
+        {
+            static Level detected = detect();
+            Level max = maxLevel();
+            return detected < max ? detected : max;
+        }
+
+        /**
+         * Limit the instruction set the library will use.
+         * Useful for testing the fallback code paths.
+         * @param max The highest instruction set level to use.
+         */
+        static void setMaxLevel(Level max)
+        {
+            maxLevel() = max;
+        }
+
+        /**
+         * Count the trailing zero bits of a value.
+         * @param value The value, must not be zero.
+         * @return The number of trailing zero bits.
+         */
+        static int trailingZeros(uint64_t value)
+        {
+#if defined(__GNUC__)
+            return __builtin_ctzll(value);
+#else
+            int count = 0;
+            while((value & 1) == 0)
+            {
+                value >>= 1;
+                count++;
+            }
+            return count;
+#endif
+        }
+
+        /**
+         * Count the set bits of a value.
+         * @param value The value.
+         * @return The number of set bits.
+         */
+        static int popCount(uint64_t value)
+        {
+#if defined(__GNUC__)
+            return __builtin_popcountll(value);
+#else
+            int count = 0;
+            while(value != 0)
+            {
+                value &= value - 1;
+                count++;
+            }
+            return count;
+#endif
+        }
+
+    private:
+
+        static Level &maxLevel()
+        {
+            static Level max = Level::AVX2;
+            return max;
+        }
+
+        static Level detect()
+        {
+#ifdef KAYLIB_SIMD_X86
+            __builtin_cpu_init();
+            if(__builtin_cpu_supports("avx2"))
+            {
+                return Level::AVX2;
+            }
+            return Level::SSE2;
+#else
+            return Level::SCALAR;
+#endif
+        }
+
+    };
+
+}
+
+#endif /* KSIMD_H */